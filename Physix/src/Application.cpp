@@ -3,8 +3,10 @@
 #include <GLFW/glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 #include <iostream>
+#include <fstream>
 #include <algorithm>
 #include <vector>
 #include <cmath>
@@ -18,11 +20,33 @@
 #include "Cuboid_mesh.h"  // For the floor
 #include "Cuboid.h"       // For the floor
 #include "camera.h"
+#include "broadphase.h"
+#include "neighbor_list.h"
+#include "static_bvh.h"
+#include "pair_cache.h"
+#include "sphere_narrowphase.h"
+#include "container_collider.h"
+#include "cuboid_narrowphase.h"
+#include "cuboid_dynamics.h"
+#include "convex_narrowphase.h"
+#include "convex_mesh.h"
+#include "shape_narrowphase.h"
+#include "compound_shape.h"
+#include "triangle_mesh.h"
+#include "surface_mesh.h"
+#include "heightfield.h"
+#include "distance_field.h"
+#include "broadphase_bench.h"
+#include "raycast.h"
+#include "parallel.h"
 
 // Window dimensions
 unsigned int SCR_WIDTH = 1600;
 unsigned int SCR_HEIGHT = 1200;
 
+// Half the side of the box the walls enclose; the spheres' container matches it.
+const float BOX_HALF_SIZE = 30.0f;
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     SCR_WIDTH = width;
     SCR_HEIGHT = height;
@@ -99,8 +123,7 @@ void SphereSpawner(std::vector<Sphere>& spheres, Sphere_mesh* sphereMesh, float
 void WallSpawner(std::vector<Cuboid>& walls, Cuboid_mesh* wallMesh) {
     walls.clear();
 
-    float regionSize = 60.0f;
-    float halfSize = regionSize / 2.0f;
+    float halfSize = BOX_HALF_SIZE;
     float thickness = 1.0f;
 
     // Floor (XZ plane, no rotation)
@@ -134,20 +157,230 @@ void WallSpawner(std::vector<Cuboid>& walls, Cuboid_mesh* wallMesh) {
         glm::vec3(glm::radians(90.0f), 0.0f, 0.0f));
 }
 
+// Ledges: tilted slabs high up in the corners of the box, appended to 'cuboids'.
+void LedgeSpawner(std::vector<Cuboid>& cuboids, Cuboid_mesh* ledgeMesh) {
+    float offset = BOX_HALF_SIZE - 8.0f;
+    cuboids.emplace_back(ledgeMesh, glm::vec3(-offset, 12.0f, -offset), glm::vec3(0.3f, 0.0f, -0.3f));
+    cuboids.emplace_back(ledgeMesh, glm::vec3(offset, 8.0f, offset), glm::vec3(-0.3f, 0.0f, 0.3f));
+}
+
 
+// Rocks: random convex hulls, one in the middle of the box where the spheres gather
+// and a few around it. The colliders point into 'hulls', which must not grow afterwards.
+void RockSpawner(std::vector<ConvexHull>& hulls, std::vector<ConvexCollider>& rocks, size_t count, std::mt19937* gen) {
+    hulls.clear();
+    rocks.clear();
+    hulls.reserve(count);
+
+    for (size_t i = 0; i < count; i++) {
+        float size = i == 0 ? 6.0f : uniform(gen, 2.0f, 4.0f);
+        std::vector<glm::vec3> points;
+        for (int k = 0; k < 40; k++) {
+            glm::vec3 direction(normal(gen, 0.0f, 1.0f), normal(gen, 0.0f, 1.0f), normal(gen, 0.0f, 1.0f));
+            points.push_back(glm::normalize(direction) * size * uniform(gen, 0.7f, 1.0f));
+        }
+        hulls.emplace_back(points);
 
-void ProcessCollisions(std::vector<Sphere>& spheres, std::vector<Cuboid>& walls, float deltaTime, int iterations, int thread_id) {
-    size_t siz = spheres.size(); int batch_size = siz / 10;
-    int left = batch_size * thread_id;
-    int right = (thread_id == 9) ? siz : batch_size * (thread_id + 1);
+        glm::vec3 center = i == 0 ? glm::vec3(0.0f) :
+            glm::vec3(uniform(gen, -20.0f, 20.0f), uniform(gen, -20.0f, 20.0f), uniform(gen, -20.0f, 20.0f));
+        glm::quat orientation = glm::normalize(glm::quat(uniform(gen, -1.0f, 1.0f), uniform(gen, -1.0f, 1.0f),
+            uniform(gen, -1.0f, 1.0f), uniform(gen, -1.0f, 1.0f)));
+        rocks.push_back({ &hulls.back(), glm::vec3(0.0f), center, glm::mat3_cast(orientation), 0.0f, false });
+    }
+}
+
+// Posts: capsules and cylinders standing in a circle around the middle of the box,
+// each leaning a little.
+void PostSpawner(std::vector<ShapeBody>& posts, size_t count, std::mt19937* gen) {
+    posts.clear();
+    for (size_t i = 0; i < count; i++) {
+        float angle = 2.0f * 3.14159265f * (i + 0.5f) / count;
+        glm::vec3 position(9.0f * std::cos(angle), uniform(gen, -3.0f, 3.0f), 9.0f * std::sin(angle));
+        glm::quat lean = glm::angleAxis(uniform(gen, -0.3f, 0.3f), glm::vec3(std::cos(angle), 0.0f, std::sin(angle)));
+        Shape shape = i % 2 == 0 ? MakeCapsuleShape(1.0f, 5.0f) : MakeCylinderShape(1.2f, 5.0f);
+        posts.push_back({ shape, position, glm::mat3_cast(lean) });
+    }
+}
+
+// A post's surface as an indexed triangle list in world space: its profile in the
+// (radius, y) plane swept around its axis.
+void PostSurface(const ShapeBody& post, int segments, std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices) {
+    std::vector<glm::vec2> profile;
+    float r = post.shape.radius, h = post.shape.halfHeight;
+    if (post.shape.type == ShapeType::Capsule) {
+        for (int k = 0; k <= 8; k++) {
+            float a = 0.5f * 3.14159265f * (k / 8.0f - 1.0f);
+            profile.emplace_back(r * std::cos(a), -h + r * std::sin(a));
+        }
+        for (int k = 0; k <= 8; k++) {
+            float a = 0.5f * 3.14159265f * k / 8.0f;
+            profile.emplace_back(r * std::cos(a), h + r * std::sin(a));
+        }
+    }
+    else {
+        profile = { { 0.0f, -h }, { r, -h }, { r, h }, { 0.0f, h } };
+    }
+
+    unsigned int base = static_cast<unsigned int>(vertices.size());
+    unsigned int rows = static_cast<unsigned int>(profile.size());
+    for (int i = 0; i < segments; i++) {
+        float a = 2.0f * 3.14159265f * i / segments;
+        for (const glm::vec2& p : profile) {
+            vertices.push_back(post.position + post.rotation * glm::vec3(p.x * std::cos(a), p.y, p.x * std::sin(a)));
+        }
+    }
+    for (int i = 0; i < segments; i++) {
+        unsigned int column = base + i * rows;
+        unsigned int next = base + ((i + 1) % segments) * rows;
+        for (unsigned int k = 0; k + 1 < rows; k++) {
+            indices.insert(indices.end(), { column + k, column + k + 1, next + k, next + k, column + k + 1, next + k + 1 });
+        }
+    }
+}
+
+// Tables: a top and four legs each, one compound per table so the world holds a
+// single proxy for it. The bodies point into 'compounds', which must not grow afterwards.
+void TableSpawner(std::vector<CompoundShape>& compounds, std::vector<ShapeBody>& tables, size_t count) {
+    compounds.assign(count, CompoundShape());
+    tables.clear();
+    for (size_t i = 0; i < count; i++) {
+        CompoundShape& table = compounds[i];
+        table.AddChild(MakeBoxShape(glm::vec3(3.0f, 0.2f, 2.0f)), glm::vec3(0.0f, 1.6f, 0.0f));
+        for (int k = 0; k < 4; k++) {
+            glm::vec3 corner((k & 1 ? 1.0f : -1.0f) * 2.6f, 0.0f, (k & 2 ? 1.0f : -1.0f) * 1.6f);
+            table.AddChild(MakeCylinderShape(0.2f, 1.5f), corner);
+        }
+        table.Build();
+
+        float angle = 2.0f * 3.14159265f * (i + 0.25f) / count;
+        glm::vec3 position(18.0f * std::cos(angle), -22.5f, 18.0f * std::sin(angle));
+        tables.push_back({ MakeCompoundShape(table), position, glm::mat3_cast(glm::angleAxis(-angle, glm::vec3(0.0f, 1.0f, 0.0f))) });
+    }
+}
+
+// A box's surface as an indexed triangle list in world space, four vertices per face.
+void BoxSurface(const ShapeBody& box, std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices) {
+    const glm::vec3& h = box.shape.halfExtents;
+    for (int axis = 0; axis < 3; axis++) {
+        int u = (axis + 1) % 3, v = (axis + 2) % 3;
+        for (float side : { -1.0f, 1.0f }) {
+            unsigned int base = static_cast<unsigned int>(vertices.size());
+            for (int k = 0; k < 4; k++) {
+                glm::vec3 p;
+                p[axis] = side * h[axis];
+                p[u] = (k == 1 || k == 2 ? 1.0f : -1.0f) * h[u];
+                p[v] = (k >= 2 ? 1.0f : -1.0f) * h[v];
+                vertices.push_back(box.position + box.rotation * p);
+            }
+            if (side > 0.0f) indices.insert(indices.end(), { base, base + 1, base + 2, base, base + 2, base + 3 });
+            else indices.insert(indices.end(), { base, base + 2, base + 1, base, base + 3, base + 2 });
+        }
+    }
+}
+
+// A compound's surface: its children's, placed in the world.
+void CompoundSurface(const ShapeBody& body, int segments, std::vector<glm::vec3>& vertices,
+    std::vector<unsigned int>& indices) {
+    const CompoundShape& compound = *body.shape.compound;
+    for (size_t k = 0; k < compound.getChildCount(); k++) {
+        const ShapeBody& child = compound.getChild(k);
+        ShapeBody placed = { child.shape, body.position + body.rotation * child.position, body.rotation * child.rotation };
+        if (child.shape.type == ShapeType::Box) BoxSurface(placed, vertices, indices);
+        else PostSurface(placed, segments, vertices, indices);
+    }
+}
+
+// Terrain: a wavy grid of n x n samples across the floor of the box.
+void TerrainSpawner(std::vector<float>& heights, unsigned int n) {
+    heights.resize(size_t(n) * n);
+    for (unsigned int z = 0; z < n; z++) {
+        for (unsigned int x = 0; x < n; x++) {
+            float u = BOX_HALF_SIZE * (2.0f * x / (n - 1) - 1.0f);
+            float v = BOX_HALF_SIZE * (2.0f * z / (n - 1) - 1.0f);
+            heights[size_t(z) * n + x] = -25.0f + 2.0f * std::sin(0.3f * u) * std::cos(0.25f * v);
+        }
+    }
+}
+
+// Ring: a torus lying flat around the middle of the box, as an indexed triangle list.
+void RingSpawner(std::vector<glm::vec3>& vertices, std::vector<unsigned int>& indices, float radius, float thickness,
+    int segments, int sides) {
+    vertices.clear();
+    indices.clear();
+    for (int i = 0; i < segments; i++) {
+        float a = 2.0f * 3.14159265f * i / segments;
+        for (int j = 0; j < sides; j++) {
+            float b = 2.0f * 3.14159265f * j / sides;
+            float r = radius + thickness * std::cos(b);
+            vertices.emplace_back(r * std::cos(a), thickness * std::sin(b), r * std::sin(a));
+        }
+    }
+    for (int i = 0; i < segments; i++) {
+        for (int j = 0; j < sides; j++) {
+            unsigned int i0 = static_cast<unsigned int>(i * sides + j);
+            unsigned int i1 = static_cast<unsigned int>(((i + 1) % segments) * sides + j);
+            unsigned int i2 = static_cast<unsigned int>(((i + 1) % segments) * sides + (j + 1) % sides);
+            unsigned int i3 = static_cast<unsigned int>(i * sides + (j + 1) % sides);
+            indices.insert(indices.end(), { i0, i3, i1, i1, i3, i2 });
+        }
+    }
+}
+
+void ProcessCollisions(std::vector<Sphere>& spheres, const ContainerCollider& container,
+    const std::vector<Cuboid>& staticCuboids, const StaticBVH& staticWorld, unsigned int wallCount,
+    CuboidNarrowphase& cuboidNarrowphase,
+    Broadphase& broadphase, std::vector<CollisionPair>& pairs, std::vector<CollisionPair>& contactPairs,
+    PairCache& pairCache, SphereNarrowphase& narrowphase,
+    ConvexNarrowphase& convexNarrowphase, ShapeNarrowphase& shapeNarrowphase,
+    const TriangleMesh& ring,
+    const Heightfield& terrain, const SignedDistanceField* worldField, float deltaTime, int iterations) {
+    float subDeltaTime = deltaTime / iterations;
+    // Pairs that can touch within a substep are speculative contacts, so fast spheres
+    // do not tunnel at any substep count; more substeps only add accuracy.
+    broadphase.setSpeculativeTime(subDeltaTime);
 
     for (int i = 0; i < iterations; i++) {
-        for (int j = left; j < right; j++) {
-            spheres[j].ProcessSphereCollision(spheres);
-            spheres[j].ProcessCuboidCollision(walls);
-            spheres[j].Update(deltaTime / iterations);
-            spheres[j].SetAcceleration(-10.0f * spheres[j].position);
+        // Broadphase: overlapping pairs and speculative ones, which can touch within the substep.
+        broadphase.Update(spheres);
+        pairs.clear();
+        broadphase.FindPairs(pairs);
+
+        // Classify the pairs that actually overlap against the previous substep into
+        // begin / persist / end events; near misses are not contacts.
+        contactPairs.clear();
+        for (const CollisionPair& pair : pairs) {
+            const Sphere& a = spheres[pair.a];
+            const Sphere& b = spheres[pair.b];
+            if (SpheresOverlap(a.position, a.mesh->getRadius(), b.position, b.mesh->getRadius())) contactPairs.push_back(pair);
         }
+        pairCache.Update(contactPairs);
+
+        // Pairs share bodies, so they are resolved on a single thread, in SIMD blocks
+        // of pairs that share none.
+        narrowphase.Resolve(spheres, pairs, subDeltaTime);
+        // Rocks keep each contact's GJK simplex from the last substep.
+        convexNarrowphase.Resolve(spheres, subDeltaTime);
+        // Posts and tables go through the shape-pair kernels.
+        shapeNarrowphase.Resolve(spheres, subDeltaTime);
+
+        // Static geometry and integration only touch their own sphere, so they run in parallel.
+        ParallelForRange(spheres.size(), [&](size_t left, size_t right, unsigned int batch) {
+            // The walls are a container: a clamp per axis, a block of spheres at a time.
+            ResolveContainerRange(spheres, left, right, container);
+            // Any other static Cuboid goes through the StaticBVH, four spheres per box test.
+            if (!worldField) {
+                cuboidNarrowphase.ResolveRange(spheres, left, right, batch, staticCuboids, staticWorld, wallCount);
+            }
+            // The ring's query stats are merged once per batch.
+            if (!worldField) ResolveMeshRange(spheres, left, right, ring, subDeltaTime);
+            for (size_t j = left; j < right; j++) {
+                Sphere& sphere = spheres[j];
+                if (worldField) ResolveDistanceFieldCollision(sphere, *worldField, subDeltaTime);
+                ResolveHeightfieldCollision(sphere, terrain, subDeltaTime);
+                sphere.Update(subDeltaTime);
+                sphere.SetAcceleration(-10.0f * sphere.position);
+            }
+        });
     }
 }
 
@@ -206,7 +439,7 @@ void main() {
 }
 )";
 
-int main() {
+int main(int argc, char** argv) {
     GLFWwindow* window = initialize(); if (window == nullptr)return -1;
 
     // Build shader program.
@@ -216,7 +449,9 @@ int main() {
     // Create meshes for sphere and wall
     Sphere_mesh sphereMesh_high = get_sphere_mesh(1.0f, 25, 15);
     Sphere_mesh sphereMesh_low = get_sphere_mesh(1.0f, 10, 5);
-    Cuboid_mesh wallMesh(60.0f, 60.0f, 1.0f);
+    Cuboid_mesh wallMesh(2.0f * BOX_HALF_SIZE, 2.0f * BOX_HALF_SIZE, 1.0f);
+    Cuboid_mesh crateMesh(2.0f, 2.0f, 2.0f);
+    Cuboid_mesh ledgeMesh(10.0f, 6.0f, 0.8f);
 
     // Set up random number generators
     std::random_device rd;
@@ -227,6 +462,122 @@ int main() {
     std::vector<Cuboid> walls;
     WallSpawner(walls, &wallMesh);
 
+    // Every static Cuboid: the walls first, then the ledges.
+    std::vector<Cuboid> staticCuboids(walls);
+    LedgeSpawner(staticCuboids, &ledgeMesh);
+
+    // The spheres see the walls as the container they bound and the other Cuboids
+    // through the narrowphase; all of them stay for drawing, the crates, rays and the
+    // distance field.
+    ContainerCollider container{ glm::vec3(-BOX_HALF_SIZE), glm::vec3(BOX_HALF_SIZE) };
+    CuboidNarrowphase cuboidNarrowphase;
+    // The static Cuboids never move, so their acceleration structure is built once.
+    StaticBVH staticWorld;
+    staticWorld.Build(staticCuboids);
+
+    // "--bench" runs the broadphase validation and benchmark instead of the simulation.
+    // The meshes it creates need the GL context, so this comes after initialize().
+    BenchOptions benchOptions;
+    if (ParseBenchArgs(argc, argv, benchOptions)) {
+        std::ofstream json(benchOptions.outputPath);
+        bool exact = RunBroadphaseBench(benchOptions, walls, json);
+        std::cout << "Benchmark written to " << benchOptions.outputPath
+            << (exact ? "" : " (some broadphases disagree with the oracle)") << "\n";
+        glfwTerminate();
+        return exact ? 0 : 1;
+    }
+
+    // Broadphase and the pair buffer it fills, reused every substep.
+    // Neighbour lists with a skin are only rebuilt once a sphere has moved half of it.
+    NeighborList broadphase(0.5f);
+    std::vector<CollisionPair> pairs;
+    std::vector<CollisionPair> contactPairs;
+    // Contacts that persist across substeps, with begin / end events.
+    PairCache pairCache;
+    SphereNarrowphase narrowphase;
+    std::vector<size_t> drawOrder;
+
+    std::vector<ConvexHull> rockHulls;
+    std::vector<ConvexCollider> rocks;
+    RockSpawner(rockHulls, rocks, 4, &gen);
+    ConvexNarrowphase convexNarrowphase;
+    convexNarrowphase.SetStatic(rocks);
+    std::vector<Convex_mesh> rockMeshes;
+    rockMeshes.reserve(rockHulls.size());
+    for (const ConvexHull& hull : rockHulls) rockMeshes.emplace_back(hull);
+
+    std::vector<ShapeBody> posts;
+    PostSpawner(posts, 6, &gen);
+    std::vector<CompoundShape> tableShapes;
+    std::vector<ShapeBody> tables;
+    TableSpawner(tableShapes, tables, 3);
+    std::vector<ShapeBody> staticShapes(posts);
+    staticShapes.insert(staticShapes.end(), tables.begin(), tables.end());
+    ShapeNarrowphase shapeNarrowphase;
+    shapeNarrowphase.SetStatic(staticShapes);
+    std::vector<glm::vec3> postVertices;
+    std::vector<unsigned int> postIndices;
+    for (const ShapeBody& post : posts) PostSurface(post, 24, postVertices, postIndices);
+    for (const ShapeBody& table : tables) CompoundSurface(table, 12, postVertices, postIndices);
+    Surface_mesh postMesh(postVertices, postIndices);
+
+    std::vector<glm::vec3> ringVertices;
+    std::vector<unsigned int> ringIndices;
+    RingSpawner(ringVertices, ringIndices, 14.0f, 2.0f, 64, 16);
+    TriangleMesh ring;
+    ring.Build(ringVertices, ringIndices);
+    Surface_mesh ringMesh(ringVertices, ringIndices);
+
+    const unsigned int terrainSize = 129;
+    std::vector<float> terrainHeights;
+    TerrainSpawner(terrainHeights, terrainSize);
+    Heightfield terrain;
+    terrain.Build(terrainHeights, terrainSize, terrainSize, glm::vec2(-BOX_HALF_SIZE), 2.0f * BOX_HALF_SIZE / (terrainSize - 1));
+    // Drawn from the quantized heights, so what is seen is what the spheres collide with.
+    std::vector<glm::vec3> terrainVertices;
+    std::vector<unsigned int> terrainIndices;
+    for (unsigned int z = 0; z < terrainSize; z++) {
+        for (unsigned int x = 0; x < terrainSize; x++) terrainVertices.push_back(terrain.getVertex(x, z));
+    }
+    for (unsigned int z = 0; z + 1 < terrainSize; z++) {
+        for (unsigned int x = 0; x + 1 < terrainSize; x++) {
+            unsigned int i = z * terrainSize + x;
+            terrainIndices.insert(terrainIndices.end(), { i, i + terrainSize, i + 1, i + 1, i + terrainSize, i + terrainSize + 1 });
+        }
+    }
+    Surface_mesh terrainMesh(terrainVertices, terrainIndices);
+
+    // The static Cuboids and the ring baked into a distance field, switched on with F. The bake
+    // is kept in the working directory and only redone when the geometry changes.
+    const std::string worldFieldPath = "static_world.sdf";
+    AABB worldRegion = { glm::vec3(-32.0f), glm::vec3(32.0f) };
+    SignedDistanceField worldField;
+    if (!worldField.Load(worldFieldPath, SignedDistanceField::InputKey(staticCuboids, &ring, worldRegion, 0.5f, 1.5f))) {
+        worldField.Bake(staticCuboids, staticWorld, &ring, worldRegion, 0.5f, 1.5f);
+        worldField.Save(worldFieldPath);
+    }
+    bool useWorldField = false;
+    bool togglingWorldField = false;
+    // The field knows distances only within its band, so its speculative contacts see
+    // just band - radius ahead; while it is on, the spheres keep at least this many substeps.
+    const int fieldSubsteps = 5;
+    // Sphere substeps per frame, a quality setting changed with + and -.
+    int iterations = 1;
+    bool changingIterations = false;
+
+    // Mouse picking: a left click highlights the sphere under the cursor.
+    Raycaster raycaster;
+    raycaster.SetStatic(staticCuboids, staticWorld);
+    bool picking = false;
+
+    // Crates: dynamic Cuboids under ordinary gravity, dropped with C.
+    std::vector<Cuboid> crates;
+    CuboidDynamics crateDynamics;
+    crateDynamics.SetStatic(staticCuboids);
+    // The crates have no speculative contacts, so they keep their own fixed substeps.
+    const int crateSubsteps = 5;
+    bool droppingCrate = false;
+
     // Enable depth testing
     glEnable(GL_DEPTH_TEST);
     float lastFrame = 0.0f;
@@ -247,6 +598,41 @@ int main() {
 
         // Activate shader and set view/projection matrices.
         shader.use(); camera.detectKeyPress(window, deltaTime);
+
+        bool clicked = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        if (clicked && !picking) {
+            double cursorX, cursorY;
+            glfwGetCursorPos(window, &cursorX, &cursorY);
+            Ray ray = { camera.getPosition(), camera.getPickDirection(cursorX, cursorY, SCR_WIDTH, SCR_HEIGHT),
+                camera.getMaxDist() };
+            RaycastHit hit;
+            // The terrain hides the spheres behind it: stop the ray where it meets the ground.
+            if (terrain.Cast(ray, hit)) ray.maxDistance = hit.distance;
+            raycaster.Update(spheres);
+            if (raycaster.Cast(ray, hit) && hit.type == RaycastHitType::Sphere) {
+                spheres[hit.body].SetColor(glm::vec3(1.0f));
+            }
+        }
+        picking = clicked;
+
+        bool drop = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+        if (drop && !droppingCrate) {
+            crates.emplace_back(&crateMesh,
+                glm::vec3(uniform(&gen, -20.0f, 20.0f), 20.0f, uniform(&gen, -20.0f, 20.0f)),
+                glm::vec3(uniform(&gen, 0.0f, 3.14f), uniform(&gen, 0.0f, 3.14f), uniform(&gen, 0.0f, 3.14f)));
+            crates.back().setMass(2.0f);
+        }
+        droppingCrate = drop;
+
+        bool toggle = glfwGetKey(window, GLFW_KEY_F) == GLFW_PRESS;
+        if (toggle && !togglingWorldField) useWorldField = !useWorldField;
+        togglingWorldField = toggle;
+
+        bool more = glfwGetKey(window, GLFW_KEY_EQUAL) == GLFW_PRESS;
+        bool fewer = glfwGetKey(window, GLFW_KEY_MINUS) == GLFW_PRESS;
+        if (more && !changingIterations) iterations = std::min(iterations + 1, 8);
+        if (fewer && !changingIterations) iterations = std::max(iterations - 1, 1);
+        changingIterations = more || fewer;
         float aspect = static_cast<float>(SCR_WIDTH) / static_cast<float>(SCR_HEIGHT);
 
         glm::mat4 view = camera.getViewMatrix();
@@ -262,10 +648,15 @@ int main() {
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         // Now render spheres (after transparent objects if blending is enabled)
-        std::sort(spheres.begin(), spheres.end(), [&camera](const Sphere& a, const Sphere& b) {
-            return camera.distanceFromCameraPlane(a.position) > camera.distanceFromCameraPlane(b.position);
+        // Sort a draw order rather than the spheres themselves, so sphere indices
+        // stay stable for the broadphase between frames.
+        drawOrder.resize(spheres.size());
+        for (size_t i = 0; i < drawOrder.size(); i++) drawOrder[i] = i;
+        std::sort(drawOrder.begin(), drawOrder.end(), [&camera, &spheres](size_t a, size_t b) {
+            return camera.distanceFromCameraPlane(spheres[a].position) > camera.distanceFromCameraPlane(spheres[b].position);
             });
-        for (Sphere& s : spheres) {
+        for (size_t index : drawOrder) {
+            Sphere& s = spheres[index];
             /*if (camera.distanceFromCameraPlane(s.position) > 50.0f)s.SetMesh(&sphereMesh_low);
             else s.SetMesh(&sphereMesh_high);*/
             
@@ -274,26 +665,49 @@ int main() {
             s.Render(shader);
         }
 
-        for (Cuboid& wall : walls) {
+        for (Cuboid& crate : crates) {
+            shader.setVec3("objectColor", glm::vec3(0.8f, 0.5f, 0.2f));
+            shader.setFloat("alpha", 1.0f);
+            crate.Render(shader);
+        }
+
+        for (size_t i = 0; i < rocks.size(); i++) {
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), rocks[i].center) * glm::mat4(rocks[i].rotation);
+            shader.setMat4("model", model);
+            shader.setVec3("objectColor", glm::vec3(0.45f, 0.4f, 0.35f));
+            shader.setFloat("alpha", 1.0f);
+            rockMeshes[i].render();
+        }
+
+        shader.setMat4("model", glm::mat4(1.0f));
+        shader.setVec3("objectColor", glm::vec3(0.6f, 0.6f, 0.65f));
+        shader.setFloat("alpha", 1.0f);
+        ringMesh.render();
+        shader.setVec3("objectColor", glm::vec3(0.55f, 0.35f, 0.25f));
+        postMesh.render();
+        shader.setVec3("objectColor", glm::vec3(0.35f, 0.5f, 0.3f));
+        terrainMesh.render();
+
+        for (Cuboid& wall : staticCuboids) {
             shader.setVec3("objectColor", glm::vec3(0.5f));
             shader.setFloat("alpha", 0.0f);
             wall.Render(shader);
         }
         
-        int iterations = 5;
-        int num_threads = 10;
-        std::vector<std::thread> threads;
-        std::vector<std::vector<Sphere>> batches;
-
-        for (int thread_id = 0; thread_id < num_threads; thread_id++) {
-            threads.emplace_back(ProcessCollisions, std::ref(spheres), std::ref(walls), deltaTime, iterations, thread_id);
-        }
-
-        for (auto& t : threads) {
-            t.join();
+        int substeps = useWorldField ? std::max(iterations, fieldSubsteps) : iterations;
+        ProcessCollisions(spheres, container, staticCuboids, staticWorld, static_cast<unsigned int>(walls.size()),
+            cuboidNarrowphase, broadphase, pairs, contactPairs, pairCache, narrowphase, convexNarrowphase, shapeNarrowphase, ring, terrain, useWorldField ? &worldField : nullptr, deltaTime, substeps);
+        for (int i = 0; i < crateSubsteps; i++) {
+            crateDynamics.Step(crates, deltaTime / crateSubsteps, glm::vec3(0.0f, -10.0f, 0.0f));
         }
         
-        std::cout << "No of Objects: " << sizz << " & " <<  "Current FPS: " << (int)(1 / deltaTime) << "\n";
+        std::cout << "No of Objects: " << sizz << " & " <<  "Current FPS: " << (int)(1 / deltaTime)
+            << " & " << "Neighbour list rebuilds: " << (int)(100 * broadphase.getRebuildFrequency()) << "%"
+            << " & " << "Contacts: " << pairCache.getPairCount() << " (+" << pairCache.getBeginPairs().size()
+            << " / -" << pairCache.getEndPairs().size() << ")"
+            << " & Substeps: " << substeps
+            << (useWorldField ? " & Static world: distance field" : "") << "\n";
+        broadphase.ResetStats();
         // Swap buffers and poll IO events.
         glfwSwapBuffers(window);
         glfwPollEvents();
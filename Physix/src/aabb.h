@@ -0,0 +1,37 @@
+#pragma once
+#include <algorithm>
+#include <glm/glm.hpp>
+
+// Axis-aligned bounding box in world space.
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    static AABB FromSphere(const glm::vec3& center, float radius) {
+        return { center - glm::vec3(radius), center + glm::vec3(radius) };
+    }
+
+    bool Overlaps(const AABB& other) const {
+        return min.x <= other.max.x && max.x >= other.min.x &&
+            min.y <= other.max.y && max.y >= other.min.y &&
+            min.z <= other.max.z && max.z >= other.min.z;
+    }
+
+    bool Contains(const AABB& other) const {
+        return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z &&
+            max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+    }
+
+    // Surface area, the cost metric of the surface area heuristic (SAH).
+    float SurfaceArea() const {
+        glm::vec3 d = max - min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    glm::vec3 Center() const { return 0.5f * (min + max); }
+    glm::vec3 Extents() const { return 0.5f * (max - min); }
+};
+
+inline AABB Merge(const AABB& a, const AABB& b) {
+    return { glm::min(a.min, b.min), glm::max(a.max, b.max) };
+}
@@ -0,0 +1,245 @@
+#include "aabb_tree.h"
+#include <algorithm>
+
+AABBTree::AABBTree(float margin, float displacementMultiplier)
+    : root(NULL_NODE), freeList(NULL_NODE), nodeCount(0), proxyCount(0),
+    margin(margin), displacementMultiplier(displacementMultiplier),
+    queryCount(0), queryVisits(0) {
+}
+
+int AABBTree::AllocateNode() {
+    int nodeId;
+    if (freeList != NULL_NODE) {
+        nodeId = freeList;
+        freeList = nodes[nodeId].parent;
+    }
+    else {
+        nodeId = static_cast<int>(nodes.size());
+        nodes.emplace_back();
+    }
+
+    TreeNode& node = nodes[nodeId];
+    node.parent = NULL_NODE;
+    node.child1 = NULL_NODE;
+    node.child2 = NULL_NODE;
+    node.height = 0;
+    node.userData = 0;
+    nodeCount++;
+    return nodeId;
+}
+
+void AABBTree::FreeNode(int nodeId) {
+    // Free nodes are chained through their parent index.
+    nodes[nodeId].parent = freeList;
+    nodes[nodeId].height = -1;
+    freeList = nodeId;
+    nodeCount--;
+}
+
+int AABBTree::CreateProxy(const AABB& box, unsigned int userData) {
+    int proxyId = AllocateNode();
+    nodes[proxyId].box = { box.min - glm::vec3(margin), box.max + glm::vec3(margin) };
+    nodes[proxyId].userData = userData;
+    InsertLeaf(proxyId);
+    proxyCount++;
+    return proxyId;
+}
+
+void AABBTree::DestroyProxy(int proxyId) {
+    RemoveLeaf(proxyId);
+    FreeNode(proxyId);
+    proxyCount--;
+}
+
+bool AABBTree::MoveProxy(int proxyId, const AABB& box, const glm::vec3& displacement) {
+    // Fat box: margin plus the predicted motion, only grown in the direction of travel.
+    AABB fat = { box.min - glm::vec3(margin), box.max + glm::vec3(margin) };
+    glm::vec3 d = displacementMultiplier * displacement;
+    fat.min += glm::min(d, glm::vec3(0.0f));
+    fat.max += glm::max(d, glm::vec3(0.0f));
+
+    const AABB& treeBox = nodes[proxyId].box;
+    if (treeBox.Contains(box)) {
+        // Still inside; only reinsert if the stored box has become far too loose
+        // (e.g. a fast body that has since slowed down).
+        AABB huge = { fat.min - glm::vec3(4.0f * margin), fat.max + glm::vec3(4.0f * margin) };
+        if (huge.Contains(treeBox)) return false;
+    }
+
+    RemoveLeaf(proxyId);
+    nodes[proxyId].box = fat;
+    InsertLeaf(proxyId);
+    return true;
+}
+
+void AABBTree::InsertLeaf(int leaf) {
+    if (root == NULL_NODE) {
+        root = leaf;
+        nodes[root].parent = NULL_NODE;
+        return;
+    }
+
+    // Descend towards the sibling with the lowest SAH cost.
+    AABB leafBox = nodes[leaf].box;
+    int index = root;
+    while (!nodes[index].IsLeaf()) {
+        int child1 = nodes[index].child1;
+        int child2 = nodes[index].child2;
+
+        float area = nodes[index].box.SurfaceArea();
+        float combinedArea = Merge(nodes[index].box, leafBox).SurfaceArea();
+
+        // Cost of making a new parent for this node and the leaf.
+        float cost = 2.0f * combinedArea;
+        // Minimum cost of pushing the leaf further down the tree.
+        float inheritanceCost = 2.0f * (combinedArea - area);
+
+        auto descendCost = [&](int child) {
+            float merged = Merge(leafBox, nodes[child].box).SurfaceArea();
+            if (nodes[child].IsLeaf()) return merged + inheritanceCost;
+            return merged - nodes[child].box.SurfaceArea() + inheritanceCost;
+        };
+        float cost1 = descendCost(child1);
+        float cost2 = descendCost(child2);
+
+        if (cost < cost1 && cost < cost2) break;
+        index = cost1 < cost2 ? child1 : child2;
+    }
+    int sibling = index;
+
+    // New parent replaces the sibling.
+    int oldParent = nodes[sibling].parent;
+    int newParent = AllocateNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].box = Merge(leafBox, nodes[sibling].box);
+    nodes[newParent].height = nodes[sibling].height + 1;
+    nodes[newParent].child1 = sibling;
+    nodes[newParent].child2 = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+
+    if (oldParent != NULL_NODE) {
+        if (nodes[oldParent].child1 == sibling) nodes[oldParent].child1 = newParent;
+        else nodes[oldParent].child2 = newParent;
+    }
+    else {
+        root = newParent;
+    }
+
+    RefitAncestors(nodes[leaf].parent);
+}
+
+void AABBTree::RemoveLeaf(int leaf) {
+    if (leaf == root) {
+        root = NULL_NODE;
+        return;
+    }
+
+    int parent = nodes[leaf].parent;
+    int grandParent = nodes[parent].parent;
+    int sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+    // The sibling takes the parent's place.
+    if (grandParent != NULL_NODE) {
+        if (nodes[grandParent].child1 == parent) nodes[grandParent].child1 = sibling;
+        else nodes[grandParent].child2 = sibling;
+        nodes[sibling].parent = grandParent;
+        FreeNode(parent);
+        RefitAncestors(grandParent);
+    }
+    else {
+        root = sibling;
+        nodes[sibling].parent = NULL_NODE;
+        FreeNode(parent);
+    }
+}
+
+void AABBTree::RefitAncestors(int index) {
+    while (index != NULL_NODE) {
+        TreeNode& node = nodes[index];
+        node.box = Merge(nodes[node.child1].box, nodes[node.child2].box);
+        node.height = 1 + std::max(nodes[node.child1].height, nodes[node.child2].height);
+
+        Rotate(index);
+        index = nodes[index].parent;
+    }
+}
+
+// Tries to swap one child of 'index' with a grandchild on the other side,
+// choosing the swap that shrinks the surface area the most.
+// e.g. swapping B with its nephew F turns A(B, C(F, G)) into A(F, C(B, G)).
+void AABBTree::Rotate(int index) {
+    TreeNode& A = nodes[index];
+    int B = A.child1;
+    int C = A.child2;
+    if (nodes[B].height < 1 && nodes[C].height < 1) return;
+
+    // Candidate swaps: (child to move down, grandchild to move up, its parent).
+    int bestChild = NULL_NODE, bestGrandChild = NULL_NODE, bestParent = NULL_NODE;
+    float bestGain = 0.0f;
+
+    auto consider = [&](int child, int parent) {
+        if (nodes[parent].IsLeaf()) return;
+        float parentArea = nodes[parent].box.SurfaceArea();
+        int grandChildren[2] = { nodes[parent].child1, nodes[parent].child2 };
+        for (int k = 0; k < 2; k++) {
+            int up = grandChildren[k];
+            int stays = grandChildren[1 - k];
+            float gain = parentArea - Merge(nodes[child].box, nodes[stays].box).SurfaceArea();
+            if (gain > bestGain) {
+                bestGain = gain;
+                bestChild = child;
+                bestGrandChild = up;
+                bestParent = parent;
+            }
+        }
+    };
+    consider(B, C);
+    consider(C, B);
+
+    if (bestChild == NULL_NODE) return;
+
+    // Move the grandchild up into the child's slot and the child down into the grandchild's slot.
+    if (A.child1 == bestChild) A.child1 = bestGrandChild;
+    else A.child2 = bestGrandChild;
+    nodes[bestGrandChild].parent = index;
+
+    TreeNode& P = nodes[bestParent];
+    if (P.child1 == bestGrandChild) P.child1 = bestChild;
+    else P.child2 = bestChild;
+    nodes[bestChild].parent = bestParent;
+
+    P.box = Merge(nodes[P.child1].box, nodes[P.child2].box);
+    P.height = 1 + std::max(nodes[P.child1].height, nodes[P.child2].height);
+    A.height = 1 + std::max(nodes[A.child1].height, nodes[A.child2].height);
+}
+
+float AABBTree::getAreaRatio() const {
+    if (root == NULL_NODE) return 0.0f;
+
+    float rootArea = nodes[root].box.SurfaceArea();
+    if (rootArea <= 0.0f) return 0.0f;
+
+    float totalArea = 0.0f;
+    for (const TreeNode& node : nodes) {
+        if (node.height < 0) continue;
+        totalArea += node.box.SurfaceArea();
+    }
+    return totalArea / rootArea;
+}
+
+float AABBTree::getAverageQueryCost() const {
+    unsigned long long count = queryCount.load(std::memory_order_relaxed);
+    if (count == 0) return 0.0f;
+    return static_cast<float>(queryVisits.load(std::memory_order_relaxed)) / count;
+}
+
+void AABBTree::AddQueryStats(const TreeQueryStats& stats) const {
+    queryCount.fetch_add(stats.queries, std::memory_order_relaxed);
+    queryVisits.fetch_add(stats.visits, std::memory_order_relaxed);
+}
+
+void AABBTree::ResetQueryStats() {
+    queryCount.store(0, std::memory_order_relaxed);
+    queryVisits.store(0, std::memory_order_relaxed);
+}
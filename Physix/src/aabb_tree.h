@@ -0,0 +1,127 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <glm/glm.hpp>
+#include "aabb.h"
+
+// A node of the dynamic tree. Leaves hold one proxy (child1 == NULL_NODE),
+// internal nodes always have two children.
+struct TreeNode {
+    AABB box;
+    int parent;
+    int child1;
+    int child2;
+    int height;          // leaf = 0, free node = -1
+    unsigned int userData;
+
+    bool IsLeaf() const { return child1 == -1; }
+};
+
+// Node visits of a run of tree queries, counted by the caller (one per thread or
+// batch) and merged into the tree's totals once, so queries share no counter.
+struct TreeQueryStats {
+    unsigned long long queries = 0;
+    unsigned long long visits = 0;
+};
+
+// Dynamic AABB tree (incremental BVH).
+// Leaves store "fat" boxes: the tight box grown by a margin and by the predicted
+// displacement, so a body that moves a little stays inside its leaf and costs
+// nothing. Only when a body leaves its fat box is the leaf removed and
+// reinserted. Insertion picks the sibling with the lowest SAH cost and then
+// walks back up applying tree rotations that shrink the surface area.
+class AABBTree {
+public:
+    static const int NULL_NODE = -1;
+    static const int STACK_SIZE = 64;
+
+    AABBTree(float margin = 0.1f, float displacementMultiplier = 4.0f);
+
+    // Returns a proxy id that stays valid until DestroyProxy().
+    int CreateProxy(const AABB& box, unsigned int userData);
+    void DestroyProxy(int proxyId);
+
+    // Returns true if the proxy had to be reinserted.
+    bool MoveProxy(int proxyId, const AABB& box, const glm::vec3& displacement);
+
+    const AABB& getFatAABB(int proxyId) const { return nodes[proxyId].box; }
+    unsigned int getUserData(int proxyId) const { return nodes[proxyId].userData; }
+
+    // Calls callback(proxyId) for every leaf whose fat box overlaps 'box'.
+    // Safe to call from several threads as long as the tree is not modified.
+    // The visits are added to 'stats' if given.
+    template <typename Callback>
+    void Query(const AABB& box, Callback callback, TreeQueryStats* stats = nullptr) const;
+
+    // Statistics.
+    int getNodeCount() const { return nodeCount; }
+    int getProxyCount() const { return proxyCount; }
+    size_t getMemoryUsage() const { return nodes.capacity() * sizeof(TreeNode); }
+    int getHeight() const { return root == NULL_NODE ? 0 : nodes[root].height; }
+    // Sum of node areas over root area; lower means a tighter tree.
+    float getAreaRatio() const;
+    // Average number of nodes visited per Query() since the last reset, over the
+    // stats merged with AddQueryStats().
+    float getAverageQueryCost() const;
+    void AddQueryStats(const TreeQueryStats& stats) const;
+    void ResetQueryStats();
+
+private:
+    std::vector<TreeNode> nodes;
+    int root;
+    int freeList;
+    int nodeCount;
+    int proxyCount;
+    float margin;
+    float displacementMultiplier;
+
+    mutable std::atomic<unsigned long long> queryCount;
+    mutable std::atomic<unsigned long long> queryVisits;
+
+    int AllocateNode();
+    void FreeNode(int node);
+
+    void InsertLeaf(int leaf);
+    void RemoveLeaf(int leaf);
+    // Refits bounds and heights from 'node' to the root, rotating on the way.
+    void RefitAncestors(int node);
+    void Rotate(int node);
+};
+
+template <typename Callback>
+void AABBTree::Query(const AABB& box, Callback callback, TreeQueryStats* stats) const {
+    if (root == NULL_NODE) return;
+
+    // Depth-first, a query holds at most height + 1 nodes. Rotations keep the tree
+    // shallow enough for the fixed stack; a degenerate tree spills to the heap.
+    int fixedStack[STACK_SIZE];
+    std::vector<int> heapStack;
+    int* stack = fixedStack;
+    if (nodes[root].height >= STACK_SIZE) {
+        heapStack.resize(static_cast<size_t>(nodes[root].height) + 1);
+        stack = heapStack.data();
+    }
+    int top = 0;
+    stack[top++] = root;
+    unsigned long long visits = 0;
+
+    while (top > 0) {
+        int nodeId = stack[--top];
+        const TreeNode& node = nodes[nodeId];
+        visits++;
+        if (!node.box.Overlaps(box)) continue;
+
+        if (node.IsLeaf()) {
+            callback(nodeId);
+        }
+        else {
+            stack[top++] = node.child1;
+            stack[top++] = node.child2;
+        }
+    }
+
+    if (stats) {
+        stats->queries++;
+        stats->visits += visits;
+    }
+}
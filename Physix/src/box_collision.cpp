@@ -0,0 +1,285 @@
+#include "box_collision.h"
+#include <cmath>
+
+namespace {
+    // Keeps cross products of nearly parallel edges from producing a bogus axis.
+    const float PARALLEL_EPSILON = 1e-6f;
+    // An edge axis only wins if it is clearly better than the best face axis, so
+    // resting contact keeps using faces and a stable manifold.
+    const float EDGE_RELATIVE_TOLERANCE = 0.95f;
+    const float EDGE_ABSOLUTE_TOLERANCE = 0.01f;
+    // Likewise a face of b only takes over from the best face of a if clearly better,
+    // so the reference face, and with it the contact features, does not flip back
+    // and forth between two equal boxes resting on each other.
+    const float FACE_RELATIVE_TOLERANCE = 0.98f;
+    const float FACE_ABSOLUTE_TOLERANCE = 0.001f;
+    // Equal faces stacked exactly on each other have their corners on the side
+    // planes; the slack keeps all four instead of a rounding-dependent subset.
+    const float CLIP_TOLERANCE = 1e-3f;
+
+    // Feature IDs. A face point packs its clip tag (an incident vertex 0-3, or
+    // 8 + 8 * side plane + the polygon edge the plane cut), the incident and the
+    // reference face (2 * axis + 1 if negative) and which box is the reference. An
+    // edge point packs the edge axis and which edges of the two boxes.
+    const unsigned int FEATURE_REFERENCE_B = 1u << 12;
+    const unsigned int FEATURE_EDGE = 1u << 13;
+    const unsigned int FEATURE_CENTERS = 1u << 14;
+
+    // Both boxes expressed in a's frame, shared by every axis test.
+    struct BoxPair {
+        glm::mat3 R;     // R[j][i] = dot(a axis i, b axis j), as glm is column-major
+        glm::mat3 absR;
+        glm::vec3 t;     // b's center in a's frame
+        glm::vec3 ea;
+        glm::vec3 eb;
+    };
+
+    BoxPair MakePair(const CuboidCollider& a, const CuboidCollider& b) {
+        BoxPair p;
+        p.R = glm::transpose(a.rotation) * b.rotation;
+        for (int j = 0; j < 3; j++) {
+            p.absR[j] = glm::abs(p.R[j]) + glm::vec3(PARALLEL_EPSILON);
+        }
+        p.t = glm::transpose(a.rotation) * (b.center - a.center);
+        p.ea = a.halfExtents;
+        p.eb = b.halfExtents;
+        return p;
+    }
+
+    // Overlap of the two boxes' projections on an axis (negative if separated),
+    // already divided by the axis length. Returns false for a degenerate edge axis.
+    bool AxisOverlap(const BoxPair& p, int axis, float& overlap) {
+        const glm::mat3& R = p.R;
+        const glm::mat3& A = p.absR;
+        float ra, rb, dist;
+        float length = 1.0f;
+        if (axis < 3) {
+            int i = axis;
+            ra = p.ea[i];
+            rb = p.eb.x * A[0][i] + p.eb.y * A[1][i] + p.eb.z * A[2][i];
+            dist = std::fabs(p.t[i]);
+        }
+        else if (axis < 6) {
+            int j = axis - 3;
+            ra = p.ea.x * A[j][0] + p.ea.y * A[j][1] + p.ea.z * A[j][2];
+            rb = p.eb[j];
+            dist = std::fabs(p.t.x * R[j][0] + p.t.y * R[j][1] + p.t.z * R[j][2]);
+        }
+        else {
+            // L = a_i x b_j, written in a's frame.
+            int i = (axis - 6) / 3;
+            int j = (axis - 6) % 3;
+            int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+            int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+            ra = p.ea[i1] * A[j][i2] + p.ea[i2] * A[j][i1];
+            rb = p.eb[j1] * A[j2][i] + p.eb[j2] * A[j1][i];
+            dist = std::fabs(p.t[i2] * R[j][i1] - p.t[i1] * R[j][i2]);
+            glm::vec3 crossAxis(0.0f);
+            crossAxis[i1] = -R[j][i2];
+            crossAxis[i2] = R[j][i1];
+            length = glm::length(crossAxis);
+            if (length < 1e-4f) return false;
+        }
+        overlap = (ra + rb - dist) / length;
+        return true;
+    }
+
+    // World-space axis, unnormalized for edges.
+    glm::vec3 AxisDirection(const CuboidCollider& a, const CuboidCollider& b, int axis) {
+        if (axis < 3) return a.rotation[axis];
+        if (axis < 6) return b.rotation[axis - 3];
+        return glm::cross(a.rotation[(axis - 6) / 3], b.rotation[(axis - 6) % 3]);
+    }
+
+    // Clips the polygon against dot(n, p) <= d (Sutherland-Hodgman). Each vertex
+    // has a tag and each edge, the one to the next vertex, an ID: 0-3 for the edges
+    // of the incident face, 4 + plane for the ones along a clip plane. A vertex made
+    // on this plane is tagged by the plane and the edge it cut.
+    int ClipPolygon(const glm::vec3* in, const unsigned int* inTags, const unsigned int* inEdges, int count,
+        const glm::vec3& n, float d, unsigned int plane, glm::vec3* out, unsigned int* outTags, unsigned int* outEdges) {
+        int outCount = 0;
+        for (int k = 0; k < count; k++) {
+            const glm::vec3& p = in[k];
+            const glm::vec3& q = in[(k + 1) % count];
+            float dp = glm::dot(n, p) - d;
+            float dq = glm::dot(n, q) - d;
+            if (dp <= 0.0f) {
+                outTags[outCount] = inTags[k];
+                outEdges[outCount] = inEdges[k];
+                out[outCount++] = p;
+            }
+            if ((dp < 0.0f) != (dq < 0.0f) && dp != dq) {
+                float t = dp / (dp - dq);
+                outTags[outCount] = 8 + 8 * plane + inEdges[k];
+                // Leaving the inside, the polygon follows the plane; entering, the edge cut.
+                outEdges[outCount] = dp < 0.0f ? 4 + plane : inEdges[k];
+                out[outCount++] = p + t * (q - p);
+            }
+        }
+        return outCount;
+    }
+
+    // 'reference' has a face with outward normal 'normal' (pointing at 'incident').
+    // Fills points on the incident box's face that lie behind the reference face.
+    // 'referenceBit' tells the feature IDs which box is the reference.
+    void FaceContact(const CuboidCollider& reference, int referenceAxis, const CuboidCollider& incident,
+        const glm::vec3& normal, unsigned int referenceBit, BoxManifold& manifold) {
+        // Incident face: the face of the other box most anti-parallel to the normal.
+        int incidentAxis = 0;
+        float best = -1.0f;
+        for (int j = 0; j < 3; j++) {
+            float d = std::fabs(glm::dot(incident.rotation[j], normal));
+            if (d > best) {
+                best = d;
+                incidentAxis = j;
+            }
+        }
+        float incidentSign = glm::dot(incident.rotation[incidentAxis], normal) > 0.0f ? -1.0f : 1.0f;
+        int u = (incidentAxis + 1) % 3, v = (incidentAxis + 2) % 3;
+        glm::vec3 faceCenter = incident.center +
+            incidentSign * incident.halfExtents[incidentAxis] * incident.rotation[incidentAxis];
+        glm::vec3 du = incident.halfExtents[u] * incident.rotation[u];
+        glm::vec3 dv = incident.halfExtents[v] * incident.rotation[v];
+
+        glm::vec3 polygon[8] = { faceCenter + du + dv, faceCenter - du + dv, faceCenter - du - dv, faceCenter + du - dv };
+        unsigned int tags[8] = { 0, 1, 2, 3 };
+        unsigned int edges[8] = { 0, 1, 2, 3 };
+        glm::vec3 clipped[8];
+        unsigned int clippedTags[8];
+        unsigned int clippedEdges[8];
+        int count = 4;
+
+        // Side planes of the reference face.
+        for (int side = 1; side <= 2 && count > 0; side++) {
+            int axis = (referenceAxis + side) % 3;
+            glm::vec3 n = reference.rotation[axis];
+            float c = glm::dot(n, reference.center);
+            float e = reference.halfExtents[axis];
+            unsigned int plane = 2 * (side - 1);
+            count = ClipPolygon(polygon, tags, edges, count, n, c + e + CLIP_TOLERANCE, plane, clipped, clippedTags,
+                clippedEdges);
+            count = ClipPolygon(clipped, clippedTags, clippedEdges, count, -n, -c + e + CLIP_TOLERANCE, plane + 1,
+                polygon, tags, edges);
+        }
+
+        unsigned int referenceFace = 2 * referenceAxis + (glm::dot(reference.rotation[referenceAxis], normal) < 0.0f ? 1 : 0);
+        unsigned int incidentFace = 2 * incidentAxis + (incidentSign < 0.0f ? 1 : 0);
+        unsigned int faces = referenceBit | referenceFace << 9 | incidentFace << 6;
+
+        float faceOffset = glm::dot(normal, reference.center) + reference.halfExtents[referenceAxis];
+        manifold.pointCount = 0;
+        for (int k = 0; k < count && manifold.pointCount < BoxManifold::MAX_POINTS; k++) {
+            float depth = faceOffset - glm::dot(normal, polygon[k]);
+            if (depth < -BOX_CONTACT_GAP) continue;
+            // Halfway between the incident point and the reference face.
+            glm::vec3 position = polygon[k] + 0.5f * depth * normal;
+            bool duplicate = false;
+            for (int m = 0; m < manifold.pointCount && !duplicate; m++) {
+                glm::vec3 d = manifold.points[m].position - position;
+                duplicate = glm::dot(d, d) < CLIP_TOLERANCE * CLIP_TOLERANCE;
+            }
+            if (!duplicate) manifold.points[manifold.pointCount++] = { position, depth, faces | tags[k] };
+        }
+    }
+
+    // Point on edge 'axis' of the box that lies furthest along 'direction'. 'edge'
+    // gets which of the four edges along the axis it is.
+    glm::vec3 SupportEdge(const CuboidCollider& box, int axis, const glm::vec3& direction, unsigned int& edge) {
+        glm::vec3 point = box.center;
+        edge = 0;
+        for (int k = 0; k < 3; k++) {
+            if (k == axis) continue;
+            bool positive = glm::dot(box.rotation[k], direction) > 0.0f;
+            point += (positive ? 1.0f : -1.0f) * box.halfExtents[k] * box.rotation[k];
+            edge = edge << 1 | (positive ? 1 : 0);
+        }
+        return point;
+    }
+
+    void EdgeContact(const CuboidCollider& a, const CuboidCollider& b, int axis, const glm::vec3& normal,
+        float depth, BoxManifold& manifold) {
+        int i = (axis - 6) / 3;
+        int j = (axis - 6) % 3;
+        unsigned int edgeA, edgeB;
+        glm::vec3 pa = SupportEdge(a, i, normal, edgeA);
+        glm::vec3 pb = SupportEdge(b, j, -normal, edgeB);
+        const glm::vec3& da = a.rotation[i];
+        const glm::vec3& db = b.rotation[j];
+
+        // Closest points of the two edge lines (Ericson 5.1.8), clamped to the edges.
+        glm::vec3 r = pa - pb;
+        float d = glm::dot(da, db);
+        float denom = 1.0f - d * d;
+        float s = 0.0f, t = 0.0f;
+        if (denom > PARALLEL_EPSILON) {
+            float c = glm::dot(da, r);
+            float f = glm::dot(db, r);
+            s = glm::clamp((d * f - c) / denom, -a.halfExtents[i], a.halfExtents[i]);
+            t = glm::clamp(d * s + f, -b.halfExtents[j], b.halfExtents[j]);
+        }
+        glm::vec3 ca = pa + s * da;
+        glm::vec3 cb = pb + t * db;
+        manifold.pointCount = 1;
+        manifold.points[0] = { 0.5f * (ca + cb), depth, FEATURE_EDGE | static_cast<unsigned int>(axis - 6) << 4 | edgeA << 2 | edgeB };
+    }
+}
+
+BoxOverlap CollideBoxes(const CuboidCollider& a, const CuboidCollider& b, int& cachedAxis, BoxManifold& manifold) {
+    BoxPair p = MakePair(a, b);
+    float overlap;
+
+    if (cachedAxis != BOX_NO_AXIS && AxisOverlap(p, cachedAxis, overlap) && overlap < 0.0f) {
+        return BoxOverlap::SeparatedByCache;
+    }
+
+    int bestFaceA = BOX_NO_AXIS, bestFaceB = BOX_NO_AXIS, bestEdge = BOX_NO_AXIS;
+    float faceOverlapA = 0.0f, faceOverlapB = 0.0f, edgeOverlap = 0.0f;
+    for (int axis = 0; axis < BOX_AXIS_COUNT; axis++) {
+        if (!AxisOverlap(p, axis, overlap)) continue;
+        if (overlap < 0.0f) {
+            cachedAxis = axis;
+            return BoxOverlap::Separated;
+        }
+        if (axis < 3) {
+            if (bestFaceA == BOX_NO_AXIS || overlap < faceOverlapA) {
+                bestFaceA = axis;
+                faceOverlapA = overlap;
+            }
+        }
+        else if (axis < 6) {
+            if (bestFaceB == BOX_NO_AXIS || overlap < faceOverlapB) {
+                bestFaceB = axis;
+                faceOverlapB = overlap;
+            }
+        }
+        else if (bestEdge == BOX_NO_AXIS || overlap < edgeOverlap) {
+            bestEdge = axis;
+            edgeOverlap = overlap;
+        }
+    }
+    cachedAxis = BOX_NO_AXIS;
+
+    bool useFaceB = faceOverlapB < FACE_RELATIVE_TOLERANCE * faceOverlapA - FACE_ABSOLUTE_TOLERANCE;
+    int bestFace = useFaceB ? bestFaceB : bestFaceA;
+    float faceOverlap = useFaceB ? faceOverlapB : faceOverlapA;
+
+    bool useEdge = bestEdge != BOX_NO_AXIS &&
+        edgeOverlap < EDGE_RELATIVE_TOLERANCE * faceOverlap - EDGE_ABSOLUTE_TOLERANCE;
+    int axis = useEdge ? bestEdge : bestFace;
+    float depth = useEdge ? edgeOverlap : faceOverlap;
+
+    glm::vec3 normal = glm::normalize(AxisDirection(a, b, axis));
+    if (glm::dot(normal, b.center - a.center) < 0.0f) normal = -normal;
+    manifold.normal = normal;
+
+    if (axis < 3) FaceContact(a, axis, b, normal, 0, manifold);
+    else if (axis < 6) FaceContact(b, axis - 3, a, -normal, FEATURE_REFERENCE_B, manifold);
+    else EdgeContact(a, b, axis, normal, depth, manifold);
+
+    // Clipping can leave nothing for barely touching boxes; fall back to the centers.
+    if (manifold.pointCount == 0) {
+        manifold.pointCount = 1;
+        manifold.points[0] = { 0.5f * (a.center + b.center), depth, FEATURE_CENTERS };
+    }
+    return BoxOverlap::Touching;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <glm/glm.hpp>
+#include "cuboid.h"
+
+// A contact point between two boxes; 'depth' is the penetration along the normal.
+// Face contacts keep points up to BOX_CONTACT_GAP apart (negative depth), so a
+// resting box whose corner lifts slightly keeps all four points. 'feature' names
+// the faces, edges and clip planes the point came from; it stays the same while
+// the boxes keep touching the same way.
+struct BoxContactPoint {
+    glm::vec3 position;
+    float depth;
+    unsigned int feature;
+};
+
+// Contact between two boxes. 'normal' points from box a towards box b.
+struct BoxManifold {
+    static const int MAX_POINTS = 8;
+
+    glm::vec3 normal;
+    int pointCount;
+    BoxContactPoint points[MAX_POINTS];
+};
+
+// Result of CollideBoxes(). A pair rejected by its cached axis cost one axis test.
+enum class BoxOverlap {
+    Touching,
+    Separated,          // found by the full axis scan
+    SeparatedByCache    // the cached axis alone separated the boxes
+};
+
+// Axis indices of CollideBoxes().
+const int BOX_AXIS_COUNT = 15;
+const int BOX_NO_AXIS = -1;
+const float BOX_CONTACT_GAP = 0.02f;
+
+// Separating-axis test between two oriented boxes (Ericson, Real-Time Collision
+// Detection 4.4.1). Axes 0-2 are the face normals of a, 3-5 those of b, and
+// 6 + 3 * i + j is the cross product of a's axis i with b's axis j.
+// 'cachedAxis' is the axis that separated the pair last time, or BOX_NO_AXIS. It is
+// tried first: boxes that stayed apart usually stay apart along the same axis, so
+// most non-touching pairs cost one axis test instead of fifteen. On return it holds
+// the separating axis found, or BOX_NO_AXIS if the boxes overlap.
+// Overlapping boxes get a manifold from the axis of least penetration: for a face
+// axis, the most anti-parallel face of the other box is clipped against the side
+// planes of the reference face; for an edge axis, the closest points of the two edges.
+BoxOverlap CollideBoxes(const CuboidCollider& a, const CuboidCollider& b, int& cachedAxis, BoxManifold& manifold);
@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "sphere.h"
+
+// A pair of body indices produced by a broadphase, with a < b.
+struct CollisionPair {
+    unsigned int a;
+    unsigned int b;
+};
+
+// Exact sphere-sphere overlap test shared by every broadphase, so that all of
+// them report the same pairs as the all-pairs loop in Sphere::ProcessSphereCollision.
+inline bool SpheresOverlap(const glm::vec3& p1, float r1, const glm::vec3& p2, float r2) {
+    glm::vec3 diff = p1 - p2;
+    float minDist = r1 + r2;
+    return glm::dot(diff, diff) < minDist * minDist;
+}
+
+// Heap bytes held by a vector, for getMemoryUsage().
+template <typename T>
+inline size_t VectorBytes(const std::vector<T>& v) {
+    return v.capacity() * sizeof(T);
+}
+
+template <typename T>
+inline size_t VectorBytes(const std::vector<std::vector<T>>& v) {
+    size_t bytes = v.capacity() * sizeof(std::vector<T>);
+    for (const std::vector<T>& inner : v) {
+        bytes += VectorBytes(inner);
+    }
+    return bytes;
+}
+
+// Common interface of the sphere broadphases.
+// Update() is called once per substep with the current sphere positions,
+// FindPairs() then appends every overlapping sphere pair exactly once.
+class Broadphase {
+public:
+    virtual ~Broadphase() = default;
+
+    virtual void Update(const std::vector<Sphere>& spheres) = 0;
+    virtual void FindPairs(std::vector<CollisionPair>& pairs) = 0;
+
+    virtual const char* getName() const = 0;
+    // Heap memory held by the broadphase's own buffers, in bytes.
+    virtual size_t getMemoryUsage() const = 0;
+
+    // For speculative contacts: every sphere counts as grown by the distance its
+    // velocity covers in this time, so pairs that can touch within it are reported
+    // too. Zero (the default) reports the overlapping pairs only.
+    void setSpeculativeTime(float time) { speculativeTime = time; }
+    float getSpeculativeTime() const { return speculativeTime; }
+
+protected:
+    float speculativeTime = 0.0f;
+
+    float ReachRadius(const Sphere& sphere) const {
+        return sphere.mesh->getRadius() + speculativeTime * glm::length(sphere.velocity);
+    }
+};
@@ -0,0 +1,502 @@
+#include "broadphase_bench.h"
+#include "hash_grid.h"
+#include "hierarchical_grid.h"
+#include "sweep_and_prune.h"
+#include "tree_broadphase.h"
+#include "lbvh.h"
+#include "wide_bvh.h"
+#include "neighbor_list.h"
+#include "static_bvh.h"
+#include "parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <memory>
+
+namespace {
+    // Sphere volume over region volume. Keeps roughly 0.4 pairs per sphere in the
+    // uniform scene, whatever the sphere count.
+    const float VOLUME_FRACTION = 0.1f;
+    const float PI = 3.14159265f;
+    // Largest per-axis move of a sphere between repeats, in radii. Most spheres stay
+    // inside fat boxes and skins, some leave them and force reinsertions.
+    const float MOVE_DISTANCE = 0.25f;
+
+    typedef std::chrono::steady_clock Clock;
+
+    double ElapsedMs(Clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // splitmix64, so scenes are identical on every compiler and standard library
+    // (the std distributions are not).
+    struct BenchRandom {
+        unsigned long long state;
+
+        explicit BenchRandom(unsigned long long seed) : state(seed) {}
+
+        unsigned long long Next() {
+            unsigned long long z = (state += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            return z ^ (z >> 31);
+        }
+
+        // Uniform in [0, 1).
+        float Uniform() { return static_cast<float>(Next() >> 40) / 16777216.0f; }
+        float Uniform(float lo, float hi) { return lo + (hi - lo) * Uniform(); }
+
+        float Gaussian() {
+            // Box-Muller; 1 - Uniform() keeps the log argument above zero.
+            float u1 = 1.0f - Uniform();
+            float u2 = Uniform();
+            return std::sqrt(-2.0f * std::log(u1)) * std::cos(2.0f * PI * u2);
+        }
+    };
+
+    bool PairLess(const CollisionPair& x, const CollisionPair& y) {
+        return x.a != y.a ? x.a < y.a : x.b < y.b;
+    }
+
+    bool PairEqual(const CollisionPair& x, const CollisionPair& y) {
+        return x.a == y.a && x.b == y.b;
+    }
+
+    // A generated scene owns the meshes its spheres point to.
+    struct BenchSceneData {
+        std::vector<std::unique_ptr<Sphere_mesh>> meshes;
+        std::vector<Sphere> spheres;
+    };
+
+    // Inside of the WallSpawner box: the union of the wall bounds, shrunk by the wall thickness.
+    AABB InnerBounds(const std::vector<Cuboid>& walls) {
+        AABB box = walls[0].getBounds();
+        float thickness = std::numeric_limits<float>::max();
+        for (const Cuboid& wall : walls) {
+            AABB bounds = wall.getBounds();
+            box = Merge(box, bounds);
+            glm::vec3 size = bounds.max - bounds.min;
+            thickness = std::min(thickness, std::min(size.x, std::min(size.y, size.z)));
+        }
+        return { box.min + thickness, box.max - thickness };
+    }
+
+    void GenerateScene(BenchScene scene, size_t count, const std::vector<Cuboid>* walls, unsigned int seed,
+        BenchSceneData& data) {
+        BenchRandom random(seed * 0x100000001B3ull + static_cast<unsigned long long>(scene) * 131 + count);
+
+        // Radius classes; the mixed scene favours small spheres (weight 1 / r^2).
+        std::vector<float> radii = { 1.0f };
+        std::vector<float> weights = { 1.0f };
+        if (scene == BenchScene::MixedRadii) {
+            radii = { 0.25f, 0.5f, 1.0f, 2.0f, 4.0f, 8.0f };
+            weights.clear();
+            for (float r : radii) weights.push_back(1.0f / (r * r));
+        }
+        float totalWeight = 0.0f;
+        float meanVolume = 0.0f;
+        for (size_t k = 0; k < radii.size(); k++) {
+            totalWeight += weights[k];
+            meanVolume += weights[k] * 4.0f / 3.0f * PI * radii[k] * radii[k] * radii[k];
+        }
+        meanVolume /= totalWeight;
+
+        // Free space grows with the count; the wall box is fixed, so the spheres shrink instead.
+        AABB region;
+        float scale = 1.0f;
+        if (walls) {
+            region = InnerBounds(*walls);
+            glm::vec3 size = region.max - region.min;
+            float volume = size.x * size.y * size.z;
+            scale = std::min(1.0f, std::cbrt(VOLUME_FRACTION * volume / (count * meanVolume)));
+        }
+        else {
+            float side = std::cbrt(count * meanVolume / VOLUME_FRACTION);
+            region = { glm::vec3(-0.5f * side), glm::vec3(0.5f * side) };
+        }
+        glm::vec3 center = region.Center();
+        glm::vec3 extent = region.max - region.min;
+
+        data.meshes.clear();
+        for (float r : radii) {
+            data.meshes.emplace_back(new Sphere_mesh(r * scale, 8, 4));
+        }
+
+        std::vector<glm::vec3> clusters;
+        if (scene == BenchScene::Clustered) {
+            for (int k = 0; k < 32; k++) {
+                clusters.push_back(glm::vec3(random.Uniform(region.min.x, region.max.x),
+                    random.Uniform(region.min.y, region.max.y), random.Uniform(region.min.z, region.max.z)));
+            }
+        }
+        float sigma = std::min(extent.x, std::min(extent.y, extent.z)) / 32.0f;
+        float hotspotRadius = std::min(extent.x, std::min(extent.y, extent.z)) / 8.0f;
+
+        data.spheres.clear();
+        data.spheres.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            size_t type = 0;
+            float pick = random.Uniform() * totalWeight;
+            while (type + 1 < radii.size() && pick >= weights[type]) {
+                pick -= weights[type];
+                type++;
+            }
+            glm::vec3 p;
+            if (scene == BenchScene::Clustered) {
+                const glm::vec3& c = clusters[random.Next() % clusters.size()];
+                p = c + sigma * glm::vec3(random.Gaussian(), random.Gaussian(), random.Gaussian());
+            }
+            else if (scene == BenchScene::Hotspot && i % 10 == 0) {
+                // Every tenth sphere goes into the ball in the middle.
+                glm::vec3 d;
+                do {
+                    d = glm::vec3(random.Uniform(-1.0f, 1.0f), random.Uniform(-1.0f, 1.0f), random.Uniform(-1.0f, 1.0f));
+                } while (glm::dot(d, d) > 1.0f);
+                p = center + hotspotRadius * d;
+            }
+            else {
+                p = glm::vec3(random.Uniform(region.min.x, region.max.x), random.Uniform(region.min.y, region.max.y),
+                    random.Uniform(region.min.z, region.max.z));
+            }
+            // Centers stay inside the region, so spheres next to the walls touch them.
+            data.spheres.emplace_back(1.0f, data.meshes[type].get(), glm::clamp(p, region.min, region.max));
+        }
+    }
+
+    // One frame of motion for repeat 'repeat': every sphere moves by up to
+    // MOVE_DISTANCE radii per axis. The moves only depend on the seed and the
+    // repeat, so every broadphase sees the same sequence of scenes.
+    void MoveScene(std::vector<Sphere>& spheres, unsigned int seed, int repeat) {
+        BenchRandom random(seed * 0x9E3779B97F4A7C15ull + static_cast<unsigned long long>(repeat) * 7919 + spheres.size());
+        for (Sphere& sphere : spheres) {
+            float step = MOVE_DISTANCE * sphere.mesh->getRadius();
+            sphere.position += step * glm::vec3(random.Uniform(-1.0f, 1.0f), random.Uniform(-1.0f, 1.0f),
+                random.Uniform(-1.0f, 1.0f));
+        }
+    }
+
+    void OraclePairs(const std::vector<Sphere>& spheres, std::vector<CollisionPair>& pairs) {
+        if (spheres.size() <= BRUTE_FORCE_LIMIT) BruteForcePairs(spheres, pairs);
+        else SweepPairs(spheres, pairs);
+    }
+
+    // Missing and extra pairs of 'found' against the sorted oracle; duplicates count as extra.
+    void DiffPairs(const std::vector<CollisionPair>& expected, std::vector<CollisionPair>& found,
+        size_t& missing, size_t& extra) {
+        for (CollisionPair& pair : found) {
+            if (pair.a > pair.b) std::swap(pair.a, pair.b);
+        }
+        std::sort(found.begin(), found.end(), PairLess);
+
+        missing = 0;
+        extra = 0;
+        size_t i = 0, j = 0;
+        while (i < expected.size() || j < found.size()) {
+            if (j > 0 && j < found.size() && PairEqual(found[j], found[j - 1])) {
+                extra++;
+                j++;
+            }
+            else if (j == found.size() || (i < expected.size() && PairLess(expected[i], found[j]))) {
+                missing++;
+                i++;
+            }
+            else if (i == expected.size() || PairLess(found[j], expected[i])) {
+                extra++;
+                j++;
+            }
+            else {
+                i++;
+                j++;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Broadphase>> MakeBroadphases(const std::string& filter) {
+        std::vector<std::unique_ptr<Broadphase>> all;
+        all.emplace_back(new HashGrid());
+        all.emplace_back(new HierarchicalGrid());
+        all.emplace_back(new SweepAndPrune());
+        all.emplace_back(new TreeBroadphase());
+        all.emplace_back(new LBVH());
+        all.emplace_back(new WideBVH<4>());
+        all.emplace_back(new WideBVH<8>());
+        all.emplace_back(new NeighborList());
+
+        std::vector<std::unique_ptr<Broadphase>> selected;
+        for (std::unique_ptr<Broadphase>& broadphase : all) {
+            if (filter.empty() || std::strstr(broadphase->getName(), filter.c_str())) {
+                selected.push_back(std::move(broadphase));
+            }
+        }
+        return selected;
+    }
+
+    void MergeThreadPairs(std::vector<std::vector<CollisionPair>>& threadPairs, std::vector<CollisionPair>& pairs) {
+        pairs.clear();
+        for (std::vector<CollisionPair>& out : threadPairs) {
+            pairs.insert(pairs.end(), out.begin(), out.end());
+        }
+        std::sort(pairs.begin(), pairs.end(), PairLess);
+    }
+}
+
+const char* getBenchSceneName(BenchScene scene) {
+    switch (scene) {
+    case BenchScene::Uniform: return "uniform";
+    case BenchScene::Clustered: return "clustered";
+    case BenchScene::Hotspot: return "hotspot";
+    case BenchScene::MixedRadii: return "mixed_radii";
+    }
+    return "unknown";
+}
+
+bool ParseBenchArgs(int argc, char** argv, BenchOptions& options) {
+    bool bench = false;
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argv[i], "--bench") == 0) {
+            bench = true;
+        }
+        else if (std::strcmp(argv[i], "--out") == 0 && hasValue) {
+            options.outputPath = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--sizes") == 0 && hasValue) {
+            options.sizes.clear();
+            for (char* p = argv[++i]; *p;) {
+                size_t size = std::strtoul(p, &p, 10);
+                if (size > 0) options.sizes.push_back(size);
+                if (*p == ',') p++;
+                else break;
+            }
+        }
+        else if (std::strcmp(argv[i], "--repeats") == 0 && hasValue) {
+            options.repeats = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::strcmp(argv[i], "--seed") == 0 && hasValue) {
+            options.seed = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (std::strcmp(argv[i], "--only") == 0 && hasValue) {
+            options.filter = argv[++i];
+        }
+    }
+    return bench;
+}
+
+void BruteForcePairs(const std::vector<Sphere>& spheres, std::vector<CollisionPair>& pairs) {
+    size_t count = spheres.size();
+    std::vector<std::vector<CollisionPair>> threadPairs(NumWorkerThreads());
+
+    // Rows get shorter towards the end, so row k is paired with row count-1-k to keep
+    // the batches equally expensive.
+    ParallelForRange(count, [&](size_t left, size_t right, unsigned int batch) {
+        std::vector<CollisionPair>& out = threadPairs[batch];
+        for (size_t k = left; k < right; k++) {
+            // Row k and row count-1-k together always cost count-1 tests.
+            size_t i = (k % 2 == 0) ? k / 2 : count - 1 - k / 2;
+            const glm::vec3& p = spheres[i].position;
+            float r = spheres[i].mesh->getRadius();
+            for (size_t j = i + 1; j < count; j++) {
+                if (SpheresOverlap(p, r, spheres[j].position, spheres[j].mesh->getRadius())) {
+                    out.push_back({ static_cast<unsigned int>(i), static_cast<unsigned int>(j) });
+                }
+            }
+        }
+    }, 64);
+
+    MergeThreadPairs(threadPairs, pairs);
+}
+
+void SweepPairs(const std::vector<Sphere>& spheres, std::vector<CollisionPair>& pairs) {
+    size_t count = spheres.size();
+    std::vector<unsigned int> order(count);
+    std::vector<float> minX(count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = static_cast<unsigned int>(i);
+        minX[i] = spheres[i].position.x - spheres[i].mesh->getRadius();
+    }
+    std::sort(order.begin(), order.end(), [&](unsigned int x, unsigned int y) { return minX[x] < minX[y]; });
+
+    std::vector<std::vector<CollisionPair>> threadPairs(NumWorkerThreads());
+    ParallelForRange(count, [&](size_t left, size_t right, unsigned int batch) {
+        std::vector<CollisionPair>& out = threadPairs[batch];
+        for (size_t k = left; k < right; k++) {
+            unsigned int i = order[k];
+            const glm::vec3& p = spheres[i].position;
+            float r = spheres[i].mesh->getRadius();
+            float maxX = p.x + r;
+            // Every sphere starting before this one ends is a candidate; the test itself is exact.
+            for (size_t m = k + 1; m < count && minX[order[m]] <= maxX; m++) {
+                unsigned int j = order[m];
+                if (SpheresOverlap(p, r, spheres[j].position, spheres[j].mesh->getRadius())) {
+                    out.push_back(i < j ? CollisionPair{ i, j } : CollisionPair{ j, i });
+                }
+            }
+        }
+    });
+
+    MergeThreadPairs(threadPairs, pairs);
+}
+
+bool RunBroadphaseBench(const BenchOptions& options, const std::vector<Cuboid>& walls, std::ostream& json) {
+    bool allExact = true;
+    BenchSceneData data;
+    std::vector<Sphere> moving;
+    std::vector<std::vector<CollisionPair>> expected(options.repeats);
+    std::vector<CollisionPair> found;
+
+    json << "{\n  \"threads\": " << NumWorkerThreads() << ",\n  \"repeats\": " << options.repeats
+        << ",\n  \"seed\": " << options.seed << ",\n  \"runs\": [";
+    bool firstRun = true;
+
+    for (bool withWalls : options.walls) {
+        if (withWalls && walls.empty()) continue;
+        for (BenchScene scene : options.scenes) {
+            for (size_t count : options.sizes) {
+                GenerateScene(scene, count, withWalls ? &walls : nullptr, options.seed, data);
+                const std::vector<Sphere>& spheres = data.spheres;
+
+                bool bruteForce = count <= BRUTE_FORCE_LIMIT;
+                Clock::time_point start = Clock::now();
+                OraclePairs(spheres, expected[0]);
+                double oracleMs = ElapsedMs(start);
+
+                // Reference pairs of every later repeat, after the spheres moved.
+                moving = spheres;
+                for (int repeat = 1; repeat < options.repeats; repeat++) {
+                    MoveScene(moving, options.seed, repeat);
+                    OraclePairs(moving, expected[repeat]);
+                }
+
+                std::cout << getBenchSceneName(scene) << (withWalls ? " + walls" : "") << ", " << count
+                    << " spheres: " << expected[0].size() << " pairs\n";
+
+                json << (firstRun ? "\n" : ",\n") << "    {\n"
+                    << "      \"scene\": \"" << getBenchSceneName(scene) << "\",\n"
+                    << "      \"walls\": " << (withWalls ? "true" : "false") << ",\n"
+                    << "      \"count\": " << count << ",\n"
+                    << "      \"oracle\": \"" << (bruteForce ? "brute_force" : "sweep_x") << "\",\n"
+                    << "      \"oracle_ms\": " << oracleMs << ",\n"
+                    << "      \"pairs\": " << expected[0].size() << ",\n"
+                    << "      \"broadphases\": [";
+                firstRun = false;
+
+                std::vector<std::unique_ptr<Broadphase>> broadphases = MakeBroadphases(options.filter);
+                for (size_t b = 0; b < broadphases.size(); b++) {
+                    Broadphase& broadphase = *broadphases[b];
+
+                    // The first Update() builds from nothing. Before each later one the
+                    // spheres move a little, as between frames, so the refit, reinsertion
+                    // and skin paths of the incremental structures run and are checked.
+                    moving = spheres;
+                    start = Clock::now();
+                    broadphase.Update(moving);
+                    double buildMs = ElapsedMs(start);
+
+                    double updateMs = 0.0;
+                    double queryMs = 0.0;
+                    size_t reported = 0;
+                    size_t missing = 0, extra = 0;
+                    for (int repeat = 0; repeat < options.repeats; repeat++) {
+                        if (repeat > 0) {
+                            MoveScene(moving, options.seed, repeat);
+                            start = Clock::now();
+                            broadphase.Update(moving);
+                            double ms = ElapsedMs(start);
+                            updateMs = repeat == 1 ? ms : std::min(updateMs, ms);
+                        }
+                        found.clear();
+                        start = Clock::now();
+                        broadphase.FindPairs(found);
+                        double ms = ElapsedMs(start);
+                        queryMs = repeat == 0 ? ms : std::min(queryMs, ms);
+
+                        reported = found.size();
+                        size_t repeatMissing, repeatExtra;
+                        DiffPairs(expected[repeat], found, repeatMissing, repeatExtra);
+                        missing += repeatMissing;
+                        extra += repeatExtra;
+                    }
+                    bool exact = missing == 0 && extra == 0;
+                    allExact = allExact && exact;
+
+                    std::cout << "  " << broadphase.getName() << ": build " << buildMs << " ms, update " << updateMs << " ms, query "
+                        << queryMs << " ms" << (exact ? "" : " MISMATCH") << "\n";
+
+                    json << (b == 0 ? "\n" : ",\n") << "        { \"name\": \"" << broadphase.getName() << "\""
+                        << ", \"build_ms\": " << buildMs
+                        << ", \"update_ms\": " << updateMs
+                        << ", \"query_ms\": " << queryMs
+                        << ", \"pairs\": " << reported
+                        << ", \"pairs_per_sec\": " << (queryMs > 0.0 ? reported / (queryMs * 0.001) : 0.0)
+                        << ", \"memory_bytes\": " << broadphase.getMemoryUsage()
+                        << ", \"missing\": " << missing
+                        << ", \"extra\": " << extra
+                        << ", \"exact\": " << (exact ? "true" : "false") << " }";
+                }
+                json << "\n      ]";
+
+                if (withWalls) {
+                    // Sphere/wall candidates of the StaticBVH against testing every wall.
+                    StaticBVH staticWorld;
+                    start = Clock::now();
+                    staticWorld.Build(walls);
+                    double buildMs = ElapsedMs(start);
+
+                    std::vector<size_t> threadCandidates(NumWorkerThreads(), 0);
+                    start = Clock::now();
+                    ParallelForRange(spheres.size(), [&](size_t left, size_t right, unsigned int batch) {
+                        for (size_t i = left; i < right; i++) {
+                            AABB box = AABB::FromSphere(spheres[i].position, spheres[i].mesh->getRadius());
+                            staticWorld.Query(box, [&](unsigned int) { threadCandidates[batch]++; });
+                        }
+                    });
+                    double queryMs = ElapsedMs(start);
+
+                    std::vector<size_t> threadMissing(NumWorkerThreads(), 0);
+                    std::vector<size_t> threadExtra(NumWorkerThreads(), 0);
+                    ParallelForRange(spheres.size(), [&](size_t left, size_t right, unsigned int batch) {
+                        std::vector<unsigned int> hits;
+                        for (size_t i = left; i < right; i++) {
+                            AABB box = AABB::FromSphere(spheres[i].position, spheres[i].mesh->getRadius());
+                            hits.clear();
+                            staticWorld.Query(box, [&](unsigned int wall) { hits.push_back(wall); });
+                            std::sort(hits.begin(), hits.end());
+
+                            size_t matched = 0;
+                            for (unsigned int w = 0; w < walls.size(); w++) {
+                                if (!walls[w].getBounds().Overlaps(box)) continue;
+                                if (std::binary_search(hits.begin(), hits.end(), w)) matched++;
+                                else threadMissing[batch]++;
+                            }
+                            threadExtra[batch] += hits.size() - matched;
+                        }
+                    });
+
+                    size_t candidates = 0, missing = 0, extra = 0;
+                    for (unsigned int t = 0; t < NumWorkerThreads(); t++) {
+                        candidates += threadCandidates[t];
+                        missing += threadMissing[t];
+                        extra += threadExtra[t];
+                    }
+                    bool exact = missing == 0 && extra == 0;
+                    allExact = allExact && exact;
+
+                    json << ",\n      \"static_bvh\": { \"build_ms\": " << buildMs
+                        << ", \"query_ms\": " << queryMs
+                        << ", \"candidates\": " << candidates
+                        << ", \"memory_bytes\": " << staticWorld.getMemoryUsage()
+                        << ", \"missing\": " << missing
+                        << ", \"extra\": " << extra
+                        << ", \"exact\": " << (exact ? "true" : "false") << " }";
+                }
+                json << "\n    }";
+            }
+        }
+    }
+    json << "\n  ],\n  \"exact\": " << (allExact ? "true" : "false") << "\n}\n";
+    return allExact;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <ostream>
+#include <string>
+#include <vector>
+#include "broadphase.h"
+#include "cuboid.h"
+
+// Scene layouts of the broadphase benchmark.
+enum class BenchScene {
+    Uniform,      // equal spheres spread evenly
+    Clustered,    // equal spheres in gaussian clumps
+    Hotspot,      // uniform background plus one dense ball in the middle
+    MixedRadii    // uniform positions, radii from 0.25 to 8
+};
+
+const char* getBenchSceneName(BenchScene scene);
+
+struct BenchOptions {
+    std::vector<size_t> sizes = { 1000, 10000, 100000, 1000000 };
+    std::vector<BenchScene> scenes = { BenchScene::Uniform, BenchScene::Clustered,
+        BenchScene::Hotspot, BenchScene::MixedRadii };
+    // Run every scene without walls (free space) and inside the WallSpawner box.
+    std::vector<bool> walls = { false, true };
+    int repeats = 3;
+    unsigned int seed = 1;
+    // Only broadphases whose name contains this string; empty runs all of them.
+    std::string filter;
+    std::string outputPath = "broadphase_bench.json";
+};
+
+// Parses "--bench [--out file] [--sizes 1000,10000] [--repeats n] [--seed n] [--only name]".
+// Returns false if the arguments do not ask for a benchmark run.
+bool ParseBenchArgs(int argc, char** argv, BenchOptions& options);
+
+// Exact overlapping pairs (a < b, sorted), used as the reference every broadphase is
+// diffed against. Up to BRUTE_FORCE_LIMIT spheres every pair is tested, above that
+// an exact sort-and-sweep along x keeps the oracle affordable.
+const size_t BRUTE_FORCE_LIMIT = 16384;
+void BruteForcePairs(const std::vector<Sphere>& spheres, std::vector<CollisionPair>& pairs);
+void SweepPairs(const std::vector<Sphere>& spheres, std::vector<CollisionPair>& pairs);
+
+// Runs every broadphase over every scene and size and writes build / update / query
+// times, pairs per second and memory as JSON. Between repeats the spheres move a
+// little, and the pairs of every repeat are diffed against the oracle.
+// With walls, the StaticBVH sphere/wall candidates are checked as well.
+// Returns false if any structure reported a missing or extra pair.
+bool RunBroadphaseBench(const BenchOptions& options, const std::vector<Cuboid>& walls, std::ostream& json);
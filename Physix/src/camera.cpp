@@ -91,3 +91,13 @@ glm::mat4 Camera::getViewMatrix() const {
 glm::mat4 Camera::getProjectionMatrix(float aspectRatio) const {
     return glm::perspective(glm::radians(this->ProjectionAngle), aspectRatio, this->MinDist, this->MaxDist);
 }
+
+glm::vec3 Camera::getPickDirection(double cursorX, double cursorY, int width, int height) const {
+    // Window pixel to normalized device coordinates, then back through the projection and view.
+    float x = 2.0f * static_cast<float>(cursorX) / width - 1.0f;
+    float y = 1.0f - 2.0f * static_cast<float>(cursorY) / height;
+    glm::mat4 inverse = glm::inverse(getProjectionMatrix(static_cast<float>(width) / height) * getViewMatrix());
+    glm::vec4 nearPoint = inverse * glm::vec4(x, y, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(x, y, 1.0f, 1.0f);
+    return glm::normalize(glm::vec3(farPoint) / farPoint.w - glm::vec3(nearPoint) / nearPoint.w);
+}
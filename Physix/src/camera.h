@@ -33,6 +33,10 @@ public:
     glm::mat4 getViewMatrix() const;
     glm::mat4 getProjectionMatrix(float aspectRatio) const;
 
+    // Normalized world-space direction of the ray from the camera through a window
+    // pixel (origin top-left, as GLFW reports the cursor), for mouse picking.
+    glm::vec3 getPickDirection(double cursorX, double cursorY, int width, int height) const;
+
     // Getters
     glm::vec3 getPosition() const { return this->Position; }
     glm::vec3 getDirection() const { return this->Direction; }
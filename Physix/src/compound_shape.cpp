@@ -0,0 +1,68 @@
+#include "compound_shape.h"
+#include <algorithm>
+#include <cassert>
+
+void CompoundShape::AddChild(const Shape& shape, const glm::vec3& position, const glm::mat3& rotation) {
+    assert(shape.type != ShapeType::Compound);
+    children.push_back({ shape, position, rotation });
+}
+
+void CompoundShape::Build() {
+    unsigned int count = static_cast<unsigned int>(children.size());
+    nodes.clear();
+    childBounds.resize(count);
+    bounds = { glm::vec3(0.0f), glm::vec3(0.0f) };
+    if (count == 0) return;
+
+    for (unsigned int i = 0; i < count; i++) childBounds[i] = ShapeBounds(children[i]);
+    std::vector<unsigned int> order(count);
+    for (unsigned int i = 0; i < count; i++) order[i] = i;
+
+    nodes.reserve(2 * static_cast<size_t>(count));
+    BuildRange(order, 0, count);
+    bounds = { nodes[0].min, nodes[0].max };
+
+    // Store the children and their bounds in leaf order.
+    std::vector<ShapeBody> sortedChildren(count);
+    std::vector<AABB> sortedBounds(count);
+    for (unsigned int k = 0; k < count; k++) {
+        sortedChildren[k] = children[order[k]];
+        sortedBounds[k] = childBounds[order[k]];
+    }
+    children.swap(sortedChildren);
+    childBounds.swap(sortedBounds);
+}
+
+void CompoundShape::BuildRange(std::vector<unsigned int>& order, unsigned int first, unsigned int count) {
+    unsigned int index = static_cast<unsigned int>(nodes.size());
+    nodes.emplace_back();
+
+    AABB box = childBounds[order[first]];
+    AABB centerBox = { box.Center(), box.Center() };
+    for (unsigned int k = first; k < first + count; k++) {
+        box = Merge(box, childBounds[order[k]]);
+        centerBox.min = glm::min(centerBox.min, childBounds[order[k]].Center());
+        centerBox.max = glm::max(centerBox.max, childBounds[order[k]].Center());
+    }
+    nodes[index].min = box.min;
+    nodes[index].max = box.max;
+
+    if (count <= MAX_LEAF_SIZE) {
+        nodes[index].offset = first;
+        nodes[index].count = count;
+        return;
+    }
+
+    // A compound has a handful of children, so a median split on the widest axis
+    // of the centers is enough.
+    glm::vec3 spread = centerBox.max - centerBox.min;
+    int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+    unsigned int mid = first + count / 2;
+    std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + first + count,
+        [&](unsigned int a, unsigned int b) { return childBounds[a].Center()[axis] < childBounds[b].Center()[axis]; });
+
+    BuildRange(order, first, mid - first);
+    nodes[index].offset = static_cast<unsigned int>(nodes.size());
+    nodes[index].count = 0;
+    BuildRange(order, mid, first + count - mid);
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "aabb.h"
+#include "shape.h"
+
+// Node of a compound's local BVH, stored depth-first like StaticBVHNode: the left
+// child of an internal node is the next node, 'offset' is the index of its right
+// child. For a leaf (count > 0), 'offset' is its first child shape.
+struct CompoundNode {
+    glm::vec3 min;
+    unsigned int offset;
+    glm::vec3 max;
+    unsigned int count;
+};
+
+// A body built from child shapes placed in its frame (furniture, ships). The
+// world sees it as one body with one broadphase proxy; the children are only
+// reached through a small BVH in the compound's frame. Build() stores the
+// children in leaf order, so a leaf's children lie next to each other.
+class CompoundShape {
+public:
+    static const unsigned int MAX_LEAF_SIZE = 2;
+
+    // Children may be any shape but another compound. Build() must follow the last.
+    void AddChild(const Shape& shape, const glm::vec3& position, const glm::mat3& rotation = glm::mat3(1.0f));
+    void Build();
+
+    // Calls callback(childIndex) for every child whose bounds overlap 'box', which
+    // is in the compound's frame.
+    template <typename Callback>
+    void Query(const AABB& box, Callback callback) const;
+
+    size_t getChildCount() const { return children.size(); }
+    // The child's shape, position and rotation in the compound's frame.
+    const ShapeBody& getChild(size_t k) const { return children[k]; }
+    // Bounds of all children in the compound's frame.
+    const AABB& getBounds() const { return bounds; }
+    size_t getNodeCount() const { return nodes.size(); }
+
+private:
+    std::vector<ShapeBody> children;
+    std::vector<AABB> childBounds;
+    std::vector<CompoundNode> nodes;
+    AABB bounds;
+
+    void BuildRange(std::vector<unsigned int>& order, unsigned int first, unsigned int count);
+};
+
+template <typename Callback>
+void CompoundShape::Query(const AABB& box, Callback callback) const {
+    if (nodes.empty()) return;
+
+    unsigned int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        unsigned int index = stack[--top];
+        const CompoundNode& node = nodes[index];
+        if (node.min.x > box.max.x || node.max.x < box.min.x ||
+            node.min.y > box.max.y || node.max.y < box.min.y ||
+            node.min.z > box.max.z || node.max.z < box.min.z) continue;
+
+        if (node.count > 0) {
+            for (unsigned int k = node.offset; k < node.offset + node.count; k++) {
+                if (childBounds[k].Overlaps(box)) callback(static_cast<size_t>(k));
+            }
+        }
+        else {
+            stack[top++] = node.offset;
+            stack[top++] = index + 1;
+        }
+    }
+}
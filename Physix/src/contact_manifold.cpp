@@ -0,0 +1,121 @@
+#include "contact_manifold.h"
+#include <cmath>
+
+namespace {
+    // Normals further apart than this (cosine) belong to different contacts.
+    const float NORMAL_MATCH_COSINE = 0.95f;
+    // A point without a feature match takes one from the last step this close to it.
+    const float MATCH_DISTANCE = 0.05f;
+
+    // Twice the area of triangle abc projected on the plane normal to n, signed so
+    // it is positive when abc turns counter-clockwise about n.
+    float SignedArea(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& n) {
+        return glm::dot(glm::cross(b - a, c - a), n);
+    }
+}
+
+int ReduceContactPoints(const glm::vec3* positions, const float* depths, int count, const glm::vec3& normal,
+    int* keep) {
+    if (count <= ContactManifold::MAX_POINTS) {
+        for (int k = 0; k < count; k++) keep[k] = k;
+        return count;
+    }
+
+    // The deepest point carries the contact, so it is always kept.
+    int first = 0;
+    for (int k = 1; k < count; k++) {
+        if (depths[k] > depths[first]) first = k;
+    }
+
+    int second = -1;
+    float bestDistance = -1.0f;
+    for (int k = 0; k < count; k++) {
+        glm::vec3 d = positions[k] - positions[first];
+        d -= glm::dot(d, normal) * normal;
+        float distance = glm::dot(d, d);
+        if (k != first && distance > bestDistance) {
+            bestDistance = distance;
+            second = k;
+        }
+    }
+
+    // Either winding will do; the third point is on the side with the larger area.
+    int third = -1;
+    float bestArea = -1.0f;
+    for (int k = 0; k < count; k++) {
+        float area = std::fabs(SignedArea(positions[first], positions[second], positions[k], normal));
+        if (k != first && k != second && area > bestArea) {
+            bestArea = area;
+            third = k;
+        }
+    }
+
+    keep[0] = first;
+    keep[1] = second;
+    keep[2] = third;
+    if (!(bestArea > 0.0f)) return 3;
+
+    // With the triangle wound counter-clockwise, a point outside it is on the
+    // negative side of an edge; the most negative edge area is what it adds.
+    if (SignedArea(positions[first], positions[second], positions[third], normal) < 0.0f) {
+        keep[1] = third;
+        keep[2] = second;
+    }
+    int fourth = -1;
+    float bestAdded = 0.0f;
+    for (int k = 0; k < count; k++) {
+        if (k == keep[0] || k == keep[1] || k == keep[2]) continue;
+        float added = 0.0f;
+        for (int e = 0; e < 3; e++) {
+            float area = SignedArea(positions[keep[e]], positions[keep[(e + 1) % 3]], positions[k], normal);
+            if (-area > added) added = -area;
+        }
+        if (added > bestAdded) {
+            bestAdded = added;
+            fourth = k;
+        }
+    }
+    if (fourth < 0) return 3;
+    keep[3] = fourth;
+    return 4;
+}
+
+int WarmStartManifold(ContactManifold& manifold, const ContactManifold* previous) {
+    for (int p = 0; p < manifold.pointCount; p++) {
+        for (int d = 0; d < 3; d++) manifold.points[p].impulse[d] = 0.0f;
+    }
+    if (!previous || glm::dot(manifold.normal, previous->normal) <= NORMAL_MATCH_COSINE) return 0;
+
+    bool matched[ContactManifold::MAX_POINTS] = {};
+    bool used[ContactManifold::MAX_POINTS] = {};
+    int matchCount = 0;
+    auto take = [&](int p, int q) {
+        for (int d = 0; d < 3; d++) manifold.points[p].impulse[d] = previous->points[q].impulse[d];
+        matched[p] = used[q] = true;
+        matchCount++;
+    };
+
+    for (int p = 0; p < manifold.pointCount; p++) {
+        for (int q = 0; q < previous->pointCount; q++) {
+            if (!used[q] && previous->points[q].feature == manifold.points[p].feature) {
+                take(p, q);
+                break;
+            }
+        }
+    }
+    for (int p = 0; p < manifold.pointCount; p++) {
+        if (matched[p]) continue;
+        int nearest = -1;
+        float bestDistance = MATCH_DISTANCE * MATCH_DISTANCE;
+        for (int q = 0; q < previous->pointCount; q++) {
+            glm::vec3 d = previous->points[q].localPoint - manifold.points[p].localPoint;
+            float distance = glm::dot(d, d);
+            if (!used[q] && distance < bestDistance) {
+                bestDistance = distance;
+                nearest = q;
+            }
+        }
+        if (nearest >= 0) take(p, nearest);
+    }
+    return matchCount;
+}
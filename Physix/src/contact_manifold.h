@@ -0,0 +1,39 @@
+#pragma once
+#include <glm/glm.hpp>
+
+// A contact point kept across steps. 'feature' names the pair of features (vertex,
+// edge, face, clip plane) that produced it, so the same point is recognised next
+// step however far it slid. The impulses are the solver's accumulated normal and
+// friction impulses, carried over as its starting guess.
+struct ManifoldPoint {
+    glm::vec3 position;
+    glm::vec3 localPoint;      // in body a's frame
+    float depth;
+    unsigned int feature;
+    float impulse[3];
+};
+
+// The contact of one pair, persistent across steps. 'normal' points from a towards b.
+struct ContactManifold {
+    static const int MAX_POINTS = 4;
+
+    glm::vec3 normal;
+    int pointCount;
+    ManifoldPoint points[MAX_POINTS];
+};
+
+// Picks at most ContactManifold::MAX_POINTS of 'count' candidate points, writing
+// their indices to 'keep', and returns how many. The deepest point is kept, then the
+// one furthest from it, then the one spanning the largest triangle with those two and
+// last the one adding the most area outside that triangle. Distances and areas are
+// measured in the contact plane.
+int ReduceContactPoints(const glm::vec3* positions, const float* depths, int count, const glm::vec3& normal,
+    int* keep);
+
+// Starts the points of 'manifold' from the impulses of the points of 'previous' (the
+// pair's manifold of the last step, if any) with the same feature, or from zero.
+// A point whose features changed without it moving (a corner crossing a side plane,
+// the reference face passing to the other body) takes the nearest unmatched point
+// close to it in a's frame instead. Returns the number of points matched. A manifold
+// whose normal has turned too far is treated as new.
+int WarmStartManifold(ContactManifold& manifold, const ContactManifold* previous);
@@ -0,0 +1,151 @@
+#include "container_collider.h"
+#include "simd_lanes.h"
+#include <algorithm>
+
+namespace {
+    // Perfectly elastic, like the walls.
+    const float RESTITUTION = 1.0f;
+
+    // Block of spheres staged per coordinate: position, velocity, radius. Velocities
+    // are only gathered for a block that touched.
+    template <typename L>
+    struct SphereLanes {
+        alignas(32) float p[3][L::WIDTH];
+        alignas(32) float v[3][L::WIDTH];
+        alignas(32) float r[L::WIDTH];
+
+        // The tail of a short block repeats its last sphere.
+        void GatherPositions(const Sphere* spheres, size_t count) {
+            for (int k = 0; k < L::WIDTH; k++) {
+                const Sphere& s = spheres[static_cast<size_t>(k) < count ? k : count - 1];
+                p[0][k] = s.position.x;
+                p[1][k] = s.position.y;
+                p[2][k] = s.position.z;
+                r[k] = s.mesh->getRadius();
+            }
+        }
+
+        void GatherVelocities(const Sphere* spheres, size_t count) {
+            for (int k = 0; k < L::WIDTH; k++) {
+                const Sphere& s = spheres[static_cast<size_t>(k) < count ? k : count - 1];
+                v[0][k] = s.velocity.x;
+                v[1][k] = s.velocity.y;
+                v[2][k] = s.velocity.z;
+            }
+        }
+
+        void Scatter(Sphere* spheres, size_t count) const {
+            for (size_t k = 0; k < count; k++) {
+                spheres[k].position = glm::vec3(p[0][k], p[1][k], p[2][k]);
+                spheres[k].velocity = glm::vec3(v[0][k], v[1][k], v[2][k]);
+            }
+        }
+    };
+
+    template <typename L>
+    void ContainerLanes(Sphere* spheres, size_t count, const ContainerCollider& container) {
+        typedef typename L::Float Float;
+        SphereLanes<L> lanes;
+        for (size_t first = 0; first < count; first += L::WIDTH) {
+            size_t blockCount = std::min(static_cast<size_t>(L::WIDTH), count - first);
+            lanes.GatherPositions(spheres + first, blockCount);
+            Float r = L::Load(lanes.r);
+            Float low[3], high[3], below[3], above[3];
+            unsigned int touched = 0;
+            for (int i = 0; i < 3; i++) {
+                Float p = L::Load(lanes.p[i]);
+                low[i] = L::Add(L::Set(container.min[i]), r);
+                high[i] = L::Sub(L::Set(container.max[i]), r);
+                below[i] = L::Less(p, low[i]);
+                above[i] = L::Less(high[i], p);
+                touched |= L::MoveMask(below[i]) | L::MoveMask(above[i]);
+            }
+            if (!touched) continue;
+
+            // Clamped into [low, high]; the velocity component pointing out is turned
+            // back in, scaled by the restitution.
+            lanes.GatherVelocities(spheres + first, blockCount);
+            for (int i = 0; i < 3; i++) {
+                Float p = L::Load(lanes.p[i]);
+                Float v = L::Load(lanes.v[i]);
+                Float bounced = L::Mul(L::Set(-RESTITUTION), v);
+                Float inward = L::Max(v, bounced);
+                Float outward = L::Min(v, bounced);
+                L::Store(lanes.p[i], L::Min(L::Max(p, low[i]), high[i]));
+                L::Store(lanes.v[i], L::Select(below[i], inward, L::Select(above[i], outward, v)));
+            }
+            lanes.Scatter(spheres + first, blockCount);
+        }
+    }
+
+    template <typename L>
+    void PlaneLanes(Sphere* spheres, size_t count, const PlaneCollider& plane) {
+        typedef typename L::Float Float;
+        SphereLanes<L> lanes;
+        for (size_t first = 0; first < count; first += L::WIDTH) {
+            size_t blockCount = std::min(static_cast<size_t>(L::WIDTH), count - first);
+            lanes.GatherPositions(spheres + first, blockCount);
+            Float distance = L::Set(-plane.offset);
+            for (int i = 0; i < 3; i++) distance = L::Add(distance, L::Mul(L::Set(plane.normal[i]), L::Load(lanes.p[i])));
+            Float r = L::Load(lanes.r);
+            Float touching = L::Less(distance, r);
+            if (!L::MoveMask(touching)) continue;
+
+            lanes.GatherVelocities(spheres + first, blockCount);
+            Float velAlongNormal = L::Set(0.0f);
+            for (int i = 0; i < 3; i++) velAlongNormal = L::Add(velAlongNormal, L::Mul(L::Set(plane.normal[i]), L::Load(lanes.v[i])));
+
+            Float push = L::And(touching, L::Sub(r, distance));
+            Float j = L::And(touching, L::Mul(L::Set(1.0f + RESTITUTION), L::Min(velAlongNormal, L::Set(0.0f))));
+            for (int i = 0; i < 3; i++) {
+                Float n = L::Set(plane.normal[i]);
+                L::Store(lanes.p[i], L::Add(L::Load(lanes.p[i]), L::Mul(push, n)));
+                L::Store(lanes.v[i], L::Sub(L::Load(lanes.v[i]), L::Mul(j, n)));
+            }
+            lanes.Scatter(spheres + first, blockCount);
+        }
+    }
+}
+
+void ResolvePlaneCollision(Sphere& sphere, const PlaneCollider& plane) {
+    float r = sphere.mesh->getRadius();
+    float distance = glm::dot(plane.normal, sphere.position) - plane.offset;
+    if (distance >= r) return;
+    sphere.position += (r - distance) * plane.normal;
+    float velAlongNormal = glm::dot(sphere.velocity, plane.normal);
+    if (velAlongNormal < 0.0f) sphere.velocity -= (1.0f + RESTITUTION) * velAlongNormal * plane.normal;
+}
+
+void ResolveContainerCollision(Sphere& sphere, const ContainerCollider& container) {
+    float r = sphere.mesh->getRadius();
+    for (int i = 0; i < 3; i++) {
+        float low = container.min[i] + r;
+        float high = container.max[i] - r;
+        if (sphere.position[i] < low) {
+            sphere.position[i] = low;
+            if (sphere.velocity[i] < 0.0f) sphere.velocity[i] *= -RESTITUTION;
+        }
+        else if (sphere.position[i] > high) {
+            sphere.position[i] = high;
+            if (sphere.velocity[i] > 0.0f) sphere.velocity[i] *= -RESTITUTION;
+        }
+    }
+}
+
+void ResolvePlaneRange(std::vector<Sphere>& spheres, size_t left, size_t right, const PlaneCollider& plane) {
+    if (right <= left) return;
+#ifdef __AVX__
+    PlaneLanes<AVXLanes>(spheres.data() + left, right - left, plane);
+#else
+    PlaneLanes<SSELanes>(spheres.data() + left, right - left, plane);
+#endif
+}
+
+void ResolveContainerRange(std::vector<Sphere>& spheres, size_t left, size_t right, const ContainerCollider& container) {
+    if (right <= left) return;
+#ifdef __AVX__
+    ContainerLanes<AVXLanes>(spheres.data() + left, right - left, container);
+#else
+    ContainerLanes<SSELanes>(spheres.data() + left, right - left, container);
+#endif
+}
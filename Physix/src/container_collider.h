@@ -0,0 +1,30 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "sphere.h"
+
+// Infinite plane; the free side is the one 'normal' (unit length) points into,
+// where dot(normal, p) > offset.
+struct PlaneCollider {
+    glm::vec3 normal;
+    float offset;
+};
+
+// Axis-aligned box whose inside is the free space, like a room. It stands in for
+// walls built from six Cuboids: a sphere's test is a clamp of its center to
+// [min + r, max - r] per axis, with no rotation or closest-point search, and being
+// solid all the way out it cannot be tunnelled through.
+struct ContainerCollider {
+    glm::vec3 min;
+    glm::vec3 max;
+};
+
+// A touching sphere is put back on the surface and, if moving into it, reflected.
+void ResolvePlaneCollision(Sphere& sphere, const PlaneCollider& plane);
+void ResolveContainerCollision(Sphere& sphere, const ContainerCollider& container);
+
+// The same for spheres[left, right), a block of spheres at a time: each block is
+// staged into SIMD lanes per coordinate, tested branch-free and written back only
+// if one of its spheres touched.
+void ResolvePlaneRange(std::vector<Sphere>& spheres, size_t left, size_t right, const PlaneCollider& plane);
+void ResolveContainerRange(std::vector<Sphere>& spheres, size_t left, size_t right, const ContainerCollider& container);
@@ -0,0 +1,186 @@
+#include "convex_hull.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <emmintrin.h>
+#include <utility>
+
+namespace {
+    // Faces of the hull under construction. Faces hidden by a new point are only
+    // marked dead and dropped when the hull is compacted.
+    struct BuildFace {
+        unsigned int v[3];
+        glm::vec3 normal;
+        float offset;
+        bool live;
+    };
+
+    BuildFace MakeFace(const std::vector<glm::vec3>& points, unsigned int a, unsigned int b, unsigned int c) {
+        BuildFace face = { { a, b, c }, glm::vec3(0.0f), 0.0f, true };
+        glm::vec3 n = glm::cross(points[b] - points[a], points[c] - points[a]);
+        float length = glm::length(n);
+        if (length > 0.0f) face.normal = n / length;
+        face.offset = glm::dot(face.normal, points[a]);
+        return face;
+    }
+
+    template <typename Distance>
+    unsigned int Furthest(const std::vector<glm::vec3>& points, Distance distance) {
+        unsigned int best = 0;
+        float bestDistance = -1.0f;
+        for (unsigned int i = 0; i < points.size(); i++) {
+            float d = distance(points[i]);
+            if (d > bestDistance) {
+                bestDistance = d;
+                best = i;
+            }
+        }
+        return best;
+    }
+}
+
+ConvexHull::ConvexHull(const std::vector<glm::vec3>& points)
+    : boundingRadius(0.0f) {
+    Build(points);
+
+    for (const glm::vec3& v : vertices) boundingRadius = std::max(boundingRadius, glm::length(v));
+
+    size_t padded = (vertices.size() + 3) & ~size_t(3);
+    glm::vec3 pad = vertices.empty() ? glm::vec3(0.0f) : vertices[0];
+    xs.assign(padded, pad.x);
+    ys.assign(padded, pad.y);
+    zs.assign(padded, pad.z);
+    for (size_t i = 0; i < vertices.size(); i++) {
+        xs[i] = vertices[i].x;
+        ys[i] = vertices[i].y;
+        zs[i] = vertices[i].z;
+    }
+}
+
+void ConvexHull::Build(const std::vector<glm::vec3>& points) {
+    vertices = points;
+    faces.clear();
+    if (points.size() < 4) return;
+
+    glm::vec3 lo = points[0], hi = points[0];
+    for (const glm::vec3& p : points) {
+        lo = glm::min(lo, p);
+        hi = glm::max(hi, p);
+    }
+    glm::vec3 size = hi - lo;
+    float epsilon = 1e-5f * std::max(size.x, std::max(size.y, size.z));
+
+    // Starting tetrahedron: a point, the point furthest from it, the point furthest
+    // from their line and the point furthest from the plane of the three.
+    unsigned int i0 = static_cast<unsigned int>(std::min_element(points.begin(), points.end(),
+        [](const glm::vec3& a, const glm::vec3& b) { return a.x < b.x; }) - points.begin());
+    const glm::vec3& origin = points[i0];
+    unsigned int i1 = Furthest(points, [&](const glm::vec3& p) {
+        glm::vec3 d = p - origin;
+        return glm::dot(d, d);
+    });
+    glm::vec3 lineDirection = glm::normalize(points[i1] - origin);
+    unsigned int i2 = Furthest(points, [&](const glm::vec3& p) {
+        glm::vec3 d = glm::cross(p - origin, lineDirection);
+        return glm::dot(d, d);
+    });
+    glm::vec3 planeNormal = glm::cross(points[i1] - origin, points[i2] - origin);
+    float planeArea = glm::length(planeNormal);
+    if (planeArea > 0.0f) planeNormal /= planeArea;
+    unsigned int i3 = Furthest(points, [&](const glm::vec3& p) {
+        return std::abs(glm::dot(p - origin, planeNormal));
+    });
+
+    // Flat or degenerate clouds keep every point and have no faces; Support() still works.
+    if (glm::length(points[i1] - origin) <= epsilon ||
+        glm::length(glm::cross(points[i2] - origin, lineDirection)) <= epsilon ||
+        std::abs(glm::dot(points[i3] - origin, planeNormal)) <= epsilon) {
+        return;
+    }
+
+    std::vector<BuildFace> build;
+    glm::vec3 inside = 0.25f * (points[i0] + points[i1] + points[i2] + points[i3]);
+    unsigned int tetra[4][3] = { { i0, i1, i2 }, { i0, i3, i1 }, { i0, i2, i3 }, { i1, i3, i2 } };
+    for (auto& t : tetra) {
+        BuildFace face = MakeFace(points, t[0], t[1], t[2]);
+        if (glm::dot(face.normal, inside) > face.offset) face = MakeFace(points, t[0], t[2], t[1]);
+        build.push_back(face);
+    }
+
+    // Each point beyond some faces replaces them with a fan from the horizon (the
+    // edges between visible and hidden faces) to the point.
+    std::vector<std::pair<unsigned int, unsigned int>> horizon;
+    for (unsigned int i = 0; i < points.size(); i++) {
+        if (i == i0 || i == i1 || i == i2 || i == i3) continue;
+        const glm::vec3& p = points[i];
+
+        horizon.clear();
+        for (BuildFace& face : build) {
+            if (!face.live || glm::dot(face.normal, p) - face.offset <= epsilon) continue;
+            face.live = false;
+            // An edge shared by two visible faces shows up once in each direction.
+            for (int k = 0; k < 3; k++) {
+                std::pair<unsigned int, unsigned int> edge(face.v[k], face.v[(k + 1) % 3]);
+                auto twin = std::find(horizon.begin(), horizon.end(), std::make_pair(edge.second, edge.first));
+                if (twin != horizon.end()) horizon.erase(twin);
+                else horizon.push_back(edge);
+            }
+        }
+        for (const auto& edge : horizon) build.push_back(MakeFace(points, edge.first, edge.second, i));
+    }
+
+    // Keep only the points still used by a face.
+    std::vector<unsigned int> remap(points.size(), ~0u);
+    vertices.clear();
+    for (const BuildFace& face : build) {
+        if (!face.live) continue;
+        HullFace out;
+        for (int k = 0; k < 3; k++) {
+            if (remap[face.v[k]] == ~0u) {
+                remap[face.v[k]] = static_cast<unsigned int>(vertices.size());
+                vertices.push_back(points[face.v[k]]);
+            }
+            out.v[k] = remap[face.v[k]];
+        }
+        out.normal = face.normal;
+        out.offset = face.offset;
+        faces.push_back(out);
+    }
+}
+
+unsigned int ConvexHull::Support(const glm::vec3& direction) const {
+    if (vertices.size() <= 1) return 0;
+
+    __m128 dx = _mm_set1_ps(direction.x);
+    __m128 dy = _mm_set1_ps(direction.y);
+    __m128 dz = _mm_set1_ps(direction.z);
+    __m128 best = _mm_set1_ps(-FLT_MAX);
+    __m128i bestIndex = _mm_setzero_si128();
+    __m128i index = _mm_set_epi32(3, 2, 1, 0);
+    const __m128i four = _mm_set1_epi32(4);
+
+    for (size_t i = 0; i < xs.size(); i += 4) {
+        __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&xs[i]), dx), _mm_mul_ps(_mm_loadu_ps(&ys[i]), dy)),
+            _mm_mul_ps(_mm_loadu_ps(&zs[i]), dz));
+        __m128 greater = _mm_cmpgt_ps(d, best);
+        __m128i mask = _mm_castps_si128(greater);
+        best = _mm_or_ps(_mm_and_ps(greater, d), _mm_andnot_ps(greater, best));
+        bestIndex = _mm_or_si128(_mm_and_si128(mask, index), _mm_andnot_si128(mask, bestIndex));
+        index = _mm_add_epi32(index, four);
+    }
+
+    alignas(16) float value[4];
+    alignas(16) unsigned int lane[4];
+    _mm_store_ps(value, best);
+    _mm_store_si128(reinterpret_cast<__m128i*>(lane), bestIndex);
+    // Ties go to the lower index, so padding never wins over the vertex it copies.
+    unsigned int result = lane[0];
+    float resultValue = value[0];
+    for (int k = 1; k < 4; k++) {
+        if (value[k] > resultValue || (value[k] == resultValue && lane[k] < result)) {
+            result = lane[k];
+            resultValue = value[k];
+        }
+    }
+    return result;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+// Triangle of a convex hull, counter-clockwise seen from outside.
+struct HullFace {
+    unsigned int v[3];
+    glm::vec3 normal;
+    float offset;        // dot(normal, x) == offset on the face's plane
+};
+
+// Convex hull of a point cloud, in the body's local frame.
+// Built once with an incremental (beneath-beyond) algorithm: points inside the
+// hull are dropped and the rest are kept with outward-facing triangles. The
+// vertices are also stored as padded x / y / z arrays, so Support() scans four
+// vertices per SSE instruction.
+class ConvexHull {
+public:
+    ConvexHull(const std::vector<glm::vec3>& points);
+
+    // Index of the vertex furthest along 'direction'.
+    unsigned int Support(const glm::vec3& direction) const;
+
+    const glm::vec3& getVertex(unsigned int index) const { return vertices[index]; }
+    const std::vector<glm::vec3>& getVertices() const { return vertices; }
+    const std::vector<HullFace>& getFaces() const { return faces; }
+    size_t getVertexCount() const { return vertices.size(); }
+    // Radius of the sphere around the local origin that holds every vertex.
+    float getBoundingRadius() const { return boundingRadius; }
+
+private:
+    std::vector<glm::vec3> vertices;
+    std::vector<HullFace> faces;
+    std::vector<float> xs, ys, zs;    // padded to a multiple of 4 with the first vertex
+    float boundingRadius;
+
+    void Build(const std::vector<glm::vec3>& points);
+};
@@ -0,0 +1,47 @@
+#include "convex_mesh.h"
+
+Convex_mesh::Convex_mesh(const ConvexHull& hull)
+    : VAO(0), VBO(0), vertexCount(0)
+{
+    std::vector<float> vertices;
+    generateConvexMesh(hull, vertices);
+    vertexCount = static_cast<unsigned int>(vertices.size() / 6);
+
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    // Create and fill VBO. Faces do not share vertices, so no EBO is needed.
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+
+    // Set vertex attributes: Position (location 0) and Normal (location 1).
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    glBindVertexArray(0);
+}
+
+Convex_mesh::~Convex_mesh() {
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+}
+
+void Convex_mesh::render() const {
+    glBindVertexArray(VAO);
+    glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+    glBindVertexArray(0);
+}
+
+void Convex_mesh::generateConvexMesh(const ConvexHull& hull, std::vector<float>& vertices)
+{
+    // Each vertex: position (3 floats) then the face normal (3 floats).
+    for (const HullFace& face : hull.getFaces()) {
+        for (int k = 0; k < 3; k++) {
+            const glm::vec3& p = hull.getVertex(face.v[k]);
+            vertices.insert(vertices.end(), { p.x, p.y, p.z, face.normal.x, face.normal.y, face.normal.z });
+        }
+    }
+}
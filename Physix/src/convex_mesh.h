@@ -0,0 +1,24 @@
+#pragma once
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "convex_hull.h"
+
+class Convex_mesh {
+public:
+    // Constructor: creates a flat-shaded mesh from the faces of a convex hull.
+    Convex_mesh(const ConvexHull& hull);
+
+    // Destructor: cleans up allocated OpenGL resources.
+    ~Convex_mesh();
+
+    // Render the hull mesh.
+    void render() const;
+
+private:
+    unsigned int VAO, VBO;
+    unsigned int vertexCount;
+
+    // Helper function to generate vertices (with face normals) for every hull face.
+    void generateConvexMesh(const ConvexHull& hull, std::vector<float>& vertices);
+};
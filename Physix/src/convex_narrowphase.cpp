@@ -0,0 +1,97 @@
+#include "convex_narrowphase.h"
+#include "parallel.h"
+#include <algorithm>
+
+namespace {
+    // Perfectly elastic, like the sphere-sphere and sphere-wall contacts.
+    const float RESTITUTION = 1.0f;
+
+    AABB ShapeBounds(const ConvexCollider& shape) {
+        float reach = shape.radius + (shape.hull ? shape.hull->getBoundingRadius() : glm::length(shape.halfExtents));
+        return AABB::FromSphere(shape.center, reach);
+    }
+}
+
+ConvexNarrowphase::ConvexNarrowphase()
+    : tree(0.0f, 0.0f), shapes(nullptr), threadPairs(NumWorkerThreads()), threadIterations(NumWorkerThreads(), 0),
+    iterations(0) {
+}
+
+void ConvexNarrowphase::SetStatic(const std::vector<ConvexCollider>& newShapes) {
+    for (int proxy : proxies) {
+        tree.DestroyProxy(proxy);
+    }
+    proxies.clear();
+    // The cached simplices belong to the old shapes.
+    pairCache.Clear();
+
+    shapes = &newShapes;
+    for (size_t i = 0; i < newShapes.size(); i++) {
+        proxies.push_back(tree.CreateProxy(ShapeBounds(newShapes[i]), static_cast<unsigned int>(i)));
+    }
+}
+
+void ConvexNarrowphase::Resolve(std::vector<Sphere>& spheres, float deltaTime) {
+    pairs.clear();
+    iterations = 0;
+    if (!shapes || shapes->empty()) return;
+
+    // Candidate pairs, in sphere order since the batches are contiguous.
+    for (std::vector<CollisionPair>& buffer : threadPairs) buffer.clear();
+    ParallelForRange(spheres.size(), [&](size_t left, size_t right, unsigned int batch) {
+        std::vector<CollisionPair>& buffer = threadPairs[batch];
+        for (size_t i = left; i < right; i++) {
+            const Sphere& sphere = spheres[i];
+            float reach = sphere.mesh->getRadius() + deltaTime * glm::length(sphere.velocity);
+            tree.Query(AABB::FromSphere(sphere.position, reach), [&](int proxy) {
+                buffer.push_back({ static_cast<unsigned int>(i), tree.getUserData(proxy) });
+            });
+        }
+    });
+    for (const std::vector<CollisionPair>& buffer : threadPairs) pairs.insert(pairs.end(), buffer.begin(), buffer.end());
+    pairCache.Update(pairs);
+
+    // Carry each persisting pair's simplex over; new pairs have userData 0 and start cold.
+    std::swap(caches, previousCaches);
+    caches.resize(pairs.size());
+    for (size_t k = 0; k < pairs.size(); k++) {
+        PairCacheEntry* entry = pairCache.Find(pairs[k].a, pairs[k].b);
+        if (entry->userData != 0) caches[k] = previousCaches[entry->userData - 1];
+        else caches[k].count = 0;
+        entry->userData = static_cast<unsigned int>(k + 1);
+    }
+
+    // Each batch owns the pairs of its spheres.
+    std::fill(threadIterations.begin(), threadIterations.end(), 0);
+    ParallelForRange(spheres.size(), [&](size_t left, size_t right, unsigned int batch) {
+        auto first = std::lower_bound(pairs.begin(), pairs.end(), left,
+            [](const CollisionPair& pair, size_t sphere) { return pair.a < sphere; });
+        for (size_t k = first - pairs.begin(); k < pairs.size() && pairs[k].a < right; k++) {
+            Sphere& sphere = spheres[pairs[k].a];
+            ConvexCollider ball = { nullptr, glm::vec3(0.0f), sphere.position, glm::mat3(1.0f), sphere.mesh->getRadius(),
+                false };
+
+            ConvexContact contact;
+            float speculative = deltaTime * glm::length(sphere.velocity);
+            bool touching = CollideConvex(ball, (*shapes)[pairs[k].b], caches[k], speculative, contact);
+            threadIterations[batch] += contact.iterations;
+            if (!touching) continue;
+
+            // The normal points from the sphere into the shape.
+            float velAlongNormal = glm::dot(sphere.velocity, contact.normal);
+            if (contact.distance <= CONTACT_SLOP) {
+                if (contact.distance < 0.0f) sphere.position += contact.distance * contact.normal;
+                if (velAlongNormal > 0.0f) sphere.velocity -= (1.0f + RESTITUTION) * velAlongNormal * contact.normal;
+                continue;
+            }
+            // Apart: it only loses the speed that would carry it past the surface within the step.
+            float excess = velAlongNormal - contact.distance / deltaTime;
+            if (excess > 0.0f) sphere.velocity -= excess * contact.normal;
+        }
+    });
+    for (size_t n : threadIterations) iterations += n;
+}
+
+float ConvexNarrowphase::getAverageIterations() const {
+    return pairs.empty() ? 0.0f : static_cast<float>(iterations) / static_cast<float>(pairs.size());
+}
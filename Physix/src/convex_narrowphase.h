@@ -0,0 +1,45 @@
+#pragma once
+#include <vector>
+#include "aabb_tree.h"
+#include "gjk.h"
+#include "pair_cache.h"
+#include "sphere.h"
+
+// Spheres against static convex shapes (rocks).
+// Sphere-shape pairs come from a dynamic AABB tree over the shapes and are tracked in
+// a PairCache, whose userData points at the pair's GJK simplex from the last call.
+// A sphere resting on a rock therefore restarts GJK from the face it is resting on
+// and usually stops after one iteration. A touching sphere is pushed out along the
+// contact normal and reflected if it is moving into the shape, like the walls do.
+// A sphere still apart that reaches the shape within deltaTime is a speculative
+// contact: GJK runs with that reach as its maximum distance, and the sphere only
+// loses the speed that would carry it into the shape within the step.
+// The pairs store the sphere index in 'a' and the shape index in 'b'.
+class ConvexNarrowphase {
+public:
+    ConvexNarrowphase();
+
+    // Registers the static shapes, replacing any earlier ones; they must outlive the narrowphase.
+    void SetStatic(const std::vector<ConvexCollider>& shapes);
+
+    void Resolve(std::vector<Sphere>& spheres, float deltaTime);
+
+    // Statistics of the last Resolve().
+    size_t getPairCount() const { return pairs.size(); }
+    // Average GJK iterations per pair.
+    float getAverageIterations() const;
+
+private:
+    AABBTree tree;
+    std::vector<int> proxies;
+    const std::vector<ConvexCollider>* shapes;
+
+    std::vector<std::vector<CollisionPair>> threadPairs;
+    std::vector<size_t> threadIterations;
+    std::vector<CollisionPair> pairs;
+    PairCache pairCache;
+    // caches[k] belongs to pairs[k]; previousCaches holds the last call's.
+    std::vector<GJKCache> caches;
+    std::vector<GJKCache> previousCaches;
+    size_t iterations;
+};
@@ -1,11 +1,13 @@
 #include "Cuboid.h"
+#include <glm/gtc/matrix_inverse.hpp>
 
 Cuboid::Cuboid(Cuboid_mesh* mesh,
     const glm::vec3& position,
     const glm::vec3& rotation)
-    : mesh(mesh), position(position), rotation(rotation)
+    : mesh(mesh), position(position), mass(0.0f), invMass(0.0f), invInertiaLocal(0.0f),
+    velocity(0.0f), angularVelocity(0.0f)
 {
-    updateModelMatrix();
+    setRotation(rotation);
 }
 
 void Cuboid::Render(const Shader& shader) {
@@ -35,17 +37,88 @@ void Cuboid::setPosition(const glm::vec3& newPosition) {
 }
 
 void Cuboid::setRotation(const glm::vec3& newRotation) {
-    rotation = newRotation;
+    // Apply rotations about X, Y, then Z axes.
+    orientation = glm::angleAxis(newRotation.x, glm::vec3(1.0f, 0.0f, 0.0f)) *
+        glm::angleAxis(newRotation.y, glm::vec3(0.0f, 1.0f, 0.0f)) *
+        glm::angleAxis(newRotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
+    updateModelMatrix();
+}
+
+void Cuboid::setOrientation(const glm::quat& newOrientation) {
+    orientation = glm::normalize(newOrientation);
+    updateModelMatrix();
+}
+
+void Cuboid::setMass(float newMass) {
+    mass = newMass;
+    if (mass <= 0.0f) {
+        mass = invMass = 0.0f;
+        invInertiaLocal = glm::vec3(0.0f);
+        velocity = angularVelocity = glm::vec3(0.0f);
+        return;
+    }
+    invMass = 1.0f / mass;
+    // Solid box: I = m / 12 * (sum of the squares of the other two sides).
+    glm::vec3 size(getLength(), getHeight(), getBreadth());
+    glm::vec3 sq = size * size;
+    glm::vec3 inertia = (mass / 12.0f) * glm::vec3(sq.y + sq.z, sq.x + sq.z, sq.x + sq.y);
+    invInertiaLocal = 1.0f / inertia;
+}
+
+glm::mat3 Cuboid::getInvInertia() const {
+    const glm::mat3& r = collider.rotation;
+    glm::mat3 scaled(r[0] * invInertiaLocal.x, r[1] * invInertiaLocal.y, r[2] * invInertiaLocal.z);
+    return scaled * glm::transpose(r);
+}
+
+glm::vec3 Cuboid::getPointVelocity(const glm::vec3& point) const {
+    return velocity + glm::cross(angularVelocity, point - position);
+}
+
+void Cuboid::ApplyImpulse(const glm::vec3& impulse, const glm::vec3& point) {
+    if (invMass == 0.0f) return;
+    velocity += invMass * impulse;
+    angularVelocity += getInvInertia() * glm::cross(point - position, impulse);
+}
+
+void Cuboid::Update(float deltaTime, const glm::vec3& acceleration) {
+    if (invMass == 0.0f) return;
+    velocity += acceleration * deltaTime;
+    position += velocity * deltaTime;
+    // dq/dt = 0.5 * (0, w) * q
+    glm::quat spin(0.0f, angularVelocity.x, angularVelocity.y, angularVelocity.z);
+    orientation = glm::normalize(orientation + (0.5f * deltaTime) * (spin * orientation));
     updateModelMatrix();
 }
 
 void Cuboid::updateModelMatrix() {
-    modelMatrix = glm::mat4(1.0f);
-    modelMatrix = glm::translate(modelMatrix, position);
-    // Apply rotations about X, Y, then Z axes.
-    modelMatrix = glm::rotate(modelMatrix, rotation.x, glm::vec3(1.0f, 0.0f, 0.0f));
-    modelMatrix = glm::rotate(modelMatrix, rotation.y, glm::vec3(0.0f, 1.0f, 0.0f));
-    modelMatrix = glm::rotate(modelMatrix, rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
+    modelMatrix = glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(orientation);
+
+    collider.center = position;
+    collider.rotation = glm::mat3(modelMatrix);
+    collider.halfExtents = glm::vec3(getLength(), getHeight(), getBreadth()) * 0.5f;
+    collider.inverse = glm::affineInverse(modelMatrix);
+
+    // Front: +Z, Back: -Z, Right: +X, Left: -X, Top: +Y, Bottom: -Y.
+    for (int i = 0; i < 6; i++) {
+        int axis = i < 2 ? 2 : (i < 4 ? 0 : 1);
+        float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+        glm::vec3 normal = sign * collider.rotation[axis];
+        float d = glm::dot(normal, position) + collider.halfExtents[axis];
+        collider.planes[i] = glm::vec4(normal, d);
+    }
+}
+
+AABB Cuboid::getBounds() const {
+    const glm::vec3& half = collider.halfExtents;
+
+    // Project the half extents onto the world axes through the absolute rotation.
+    const glm::mat3& rotation = collider.rotation;
+    glm::vec3 extents = glm::abs(rotation[0]) * half.x +
+        glm::abs(rotation[1]) * half.y +
+        glm::abs(rotation[2]) * half.z;
+
+    return { position - extents, position + extents };
 }
 
 std::vector<Face> Cuboid::getSurfacePlanes() const {
@@ -1,8 +1,10 @@
 #pragma once
 #include "cuboid_mesh.h"
 #include "shader.h"
+#include "aabb.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <vector>
 
 // A simple structure representing a face (plane) in world space.
@@ -12,8 +14,23 @@ struct Face {
     glm::vec3 normal;
 };
 
+// World-space collision data of a Cuboid, refreshed whenever it moves so the
+// narrowphase never has to invert the model matrix.
+// 'rotation' holds the box axes as columns, 'inverse' maps world points into the
+// box frame, and planes[i] = (normal, d) with dot(normal, p) = d on face i, in the
+// order of getSurfacePlanes().
+struct CuboidCollider {
+    glm::vec3 center;
+    glm::mat3 rotation;
+    glm::vec3 halfExtents;
+    glm::mat4 inverse;
+    glm::vec4 planes[6];
+};
+
 // The Cuboid class stores physical properties such as position and rotation,
 // computes its model matrix, and allows access to the world-space planes of its faces.
+// A Cuboid is static unless it is given a mass; a dynamic Cuboid (a crate) also carries
+// linear and angular velocity and is moved by CuboidDynamics.
 class Cuboid {
 public:
     // Constructor: accepts a pointer to a Cuboid_mesh (which stores dimensions)
@@ -36,17 +53,53 @@ public:
     // Set transformation.
     void setPosition(const glm::vec3& newPosition);
     void setRotation(const glm::vec3& newRotation);
+    void setOrientation(const glm::quat& newOrientation);
+
+    const glm::vec3& getPosition() const { return position; }
+    const glm::quat& getOrientation() const { return orientation; }
+
+    // Dynamics. A mass of 0 makes the Cuboid static (infinite mass).
+    void setMass(float newMass);
+    float getMass() const { return mass; }
+    float getInvMass() const { return invMass; }
+    bool isDynamic() const { return invMass > 0.0f; }
+
+    void setVelocity(const glm::vec3& newVelocity) { velocity = newVelocity; }
+    void setAngularVelocity(const glm::vec3& newAngularVelocity) { angularVelocity = newAngularVelocity; }
+    const glm::vec3& getVelocity() const { return velocity; }
+    const glm::vec3& getAngularVelocity() const { return angularVelocity; }
+
+    // World-space inverse inertia tensor.
+    glm::mat3 getInvInertia() const;
+    // Velocity of the world-space point 'point' on the body.
+    glm::vec3 getPointVelocity(const glm::vec3& point) const;
+    // Impulse applied at a world-space point; no effect on a static Cuboid.
+    void ApplyImpulse(const glm::vec3& impulse, const glm::vec3& point);
+    // Semi-implicit Euler step of the velocities and the pose.
+    void Update(float deltaTime, const glm::vec3& acceleration);
 
     // Compute and return the world-space planes for each face.
     // Each Face contains a point and the outward normal.
     std::vector<Face> getSurfacePlanes() const;
 
+    // World-space axis-aligned bounds of the (rotated) cuboid.
+    AABB getBounds() const;
+
+    const CuboidCollider& getCollider() const { return collider; }
+
 private:
     Cuboid_mesh* mesh;
     glm::vec3 position;
-    glm::vec3 rotation;  // Euler angles in radians.
+    glm::quat orientation;
     glm::mat4 modelMatrix;
 
-    // Update the model matrix based on current position and rotation.
+    float mass;
+    float invMass;
+    glm::vec3 invInertiaLocal;  // diagonal in the box frame
+    glm::vec3 velocity;
+    glm::vec3 angularVelocity;
+    CuboidCollider collider;
+
+    // Update the model matrix and the collider based on current position and orientation.
     void updateModelMatrix();
 };
@@ -0,0 +1,341 @@
+#include "cuboid_dynamics.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Fraction of the penetration beyond the slop that is pushed out per step.
+    const float BAUMGARTE = 0.2f;
+    const float PENETRATION_SLOP = 0.01f;
+    // Slower approaches do not bounce, so resting crates settle.
+    const float RESTITUTION_THRESHOLD = 1.0f;
+
+    // PairCacheEntry::userData: the cached separating axis + 1 in the low bits, the
+    // index + 1 of the pair's manifold of the last step above them.
+    const unsigned int AXIS_BITS = 4;
+    const unsigned int AXIS_MASK = (1u << AXIS_BITS) - 1;
+
+    // Solver colours. Manifolds that find all others taken share the last one,
+    // which is solved on one thread.
+    const unsigned int MAX_COLORS = 64;
+    const unsigned int SERIAL_COLOR = MAX_COLORS - 1;
+    // Fewest manifolds of a colour worth handing to another thread.
+    const size_t MIN_SOLVE_BATCH = 32;
+
+    glm::vec3 AnyPerpendicular(const glm::vec3& n) {
+        // Cross with the world axis least aligned with n.
+        glm::vec3 axis = std::fabs(n.x) < 0.57735f ? glm::vec3(1.0f, 0.0f, 0.0f) :
+            (std::fabs(n.y) < 0.57735f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f));
+        return glm::normalize(glm::cross(n, axis));
+    }
+}
+
+CuboidDynamics::CuboidDynamics(int solverIterations, float friction, float restitution)
+    : solverIterations(solverIterations), friction(friction), restitution(restitution),
+    tree(0.1f, 2.0f), statics(nullptr), cachedAxisHits(0), warmStarts(0) {
+}
+
+void CuboidDynamics::SetStatic(const std::vector<Cuboid>& cuboids) {
+    for (int proxy : staticProxies) {
+        tree.DestroyProxy(proxy);
+    }
+    staticProxies.clear();
+
+    statics = &cuboids;
+    for (size_t i = 0; i < cuboids.size(); i++) {
+        unsigned int userData = static_cast<unsigned int>(i) | STATIC_BODY;
+        staticProxies.push_back(tree.CreateProxy(cuboids[i].getBounds(), userData));
+    }
+}
+
+void CuboidDynamics::UpdateProxies(const std::vector<Cuboid>& crates, float deltaTime) {
+    while (crateProxies.size() > crates.size()) {
+        tree.DestroyProxy(crateProxies.back());
+        crateProxies.pop_back();
+    }
+    for (size_t i = 0; i < crates.size(); i++) {
+        AABB box = crates[i].getBounds();
+        if (i < crateProxies.size()) {
+            // The displacement over the coming step stretches the fat box ahead of the crate.
+            tree.MoveProxy(crateProxies[i], box, crates[i].getVelocity() * deltaTime);
+        }
+        else {
+            crateProxies.push_back(tree.CreateProxy(box, static_cast<unsigned int>(i)));
+        }
+    }
+}
+
+void CuboidDynamics::FindPairs(const std::vector<Cuboid>& crates) {
+    // Fat boxes against fat boxes: the candidate set only changes when a proxy is
+    // reinserted, so pairs persist and keep their cached axis.
+    pairs.clear();
+    for (size_t s = 0; s < crates.size(); s++) {
+        unsigned int i = static_cast<unsigned int>(s);
+        tree.Query(tree.getFatAABB(crateProxies[i]), [&](int proxyId) {
+            unsigned int other = tree.getUserData(proxyId);
+            if (other & STATIC_BODY) pairs.push_back({ i, other });
+            else if (other > i) pairs.push_back({ i, other });
+        });
+    }
+}
+
+void CuboidDynamics::PrepareContact(Contact& c, const Cuboid& a, const Cuboid* b, const glm::mat3& invIA,
+    const glm::mat3& invIB, const glm::vec3& point, float deltaTime) {
+    glm::vec3 rA = point - a.getPosition();
+    glm::vec3 rB = b ? point - b->getPosition() : glm::vec3(0.0f);
+    c.directions[1] = AnyPerpendicular(c.directions[0]);
+    c.directions[2] = glm::cross(c.directions[0], c.directions[1]);
+
+    c.invMassA = a.getInvMass();
+    c.invMassB = b ? b->getInvMass() : 0.0f;
+    for (int d = 0; d < 3; d++) {
+        c.crossA[d] = glm::cross(rA, c.directions[d]);
+        c.crossB[d] = glm::cross(rB, c.directions[d]);
+        c.angularA[d] = invIA * c.crossA[d];
+        c.angularB[d] = invIB * c.crossB[d];
+        float k = c.invMassA + c.invMassB + glm::dot(c.crossA[d], c.angularA[d]) + glm::dot(c.crossB[d], c.angularB[d]);
+        c.mass[d] = k > 0.0f ? 1.0f / k : 0.0f;
+    }
+
+    glm::vec3 vb = b ? b->getPointVelocity(point) : glm::vec3(0.0f);
+    float approach = glm::dot(vb - a.getPointVelocity(point), c.directions[0]);
+    // A point still apart may close its gap this step but no more.
+    if (c.depth < 0.0f) c.bias = c.depth / deltaTime;
+    else c.bias = (BAUMGARTE / deltaTime) * std::max(c.depth - PENETRATION_SLOP, 0.0f);
+    if (approach < -RESTITUTION_THRESHOLD) c.bias = std::max(c.bias, -restitution * approach);
+}
+
+void CuboidDynamics::Collide(const std::vector<Cuboid>& crates, float deltaTime) {
+    unsigned int threadCount = NumWorkerThreads();
+    threadManifolds.resize(threadCount);
+    threadEntries.resize(threadCount);
+    threadContacts.resize(threadCount);
+    threadAxisHits.assign(threadCount, 0);
+    threadWarmStarts.assign(threadCount, 0);
+    previousManifolds.swap(manifolds);
+
+    // Every pair owns its cache entry, so the pairs run in parallel.
+    ParallelForRange(pairs.size(), [&](size_t left, size_t right, unsigned int batch) {
+        std::vector<ContactManifold>& outManifolds = threadManifolds[batch];
+        std::vector<PairCacheEntry*>& outEntries = threadEntries[batch];
+        std::vector<Contact>& out = threadContacts[batch];
+        outManifolds.clear();
+        outEntries.clear();
+        out.clear();
+        for (size_t k = left; k < right; k++) {
+            const CollisionPair& pair = pairs[k];
+            const Cuboid& a = crates[pair.a];
+            bool isStatic = (pair.b & STATIC_BODY) != 0;
+            const Cuboid* b = isStatic ? nullptr : &crates[pair.b];
+            const CuboidCollider& colliderB = isStatic ? (*statics)[pair.b & ~STATIC_BODY].getCollider() :
+                b->getCollider();
+
+            // A new pair has userData 0: no cached axis and no previous manifold.
+            PairCacheEntry* entry = pairCache.Find(pair.a, pair.b);
+            int axis = static_cast<int>(entry->userData & AXIS_MASK) - 1;
+            unsigned int previous = entry->userData >> AXIS_BITS;
+            BoxManifold boxManifold;
+            BoxOverlap result = CollideBoxes(a.getCollider(), colliderB, axis, boxManifold);
+            entry->userData = static_cast<unsigned int>(axis + 1);
+            if (result != BoxOverlap::Touching) {
+                if (result == BoxOverlap::SeparatedByCache) threadAxisHits[batch]++;
+                continue;
+            }
+
+            // At most four points spanning the contact, whatever the clipping produced.
+            glm::vec3 positions[BoxManifold::MAX_POINTS];
+            float depths[BoxManifold::MAX_POINTS];
+            for (int p = 0; p < boxManifold.pointCount; p++) {
+                positions[p] = boxManifold.points[p].position;
+                depths[p] = boxManifold.points[p].depth;
+            }
+            int keep[ContactManifold::MAX_POINTS];
+            ContactManifold manifold;
+            manifold.normal = boxManifold.normal;
+            manifold.pointCount = ReduceContactPoints(positions, depths, boxManifold.pointCount, boxManifold.normal, keep);
+            glm::mat3 toLocalA = glm::transpose(a.getCollider().rotation);
+            for (int p = 0; p < manifold.pointCount; p++) {
+                const BoxContactPoint& point = boxManifold.points[keep[p]];
+                manifold.points[p].position = point.position;
+                manifold.points[p].localPoint = toLocalA * (point.position - a.getPosition());
+                manifold.points[p].depth = point.depth;
+                manifold.points[p].feature = point.feature;
+            }
+            bool persisting = previous > 0 && previous <= previousManifolds.size();
+            threadWarmStarts[batch] += WarmStartManifold(manifold, persisting ? &previousManifolds[previous - 1] : nullptr);
+
+            glm::mat3 invIA = a.getInvInertia();
+            glm::mat3 invIB = b ? b->getInvInertia() : glm::mat3(0.0f);
+            for (int p = 0; p < manifold.pointCount; p++) {
+                Contact contact;
+                contact.a = pair.a;
+                contact.b = pair.b;
+                contact.solverB = isStatic ? static_cast<unsigned int>(crates.size()) : pair.b;
+                contact.directions[0] = manifold.normal;
+                contact.depth = manifold.points[p].depth;
+                PrepareContact(contact, a, b, invIA, invIB, manifold.points[p].position, deltaTime);
+                for (int d = 0; d < 3; d++) contact.impulse[d] = manifold.points[p].impulse[d];
+                out.push_back(contact);
+            }
+            outManifolds.push_back(manifold);
+            outEntries.push_back(entry);
+        }
+    }, 64);
+
+    // Joined in batch order, so the contacts follow their manifolds; each manifold's
+    // index goes back into its pair's cache entry for the next step.
+    manifolds.clear();
+    contacts.clear();
+    cachedAxisHits = 0;
+    warmStarts = 0;
+    for (unsigned int t = 0; t < threadCount; t++) {
+        for (size_t m = 0; m < threadManifolds[t].size(); m++) {
+            threadEntries[t][m]->userData |= static_cast<unsigned int>(manifolds.size() + 1) << AXIS_BITS;
+            manifolds.push_back(threadManifolds[t][m]);
+        }
+        contacts.insert(contacts.end(), threadContacts[t].begin(), threadContacts[t].end());
+        cachedAxisHits += threadAxisHits[t];
+        warmStarts += threadWarmStarts[t];
+    }
+}
+
+void CuboidDynamics::ColorManifolds(size_t crateCount) {
+    manifoldFirst.resize(manifolds.size() + 1);
+    manifoldFirst[0] = 0;
+    for (size_t m = 0; m < manifolds.size(); m++) {
+        manifoldFirst[m + 1] = manifoldFirst[m] + static_cast<unsigned int>(manifolds[m].pointCount);
+    }
+
+    // Greedy: each manifold takes the first colour neither of its crates is in yet.
+    // The static bodies' shared slot never changes, so it does not constrain.
+    crateColors.assign(crateCount, 0);
+    std::vector<unsigned int> color(manifolds.size());
+    unsigned int colorCount = 0;
+    for (size_t m = 0; m < manifolds.size(); m++) {
+        const Contact& c = contacts[manifoldFirst[m]];
+        bool isStatic = (c.b & STATIC_BODY) != 0;
+        unsigned long long used = crateColors[c.a] | (isStatic ? 0ull : crateColors[c.b]);
+        unsigned int k = 0;
+        while (k < SERIAL_COLOR && (used >> k) & 1ull) k++;
+        color[m] = k;
+        crateColors[c.a] |= 1ull << k;
+        if (!isStatic) crateColors[c.b] |= 1ull << k;
+        colorCount = std::max(colorCount, k + 1);
+    }
+
+    // Counting sort by colour, keeping the manifold order within a colour.
+    colorStart.assign(colorCount + 1, 0);
+    for (unsigned int k : color) colorStart[k + 1]++;
+    for (unsigned int k = 0; k < colorCount; k++) colorStart[k + 1] += colorStart[k];
+    colorManifolds.resize(manifolds.size());
+    std::vector<unsigned int> next(colorStart.begin(), colorStart.end() - 1);
+    for (size_t m = 0; m < manifolds.size(); m++) colorManifolds[next[color[m]]++] = static_cast<unsigned int>(m);
+}
+
+void CuboidDynamics::SolveManifold(unsigned int manifold, bool forward) {
+    // The static bodies' slot is never written: several threads may hold contacts on it.
+    auto apply = [&](const Contact& c, int d, float lambda) {
+        velocities[c.a] -= (c.invMassA * lambda) * c.directions[d];
+        angularVelocities[c.a] -= lambda * c.angularA[d];
+        if (c.b & STATIC_BODY) return;
+        velocities[c.solverB] += (c.invMassB * lambda) * c.directions[d];
+        angularVelocities[c.solverB] += lambda * c.angularB[d];
+    };
+    auto relativeVelocity = [&](const Contact& c, int d) {
+        return glm::dot(velocities[c.solverB] - velocities[c.a], c.directions[d]) +
+            glm::dot(angularVelocities[c.solverB], c.crossB[d]) - glm::dot(angularVelocities[c.a], c.crossA[d]);
+    };
+
+    unsigned int first = manifoldFirst[manifold];
+    unsigned int count = manifoldFirst[manifold + 1] - first;
+    for (unsigned int k = 0; k < count; k++) {
+        Contact& c = contacts[first + (forward ? k : count - 1 - k)];
+
+        // Friction, bounded by the normal impulse accumulated so far.
+        float maxFriction = friction * c.impulse[0];
+        for (int d = 1; d < 3; d++) {
+            float lambda = -relativeVelocity(c, d) * c.mass[d];
+            float accumulated = glm::clamp(c.impulse[d] + lambda, -maxFriction, maxFriction);
+            apply(c, d, accumulated - c.impulse[d]);
+            c.impulse[d] = accumulated;
+        }
+
+        // Normal: push apart until the approach speed reaches the bias.
+        float lambda = (c.bias - relativeVelocity(c, 0)) * c.mass[0];
+        float accumulated = std::max(c.impulse[0] + lambda, 0.0f);
+        apply(c, 0, accumulated - c.impulse[0]);
+        c.impulse[0] = accumulated;
+    }
+}
+
+void CuboidDynamics::Solve() {
+    // Warm start: the impulses carried over from the last step are applied up front.
+    for (const Contact& c : contacts) {
+        for (int d = 0; d < 3; d++) {
+            velocities[c.a] -= (c.invMassA * c.impulse[d]) * c.directions[d];
+            angularVelocities[c.a] -= c.impulse[d] * c.angularA[d];
+            velocities[c.solverB] += (c.invMassB * c.impulse[d]) * c.directions[d];
+            angularVelocities[c.solverB] += c.impulse[d] * c.angularB[d];
+        }
+    }
+
+    // Manifolds of a colour share no crate, so they run in parallel; the colours
+    // run one after another. The sweep alternates direction, so no contact always
+    // goes first.
+    size_t colorCount = getColorCount();
+    for (int iteration = 0; iteration < solverIterations; iteration++) {
+        bool forward = (iteration % 2) == 0;
+        for (size_t k = 0; k < colorCount; k++) {
+            size_t color = forward ? k : colorCount - 1 - k;
+            const unsigned int* members = colorManifolds.data() + colorStart[color];
+            size_t count = colorStart[color + 1] - colorStart[color];
+            if (color == SERIAL_COLOR) {
+                for (size_t m = 0; m < count; m++) SolveManifold(members[forward ? m : count - 1 - m], forward);
+                continue;
+            }
+            ParallelForRange(count, [&](size_t left, size_t right, unsigned int) {
+                for (size_t m = left; m < right; m++) SolveManifold(members[forward ? m : count - 1 - m], forward);
+            }, MIN_SOLVE_BATCH);
+        }
+    }
+
+    // The accumulated impulses go back to the manifold points, for next step's warm start.
+    size_t next = 0;
+    for (ContactManifold& manifold : manifolds) {
+        for (int p = 0; p < manifold.pointCount; p++, next++) {
+            for (int d = 0; d < 3; d++) manifold.points[p].impulse[d] = contacts[next].impulse[d];
+        }
+    }
+}
+
+void CuboidDynamics::Step(std::vector<Cuboid>& crates, float deltaTime, const glm::vec3& gravity) {
+    if (crates.empty() || deltaTime <= 0.0f) return;
+
+    UpdateProxies(crates, deltaTime);
+    FindPairs(crates);
+    pairCache.Update(pairs);
+    Collide(crates, deltaTime);
+
+    // One slot per crate plus a last one shared by the static bodies. Their contacts
+    // have no inverse mass or inertia on that side, so it stays at rest.
+    size_t count = crates.size();
+    velocities.resize(count + 1);
+    angularVelocities.resize(count + 1);
+    for (size_t i = 0; i < count; i++) {
+        const Cuboid& crate = crates[i];
+        velocities[i] = crate.getVelocity() + (crate.isDynamic() ? gravity * deltaTime : glm::vec3(0.0f));
+        angularVelocities[i] = crate.getAngularVelocity();
+    }
+    velocities[count] = angularVelocities[count] = glm::vec3(0.0f);
+
+    ColorManifolds(count);
+    Solve();
+
+    for (size_t i = 0; i < count; i++) {
+        Cuboid& crate = crates[i];
+        if (!crate.isDynamic()) continue;
+        crate.setVelocity(velocities[i]);
+        crate.setAngularVelocity(angularVelocities[i]);
+        crate.Update(deltaTime, glm::vec3(0.0f));
+    }
+}
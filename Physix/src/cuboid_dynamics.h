@@ -0,0 +1,109 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "aabb_tree.h"
+#include "box_collision.h"
+#include "contact_manifold.h"
+#include "cuboid.h"
+#include "pair_cache.h"
+
+// Rigid-body step for dynamic Cuboids (crates) against each other and the static Cuboids.
+// Candidate pairs come from a dynamic AABB tree holding every crate and static Cuboid.
+// They are tracked in a PairCache whose userData keeps each pair's last separating
+// axis, so pairs whose fat boxes overlap but that stay apart early-out after one axis
+// test. A touching pair's box manifold is reduced to a ContactManifold of at most
+// four points, kept across steps, and resolved with sequential impulses (normal with
+// restitution and a Baumgarte bias, plus Coulomb friction). Points are matched to the
+// pair's points of the last step by feature ID and start from their accumulated
+// impulses (warm starting), which is what keeps stacks standing. The manifolds are
+// greedily coloured so that no two of a colour share a crate; the colours are
+// solved one after another, the manifolds of a colour in parallel.
+class CuboidDynamics {
+public:
+    // Pair user data: the static Cuboid index, with the top bit set.
+    static const unsigned int STATIC_BODY = 0x80000000u;
+
+    CuboidDynamics(int solverIterations = 10, float friction = 0.5f, float restitution = 0.2f);
+
+    // Registers the static Cuboids once; they must outlive the solver.
+    void SetStatic(const std::vector<Cuboid>& cuboids);
+
+    // Advances the crates by deltaTime. Crates are only ever appended, so a crate
+    // keeps its index (and its cached pairs) between steps.
+    void Step(std::vector<Cuboid>& crates, float deltaTime, const glm::vec3& gravity);
+
+    // Statistics of the last Step().
+    size_t getPairCount() const { return pairs.size(); }
+    size_t getManifoldCount() const { return manifolds.size(); }
+    size_t getContactCount() const { return contacts.size(); }
+    // Contact points that started from last step's impulses.
+    size_t getWarmStartCount() const { return warmStarts; }
+    // Pairs rejected by their cached separating axis alone.
+    size_t getCachedAxisHits() const { return cachedAxisHits; }
+    size_t getColorCount() const { return colorStart.empty() ? 0 : colorStart.size() - 1; }
+
+private:
+    // Direction 0 is the normal (from a towards b), 1 and 2 the friction tangents.
+    // The Jacobian terms of each direction are precomputed, so an iteration is a few
+    // dot products per contact.
+    struct Contact {
+        unsigned int a;
+        unsigned int b;                // crate index, or static index | STATIC_BODY
+        unsigned int solverB;          // b's solver slot; statics share an empty one
+        glm::vec3 directions[3];
+        glm::vec3 crossA[3];           // rA x direction
+        glm::vec3 crossB[3];
+        glm::vec3 angularA[3];         // inverse inertia * (r x direction)
+        glm::vec3 angularB[3];
+        float mass[3];                 // effective mass along each direction
+        float impulse[3];              // accumulated
+        float invMassA;
+        float invMassB;
+        float depth;
+        float bias;
+    };
+
+    int solverIterations;
+    float friction;
+    float restitution;
+
+    AABBTree tree;
+    std::vector<int> crateProxies;
+    std::vector<int> staticProxies;
+    const std::vector<Cuboid>* statics;
+
+    std::vector<CollisionPair> pairs;
+    PairCache pairCache;
+    // One manifold per touching pair, with its cache entry; the pair's contacts
+    // follow the same order, one per manifold point.
+    std::vector<std::vector<ContactManifold>> threadManifolds;
+    std::vector<std::vector<PairCacheEntry*>> threadEntries;
+    std::vector<std::vector<Contact>> threadContacts;
+    std::vector<ContactManifold> manifolds;
+    std::vector<ContactManifold> previousManifolds;
+    std::vector<Contact> contacts;
+    std::vector<size_t> threadAxisHits;
+    std::vector<size_t> threadWarmStarts;
+    size_t cachedAxisHits;
+    size_t warmStarts;
+
+    // Solver state per crate.
+    std::vector<glm::vec3> velocities;
+    std::vector<glm::vec3> angularVelocities;
+
+    // Solver colours: the manifolds of colour c are colorManifolds[colorStart[c]]
+    // up to colorStart[c + 1]. Manifold m's contacts start at manifoldFirst[m].
+    std::vector<unsigned int> manifoldFirst;
+    std::vector<unsigned long long> crateColors;   // per crate, a bit per colour it is in
+    std::vector<unsigned int> colorStart;
+    std::vector<unsigned int> colorManifolds;
+
+    void UpdateProxies(const std::vector<Cuboid>& crates, float deltaTime);
+    void FindPairs(const std::vector<Cuboid>& crates);
+    void Collide(const std::vector<Cuboid>& crates, float deltaTime);
+    void PrepareContact(Contact& contact, const Cuboid& a, const Cuboid* b, const glm::mat3& invIA,
+        const glm::mat3& invIB, const glm::vec3& point, float deltaTime);
+    void ColorManifolds(size_t crateCount);
+    void SolveManifold(unsigned int manifold, bool forward);
+    void Solve();
+};
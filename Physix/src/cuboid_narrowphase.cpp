@@ -0,0 +1,179 @@
+#include "cuboid_narrowphase.h"
+#include "parallel.h"
+#include <cmath>
+#include <emmintrin.h>
+
+namespace {
+    // Perfectly elastic, and pushed a little past the surface so thin walls are not
+    // tunnelled on the next substep.
+    const float RESTITUTION = 1.0f;
+    const float SEPARATION = 0.5f;
+
+    inline __m128 Select(__m128 mask, __m128 a, __m128 b) {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    inline __m128 Abs(__m128 a) {
+        return _mm_andnot_ps(_mm_set1_ps(-0.0f), a);
+    }
+
+    inline __m128 Clamp(__m128 a, __m128 h) {
+        return _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), h), _mm_min_ps(a, h));
+    }
+}
+
+void ResolveCuboidCollision(Sphere& sphere, const CuboidCollider& collider) {
+    float r = sphere.mesh->getRadius();
+    const glm::vec3& h = collider.halfExtents;
+    glm::vec3 local = glm::vec3(collider.inverse * glm::vec4(sphere.position, 1.0f));
+    glm::vec3 offset = local - glm::clamp(local, -h, h);
+    float dist2 = glm::dot(offset, offset);
+    if (dist2 >= r * r) return;
+
+    glm::vec3 localNormal(0.0f);
+    float penetration;
+    if (dist2 > 0.0f) {
+        float dist = std::sqrt(dist2);
+        localNormal = offset / dist;
+        penetration = r - dist;
+    }
+    else {
+        glm::vec3 depth = h - glm::abs(local);
+        int axis = (depth.x <= depth.y && depth.x <= depth.z) ? 0 : (depth.y <= depth.z ? 1 : 2);
+        localNormal[axis] = local[axis] < 0.0f ? -1.0f : 1.0f;
+        penetration = r + depth[axis];
+    }
+
+    glm::vec3 normal = collider.rotation * localNormal;
+    sphere.position += (penetration + SEPARATION) * normal;
+    float velAlongNormal = glm::dot(sphere.velocity, normal);
+    if (velAlongNormal < 0.0f) sphere.velocity -= (1.0f + RESTITUTION) * velAlongNormal * normal;
+}
+
+void ResolveCuboidCollision4(Sphere* const spheres[4], const CuboidCollider& collider) {
+    alignas(16) float px[4], py[4], pz[4], vx[4], vy[4], vz[4], radius[4];
+    for (int k = 0; k < 4; k++) {
+        // Empty lanes sit at the center with no radius and are masked off below.
+        const Sphere* s = spheres[k];
+        glm::vec3 p = s ? s->position : collider.center;
+        glm::vec3 v = s ? s->velocity : glm::vec3(0.0f);
+        px[k] = p.x; py[k] = p.y; pz[k] = p.z;
+        vx[k] = v.x; vy[k] = v.y; vz[k] = v.z;
+        radius[k] = s ? s->mesh->getRadius() : 0.0f;
+    }
+    __m128 valid = _mm_castsi128_ps(_mm_set_epi32(spheres[3] ? -1 : 0, spheres[2] ? -1 : 0,
+        spheres[1] ? -1 : 0, spheres[0] ? -1 : 0));
+
+    const glm::mat3& R = collider.rotation;
+    const glm::vec3& c = collider.center;
+    __m128 rx = _mm_sub_ps(_mm_load_ps(px), _mm_set1_ps(c.x));
+    __m128 ry = _mm_sub_ps(_mm_load_ps(py), _mm_set1_ps(c.y));
+    __m128 rz = _mm_sub_ps(_mm_load_ps(pz), _mm_set1_ps(c.z));
+
+    // Box frame: the rotation is orthonormal, so local[i] = dot(axis i, p - center).
+    __m128 local[3], offset[3];
+    __m128 dist2 = _mm_setzero_ps();
+    for (int i = 0; i < 3; i++) {
+        local[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, _mm_set1_ps(R[i].x)), _mm_mul_ps(ry, _mm_set1_ps(R[i].y))),
+            _mm_mul_ps(rz, _mm_set1_ps(R[i].z)));
+        offset[i] = _mm_sub_ps(local[i], Clamp(local[i], _mm_set1_ps(collider.halfExtents[i])));
+        dist2 = _mm_add_ps(dist2, _mm_mul_ps(offset[i], offset[i]));
+    }
+
+    __m128 r = _mm_load_ps(radius);
+    __m128 collide = _mm_and_ps(valid, _mm_cmplt_ps(dist2, _mm_mul_ps(r, r)));
+    if (_mm_movemask_ps(collide) == 0) return;
+
+    // Outside: along the offset to the closest point.
+    __m128 outside = _mm_cmpgt_ps(dist2, _mm_setzero_ps());
+    __m128 dist = _mm_sqrt_ps(dist2);
+    __m128 invDist = Select(outside, _mm_div_ps(_mm_set1_ps(1.0f), dist), _mm_setzero_ps());
+    __m128 penetration = _mm_sub_ps(r, dist);
+
+    // Inside: out through the face with the least depth.
+    __m128 depth[3];
+    for (int i = 0; i < 3; i++) depth[i] = _mm_sub_ps(_mm_set1_ps(collider.halfExtents[i]), Abs(local[i]));
+    __m128 pickX = _mm_and_ps(_mm_cmple_ps(depth[0], depth[1]), _mm_cmple_ps(depth[0], depth[2]));
+    __m128 pickY = _mm_andnot_ps(pickX, _mm_cmple_ps(depth[1], depth[2]));
+    __m128 pickZ = _mm_andnot_ps(_mm_or_ps(pickX, pickY), valid);
+    __m128 pick[3] = { pickX, pickY, pickZ };
+    __m128 signBit = _mm_set1_ps(-0.0f);
+
+    __m128 n[3];
+    __m128 insideDepth = _mm_setzero_ps();
+    for (int i = 0; i < 3; i++) {
+        __m128 face = _mm_and_ps(pick[i], _mm_or_ps(_mm_set1_ps(1.0f), _mm_and_ps(signBit, local[i])));
+        n[i] = Select(outside, _mm_mul_ps(offset[i], invDist), face);
+        insideDepth = _mm_or_ps(insideDepth, _mm_and_ps(pick[i], depth[i]));
+    }
+    penetration = Select(outside, penetration, _mm_add_ps(r, insideDepth));
+    __m128 push = _mm_and_ps(collide, _mm_add_ps(penetration, _mm_set1_ps(SEPARATION)));
+
+    // Back to world space.
+    __m128 wx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[0], _mm_set1_ps(R[0].x)), _mm_mul_ps(n[1], _mm_set1_ps(R[1].x))),
+        _mm_mul_ps(n[2], _mm_set1_ps(R[2].x)));
+    __m128 wy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[0], _mm_set1_ps(R[0].y)), _mm_mul_ps(n[1], _mm_set1_ps(R[1].y))),
+        _mm_mul_ps(n[2], _mm_set1_ps(R[2].y)));
+    __m128 wz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[0], _mm_set1_ps(R[0].z)), _mm_mul_ps(n[1], _mm_set1_ps(R[1].z))),
+        _mm_mul_ps(n[2], _mm_set1_ps(R[2].z)));
+
+    __m128 velX = _mm_load_ps(vx), velY = _mm_load_ps(vy), velZ = _mm_load_ps(vz);
+    __m128 velAlongNormal = _mm_add_ps(_mm_add_ps(_mm_mul_ps(velX, wx), _mm_mul_ps(velY, wy)), _mm_mul_ps(velZ, wz));
+    __m128 approaching = _mm_and_ps(collide, _mm_cmplt_ps(velAlongNormal, _mm_setzero_ps()));
+    __m128 j = _mm_and_ps(approaching, _mm_mul_ps(_mm_set1_ps(1.0f + RESTITUTION), velAlongNormal));
+
+    _mm_store_ps(px, _mm_add_ps(_mm_load_ps(px), _mm_mul_ps(push, wx)));
+    _mm_store_ps(py, _mm_add_ps(_mm_load_ps(py), _mm_mul_ps(push, wy)));
+    _mm_store_ps(pz, _mm_add_ps(_mm_load_ps(pz), _mm_mul_ps(push, wz)));
+    _mm_store_ps(vx, _mm_sub_ps(velX, _mm_mul_ps(j, wx)));
+    _mm_store_ps(vy, _mm_sub_ps(velY, _mm_mul_ps(j, wy)));
+    _mm_store_ps(vz, _mm_sub_ps(velZ, _mm_mul_ps(j, wz)));
+
+    int hits = _mm_movemask_ps(collide);
+    for (int k = 0; k < 4; k++) {
+        if (!(hits & (1 << k))) continue;
+        spheres[k]->position = glm::vec3(px[k], py[k], pz[k]);
+        spheres[k]->velocity = glm::vec3(vx[k], vy[k], vz[k]);
+    }
+}
+
+CuboidNarrowphase::CuboidNarrowphase()
+    : threadContacts(NumWorkerThreads()), threadOffsets(NumWorkerThreads()), threadSpheres(NumWorkerThreads()) {
+}
+
+void CuboidNarrowphase::ResolveRange(std::vector<Sphere>& spheres, size_t left, size_t right, unsigned int batch,
+    const std::vector<Cuboid>& cuboids, const StaticBVH& staticWorld, unsigned int firstCuboid) {
+    std::vector<Contact>& contacts = threadContacts[batch];
+    std::vector<unsigned int>& offsets = threadOffsets[batch];
+    std::vector<unsigned int>& grouped = threadSpheres[batch];
+
+    contacts.clear();
+    offsets.assign(cuboids.size() + 1, 0);
+    for (size_t i = left; i < right; i++) {
+        const Sphere& sphere = spheres[i];
+        staticWorld.Query(AABB::FromSphere(sphere.position, sphere.mesh->getRadius()), [&](unsigned int cuboid) {
+            if (cuboid < firstCuboid) return;
+            contacts.push_back({ cuboid, static_cast<unsigned int>(i) });
+            offsets[cuboid + 1]++;
+        });
+    }
+    if (contacts.empty()) return;
+
+    // Counting sort by Cuboid; spheres stay in index order within a Cuboid.
+    for (size_t c = 0; c < cuboids.size(); c++) offsets[c + 1] += offsets[c];
+    grouped.resize(contacts.size());
+    for (const Contact& contact : contacts) grouped[offsets[contact.cuboid]++] = contact.sphere;
+
+    // Each offset now points at the end of its run.
+    unsigned int start = 0;
+    for (size_t c = 0; c < cuboids.size(); c++) {
+        unsigned int end = offsets[c];
+        const CuboidCollider& collider = cuboids[c].getCollider();
+        for (; start < end; start += 4) {
+            Sphere* lanes[4];
+            for (unsigned int k = 0; k < 4; k++) lanes[k] = start + k < end ? &spheres[grouped[start + k]] : nullptr;
+            ResolveCuboidCollision4(lanes, collider);
+        }
+        start = end;
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+#include "cuboid.h"
+#include "sphere.h"
+#include "static_bvh.h"
+
+// Sphere against Cuboid through the cached CuboidCollider: the closest point on the
+// box to the sphere's center, found in the box frame. A touching sphere is pushed out
+// along the normal at that point and reflected if it is moving into the box. A center
+// inside the box leaves through the nearest face.
+void ResolveCuboidCollision(Sphere& sphere, const CuboidCollider& collider);
+
+// The same test for up to four spheres at once in SSE lanes; null entries are skipped.
+// No sphere may appear twice.
+void ResolveCuboidCollision4(Sphere* const spheres[4], const CuboidCollider& collider);
+
+// Spheres against the static Cuboids, several spheres per Cuboid at a time.
+// Each worker batch of spheres collects its (Cuboid, sphere) contacts from the
+// StaticBVH into its own buffers and counting-sorts them by Cuboid, so the spheres
+// near one Cuboid go through ResolveCuboidCollision4 together. Every sphere meets
+// its Cuboids in index order. Cuboids below 'firstCuboid' are left to the caller,
+// e.g. walls that a ContainerCollider already handles.
+class CuboidNarrowphase {
+public:
+    CuboidNarrowphase();
+
+    // spheres[left, right) as batch 'batch' of a ParallelForRange.
+    void ResolveRange(std::vector<Sphere>& spheres, size_t left, size_t right, unsigned int batch,
+        const std::vector<Cuboid>& cuboids, const StaticBVH& staticWorld, unsigned int firstCuboid = 0);
+
+private:
+    struct Contact {
+        unsigned int cuboid;
+        unsigned int sphere;
+    };
+
+    // Per worker batch: contacts in query order, the start of each Cuboid's run, and
+    // the sphere indices grouped by Cuboid.
+    std::vector<std::vector<Contact>> threadContacts;
+    std::vector<std::vector<unsigned int>> threadOffsets;
+    std::vector<std::vector<unsigned int>> threadSpheres;
+};
@@ -0,0 +1,293 @@
+#include "distance_field.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+namespace {
+    // Same response as the walls: perfectly elastic.
+    const float RESTITUTION = 1.0f;
+    const char FILE_MAGIC[4] = { 'P', 'X', 'D', 'F' };
+    const unsigned int FILE_VERSION = 1;
+    // Largest brick grid a file may describe: 64 MB of entries.
+    const unsigned long long MAX_GRID_CELLS = 1ull << 24;
+
+    // Exact signed distance to a Cuboid: positive outside, negative inside.
+    float CuboidDistance(const CuboidCollider& collider, const glm::vec3& p) {
+        // The rotation is orthonormal, so its transpose takes world vectors into the box frame.
+        glm::vec3 local = glm::transpose(collider.rotation) * (p - collider.center);
+        glm::vec3 q = glm::abs(local) - collider.halfExtents;
+        float outside = glm::length(glm::max(q, glm::vec3(0.0f)));
+        float inside = std::min(std::max(q.x, std::max(q.y, q.z)), 0.0f);
+        return outside + inside;
+    }
+
+    // 64-bit FNV-1a.
+    void Hash(unsigned long long& hash, const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    }
+}
+
+SignedDistanceField::SignedDistanceField()
+    : region{ glm::vec3(0.0f), glm::vec3(0.0f) }, voxelSize(1.0f), band(1.0f), dims{ 0, 0, 0 }, key(0) {
+}
+
+void SignedDistanceField::Bake(const std::vector<Cuboid>& cuboids, const StaticBVH& staticWorld,
+    const TriangleMesh* mesh, const AABB& newRegion, float newVoxelSize, float newBand) {
+    region = newRegion;
+    voxelSize = newVoxelSize;
+    band = newBand;
+    key = InputKey(cuboids, mesh, region, voxelSize, band);
+    float brickSize = BRICK_VOXELS * voxelSize;
+    for (int i = 0; i < 3; i++) {
+        dims[i] = std::max(1u, static_cast<unsigned int>(std::ceil((region.max[i] - region.min[i]) / brickSize)));
+    }
+    size_t brickSlots = size_t(dims[0]) * dims[1] * dims[2];
+    grid.assign(brickSlots, static_cast<unsigned int>(EMPTY_OUTSIDE));
+    bricks.clear();
+
+    // Bricks are independent; each thread keeps the ones it fills with their slots,
+    // and they are appended in batch order so a bake is reproducible.
+    std::vector<std::vector<std::pair<size_t, DistanceBrick>>> threadBricks(NumWorkerThreads());
+    ParallelForRange(brickSlots, [&](size_t left, size_t right, unsigned int batch) {
+        std::vector<unsigned int> nearCuboids;
+        std::vector<std::pair<const TrianglePacket*, unsigned int>> nearPackets;
+        float distances[BRICK_SAMPLES * BRICK_SAMPLES * BRICK_SAMPLES];
+
+        for (size_t slot = left; slot < right; slot++) {
+            unsigned int bx = static_cast<unsigned int>(slot % dims[0]);
+            unsigned int by = static_cast<unsigned int>((slot / dims[0]) % dims[1]);
+            unsigned int bz = static_cast<unsigned int>(slot / (size_t(dims[0]) * dims[1]));
+            glm::vec3 corner = region.min + glm::vec3(bx, by, bz) * brickSize;
+            AABB reach = { corner - band, corner + brickSize + band };
+
+            // Without geometry within the band the brick is empty space: a brick deep
+            // inside a Cuboid still overlaps its bounds.
+            nearCuboids.clear();
+            nearPackets.clear();
+            staticWorld.Query(reach, [&](unsigned int index) { nearCuboids.push_back(index); });
+            if (mesh) {
+                mesh->Query(reach, [&](const TrianglePacket& packet, unsigned int count) {
+                    nearPackets.push_back({ &packet, count });
+                });
+            }
+            if (nearCuboids.empty() && nearPackets.empty()) continue;
+
+            bool anyNear = false, anyInside = false;
+            for (int z = 0, k = 0; z < BRICK_SAMPLES; z++) {
+                for (int y = 0; y < BRICK_SAMPLES; y++) {
+                    for (int x = 0; x < BRICK_SAMPLES; x++, k++) {
+                        glm::vec3 p = corner + glm::vec3(x, y, z) * voxelSize;
+                        float d = band;
+                        for (unsigned int index : nearCuboids) d = std::min(d, CuboidDistance(cuboids[index].getCollider(), p));
+                        for (const auto& candidate : nearPackets) {
+                            const TrianglePacket& packet = *candidate.first;
+                            for (unsigned int lane = 0; lane < candidate.second; lane++) {
+                                glm::vec3 a(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+                                glm::vec3 b = a + glm::vec3(packet.edge1[0][lane], packet.edge1[1][lane], packet.edge1[2][lane]);
+                                glm::vec3 c = a + glm::vec3(packet.edge2[0][lane], packet.edge2[1][lane], packet.edge2[2][lane]);
+                                d = std::min(d, glm::length(p - ClosestPointOnTriangle(p, a, b, c)));
+                            }
+                        }
+                        distances[k] = d;
+                        anyNear = anyNear || std::fabs(d) < band;
+                        anyInside = anyInside || d < 0.0f;
+                    }
+                }
+            }
+            if (!anyNear) {
+                if (anyInside) grid[slot] = EMPTY_INSIDE;
+                continue;
+            }
+
+            threadBricks[batch].emplace_back();
+            threadBricks[batch].back().first = slot;
+            DistanceBrick& brick = threadBricks[batch].back().second;
+            for (int k = 0; k < BRICK_SAMPLES * BRICK_SAMPLES * BRICK_SAMPLES; k++) {
+                float q = std::round(std::max(-1.0f, std::min(1.0f, distances[k] / band)) * 127.0f);
+                brick.samples[k] = static_cast<signed char>(q);
+            }
+        }
+    }, 16);
+
+    for (auto& filled : threadBricks) {
+        for (auto& entry : filled) {
+            grid[entry.first] = static_cast<unsigned int>(bricks.size());
+            bricks.push_back(entry.second);
+        }
+    }
+    bricks.shrink_to_fit();
+}
+
+unsigned long long SignedDistanceField::InputKey(const std::vector<Cuboid>& cuboids, const TriangleMesh* mesh,
+    const AABB& region, float voxelSize, float band) {
+    unsigned long long hash = 14695981039346656037ull;
+    Hash(hash, &FILE_VERSION, sizeof(FILE_VERSION));
+    for (const Cuboid& cuboid : cuboids) {
+        const CuboidCollider& collider = cuboid.getCollider();
+        Hash(hash, &collider.center, sizeof(collider.center));
+        Hash(hash, &collider.rotation, sizeof(collider.rotation));
+        Hash(hash, &collider.halfExtents, sizeof(collider.halfExtents));
+    }
+    if (mesh && !mesh->getPackets().empty()) {
+        Hash(hash, mesh->getPackets().data(), mesh->getPackets().size() * sizeof(TrianglePacket));
+    }
+    Hash(hash, &region, sizeof(region));
+    Hash(hash, &voxelSize, sizeof(voxelSize));
+    Hash(hash, &band, sizeof(band));
+    return hash;
+}
+
+bool SignedDistanceField::Save(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    unsigned int brickCount = static_cast<unsigned int>(bricks.size());
+    file.write(FILE_MAGIC, sizeof(FILE_MAGIC));
+    file.write(reinterpret_cast<const char*>(&FILE_VERSION), sizeof(FILE_VERSION));
+    file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+    file.write(reinterpret_cast<const char*>(&region), sizeof(region));
+    file.write(reinterpret_cast<const char*>(&voxelSize), sizeof(voxelSize));
+    file.write(reinterpret_cast<const char*>(&band), sizeof(band));
+    file.write(reinterpret_cast<const char*>(dims), sizeof(dims));
+    file.write(reinterpret_cast<const char*>(&brickCount), sizeof(brickCount));
+    file.write(reinterpret_cast<const char*>(grid.data()), grid.size() * sizeof(unsigned int));
+    file.write(reinterpret_cast<const char*>(bricks.data()), bricks.size() * sizeof(DistanceBrick));
+    return static_cast<bool>(file);
+}
+
+bool SignedDistanceField::Load(const std::string& path, unsigned long long expectedKey) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    char magic[4];
+    unsigned int version = 0, brickCount = 0;
+    unsigned long long fileKey = 0;
+    AABB fileRegion;
+    float fileVoxelSize = 0.0f, fileBand = 0.0f;
+    unsigned int fileDims[3] = { 0, 0, 0 };
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    file.read(reinterpret_cast<char*>(&fileKey), sizeof(fileKey));
+    file.read(reinterpret_cast<char*>(&fileRegion), sizeof(fileRegion));
+    file.read(reinterpret_cast<char*>(&fileVoxelSize), sizeof(fileVoxelSize));
+    file.read(reinterpret_cast<char*>(&fileBand), sizeof(fileBand));
+    file.read(reinterpret_cast<char*>(fileDims), sizeof(fileDims));
+    file.read(reinterpret_cast<char*>(&brickCount), sizeof(brickCount));
+    if (!file || std::memcmp(magic, FILE_MAGIC, sizeof(magic)) != 0 || version != FILE_VERSION || fileKey != expectedKey) {
+        return false;
+    }
+
+    // Check the header against the bytes that follow before allocating anything, so a
+    // truncated or corrupt file is rejected instead of asking for gigabytes.
+    unsigned long long cells = 1;
+    for (unsigned int d : fileDims) {
+        if (d == 0 || d > MAX_GRID_CELLS) return false;
+        cells *= d;
+        if (cells > MAX_GRID_CELLS) return false;
+    }
+    if (brickCount > cells) return false;
+    std::streamoff header = file.tellg();
+    file.seekg(0, std::ios::end);
+    std::streamoff remaining = file.tellg() - header;
+    file.seekg(header);
+    if (!file || static_cast<unsigned long long>(remaining) !=
+        cells * sizeof(unsigned int) + static_cast<unsigned long long>(brickCount) * sizeof(DistanceBrick)) {
+        return false;
+    }
+
+    std::vector<unsigned int> fileGrid(static_cast<size_t>(cells));
+    std::vector<DistanceBrick> fileBricks(brickCount);
+    file.read(reinterpret_cast<char*>(fileGrid.data()), fileGrid.size() * sizeof(unsigned int));
+    file.read(reinterpret_cast<char*>(fileBricks.data()), fileBricks.size() * sizeof(DistanceBrick));
+    if (!file) return false;
+    for (unsigned int entry : fileGrid) {
+        if (entry < EMPTY_INSIDE && entry >= brickCount) return false;
+    }
+
+    region = fileRegion;
+    voxelSize = fileVoxelSize;
+    band = fileBand;
+    std::copy(fileDims, fileDims + 3, dims);
+    key = fileKey;
+    grid = std::move(fileGrid);
+    bricks = std::move(fileBricks);
+    return true;
+}
+
+bool SignedDistanceField::Sample(const glm::vec3& p, float& distance, glm::vec3& gradient) const {
+    if (grid.empty()) return false;
+    glm::vec3 v = (p - region.min) / voxelSize;
+    unsigned int brick[3];
+    glm::vec3 local;
+    for (int i = 0; i < 3; i++) {
+        if (!(v[i] >= 0.0f && v[i] < static_cast<float>(dims[i] * BRICK_VOXELS))) return false;
+        brick[i] = std::min(static_cast<unsigned int>(v[i]) / BRICK_VOXELS, dims[i] - 1);
+        local[i] = v[i] - static_cast<float>(brick[i] * BRICK_VOXELS);
+    }
+
+    unsigned int entry = grid[(size_t(brick[2]) * dims[1] + brick[1]) * dims[0] + brick[0]];
+    if (entry >= EMPTY_INSIDE) {
+        distance = entry == EMPTY_INSIDE ? -band : band;
+        gradient = glm::vec3(0.0f);
+        return true;
+    }
+
+    int cell[3];
+    glm::vec3 f;
+    for (int i = 0; i < 3; i++) {
+        cell[i] = std::min(static_cast<int>(local[i]), BRICK_VOXELS - 1);
+        f[i] = local[i] - static_cast<float>(cell[i]);
+    }
+    const signed char* s = bricks[entry].samples + (cell[2] * BRICK_SAMPLES + cell[1]) * BRICK_SAMPLES + cell[0];
+    const int dy = BRICK_SAMPLES, dz = BRICK_SAMPLES * BRICK_SAMPLES;
+    float c000 = s[0], c100 = s[1], c010 = s[dy], c110 = s[dy + 1];
+    float c001 = s[dz], c101 = s[dz + 1], c011 = s[dz + dy], c111 = s[dz + dy + 1];
+
+    // Trilinear value and its exact derivative, in units of band / 127 per voxel.
+    float c00 = c000 + f.x * (c100 - c000), c10 = c010 + f.x * (c110 - c010);
+    float c01 = c001 + f.x * (c101 - c001), c11 = c011 + f.x * (c111 - c011);
+    float c0 = c00 + f.y * (c10 - c00), c1 = c01 + f.y * (c11 - c01);
+    float scale = band / 127.0f;
+    distance = (c0 + f.z * (c1 - c0)) * scale;
+
+    float dx0 = (c100 - c000) + f.y * ((c110 - c010) - (c100 - c000));
+    float dx1 = (c101 - c001) + f.y * ((c111 - c011) - (c101 - c001));
+    gradient.x = dx0 + f.z * (dx1 - dx0);
+    gradient.y = (c10 - c00) + f.z * ((c11 - c01) - (c10 - c00));
+    gradient.z = c1 - c0;
+    gradient *= scale / voxelSize;
+    return true;
+}
+
+size_t SignedDistanceField::getMemoryUsage() const {
+    return grid.capacity() * sizeof(unsigned int) + bricks.capacity() * sizeof(DistanceBrick);
+}
+
+void ResolveDistanceFieldCollision(Sphere& sphere, const SignedDistanceField& field, float deltaTime) {
+    float r = sphere.mesh->getRadius();
+    // Distances are only known up to the band, so the speculative reach stops there.
+    float reach = std::max(r, std::min(r + deltaTime * glm::length(sphere.velocity), field.getBand()));
+    float distance;
+    glm::vec3 gradient;
+    if (!field.Sample(sphere.position, distance, gradient) || distance >= reach) return;
+    float length = glm::length(gradient);
+    if (length == 0.0f) return;
+
+    glm::vec3 normal = gradient / length;
+    float velAlongNormal = glm::dot(sphere.velocity, normal);
+    if (distance > r + CONTACT_SLOP) {
+        // Apart: it only loses the speed that would carry it into the surface within the step.
+        float excess = -(velAlongNormal + (distance - r) / deltaTime);
+        if (excess > 0.0f) sphere.velocity += excess * normal;
+        return;
+    }
+    if (distance < r) sphere.position += (r - distance) * normal;
+    if (velAlongNormal < 0.0f) sphere.velocity -= (1.0f + RESTITUTION) * velAlongNormal * normal;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "aabb.h"
+#include "cuboid.h"
+#include "sphere.h"
+#include "static_bvh.h"
+#include "triangle_mesh.h"
+
+// 8 x 8 x 8 distance samples covering 7 x 7 x 7 voxels, as signed bytes scaled to
+// the field's band. Neighbouring bricks repeat their shared face, so a trilinear
+// lookup never leaves its brick. Index (z * 8 + y) * 8 + x.
+struct DistanceBrick {
+    signed char samples[512];
+};
+
+// Static world geometry baked into a sparse-brick signed distance field, so a
+// sphere's contact with it is one trilinear sample and its gradient, whatever the
+// geometry. Only bricks within 'band' of a surface are stored; a dense grid of brick
+// indices covers the region, with the empty entries telling which side they are on.
+// The voxel size trades accuracy for memory: the brick count grows with the surface
+// area over its square. Bakes are saved to a file keyed by their inputs and reused.
+class SignedDistanceField {
+public:
+    static const int BRICK_SAMPLES = 8;
+    static const int BRICK_VOXELS = BRICK_SAMPLES - 1;
+    static const unsigned int EMPTY_OUTSIDE = 0xFFFFFFFFu;
+    static const unsigned int EMPTY_INSIDE = 0xFFFFFFFEu;
+
+    SignedDistanceField();
+
+    // Bakes the distance to the Cuboids (negative inside) and, if given, to the mesh's
+    // triangles (a thin shell, positive on both sides) over 'region'. Spheres with a
+    // radius up to 'band' collide correctly. The Cuboids are found through their BVH.
+    void Bake(const std::vector<Cuboid>& cuboids, const StaticBVH& staticWorld, const TriangleMesh* mesh,
+        const AABB& region, float voxelSize, float band);
+
+    // Identifies a bake's inputs: the geometry and the settings.
+    static unsigned long long InputKey(const std::vector<Cuboid>& cuboids, const TriangleMesh* mesh,
+        const AABB& region, float voxelSize, float band);
+
+    bool Save(const std::string& path) const;
+    // Fails and leaves the field as it was if the file is missing or damaged, or was
+    // baked from inputs with another key.
+    bool Load(const std::string& path, unsigned long long expectedKey);
+
+    // Distance at p, clamped to the band, and its gradient (unnormalized; zero away
+    // from every surface). Returns false outside the region.
+    bool Sample(const glm::vec3& p, float& distance, glm::vec3& gradient) const;
+
+    size_t getBrickCount() const { return bricks.size(); }
+    size_t getMemoryUsage() const;
+    float getVoxelSize() const { return voxelSize; }
+    float getBand() const { return band; }
+    unsigned long long getKey() const { return key; }
+    const AABB& getRegion() const { return region; }
+
+private:
+    AABB region;
+    float voxelSize;
+    float band;
+    unsigned int dims[3];        // bricks per axis
+    unsigned long long key;
+    std::vector<unsigned int> grid;
+    std::vector<DistanceBrick> bricks;
+};
+
+// Sphere against the baked world: pushed out along the gradient by what the sampled
+// distance lacks of the radius, and reflected if moving into the surface. A sphere
+// still apart that reaches the surface within deltaTime (as far as the band allows)
+// is a speculative contact and loses the speed that would carry it in.
+void ResolveDistanceFieldCollision(Sphere& sphere, const SignedDistanceField& field, float deltaTime);
@@ -0,0 +1,460 @@
+#include "gjk.h"
+#include <cfloat>
+#include <cmath>
+
+namespace {
+    const int MAX_GJK_ITERATIONS = 32;
+    const int MAX_EPA_ITERATIONS = 64;
+    const int MAX_EPA_VERTICES = 4 + MAX_EPA_ITERATIONS;
+    const int MAX_EPA_FACES = 2 * MAX_EPA_VERTICES;
+    // GJK stops once a new support point would shrink the squared distance by less
+    // than this fraction of it. Much smaller and float rounding decides the result.
+    const float GJK_RELATIVE_TOLERANCE = 1e-4f;
+    // Cores closer than this are treated as touching and handed to EPA.
+    const float TOUCHING_DISTANCE = 1e-5f;
+    // EPA stops once the polytope is this close to the Minkowski difference.
+    const float EPA_TOLERANCE = 1e-4f;
+
+    // A point of the Minkowski difference a - b, with the support points it came from.
+    struct SimplexVertex {
+        glm::vec3 localA;
+        glm::vec3 localB;
+        glm::vec3 pointA;
+        glm::vec3 pointB;
+        glm::vec3 w;
+    };
+
+    struct Simplex {
+        SimplexVertex v[4];
+        float weight[4];     // barycentric weights of the closest point
+        int count;
+    };
+
+    glm::vec3 LocalSupport(const ConvexCollider& shape, const glm::vec3& direction) {
+        if (shape.hull) return shape.hull->getVertex(shape.hull->Support(direction));
+        const glm::vec3& h = shape.halfExtents;
+        if (shape.cylinder) {
+            float radial = std::sqrt(direction.x * direction.x + direction.z * direction.z);
+            float scale = radial > 0.0f ? h.x / radial : 0.0f;
+            return glm::vec3(direction.x * scale, direction.y < 0.0f ? -h.y : h.y, direction.z * scale);
+        }
+        return glm::vec3(direction.x < 0.0f ? -h.x : h.x, direction.y < 0.0f ? -h.y : h.y,
+            direction.z < 0.0f ? -h.z : h.z);
+    }
+
+    SimplexVertex MakeVertex(const ConvexCollider& a, const ConvexCollider& b, const glm::vec3& localA,
+        const glm::vec3& localB) {
+        SimplexVertex v;
+        v.localA = localA;
+        v.localB = localB;
+        v.pointA = a.center + a.rotation * localA;
+        v.pointB = b.center + b.rotation * localB;
+        v.w = v.pointA - v.pointB;
+        return v;
+    }
+
+    // Support point of a - b along 'direction'. The rotations are orthonormal, so
+    // direction * rotation (the transpose applied) is the direction in the shape's frame.
+    SimplexVertex Support(const ConvexCollider& a, const ConvexCollider& b, const glm::vec3& direction) {
+        return MakeVertex(a, b, LocalSupport(a, direction * a.rotation), LocalSupport(b, -direction * b.rotation));
+    }
+
+    // Sub-simplex holding the point closest to the origin, with its weights.
+    struct Feature {
+        int count;
+        int index[3];
+        float weight[3];
+        glm::vec3 point;
+    };
+
+    Feature VertexFeature(const Simplex& s, int i) {
+        Feature f;
+        f.count = 1;
+        f.index[0] = i;
+        f.weight[0] = 1.0f;
+        f.point = s.v[i].w;
+        return f;
+    }
+
+    Feature ClosestOnSegment(const Simplex& s, int i, int j) {
+        const glm::vec3& a = s.v[i].w;
+        glm::vec3 ab = s.v[j].w - a;
+        float t = -glm::dot(a, ab);
+        if (t <= 0.0f) return VertexFeature(s, i);
+        float length2 = glm::dot(ab, ab);
+        if (t >= length2) return VertexFeature(s, j);
+        t /= length2;
+
+        Feature f;
+        f.count = 2;
+        f.index[0] = i;
+        f.index[1] = j;
+        f.weight[0] = 1.0f - t;
+        f.weight[1] = t;
+        f.point = a + t * ab;
+        return f;
+    }
+
+    // Ericson, Real-Time Collision Detection 5.1.5, for the origin.
+    Feature ClosestOnTriangle(const Simplex& s, int i, int j, int k) {
+        const glm::vec3& a = s.v[i].w;
+        const glm::vec3& b = s.v[j].w;
+        const glm::vec3& c = s.v[k].w;
+        glm::vec3 ab = b - a;
+        glm::vec3 ac = c - a;
+
+        float d1 = -glm::dot(ab, a);
+        float d2 = -glm::dot(ac, a);
+        if (d1 <= 0.0f && d2 <= 0.0f) return VertexFeature(s, i);
+
+        float d3 = -glm::dot(ab, b);
+        float d4 = -glm::dot(ac, b);
+        if (d3 >= 0.0f && d4 <= d3) return VertexFeature(s, j);
+
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return ClosestOnSegment(s, i, j);
+
+        float d5 = -glm::dot(ab, c);
+        float d6 = -glm::dot(ac, c);
+        if (d6 >= 0.0f && d5 <= d6) return VertexFeature(s, k);
+
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return ClosestOnSegment(s, i, k);
+
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) return ClosestOnSegment(s, j, k);
+
+        float sum = va + vb + vc;
+        if (!(sum > 0.0f)) {
+            // Degenerate triangle: the nearest of its edges.
+            Feature best = ClosestOnSegment(s, i, j);
+            Feature edges[2] = { ClosestOnSegment(s, i, k), ClosestOnSegment(s, j, k) };
+            for (const Feature& edge : edges) {
+                if (glm::dot(edge.point, edge.point) < glm::dot(best.point, best.point)) best = edge;
+            }
+            return best;
+        }
+
+        Feature f;
+        f.count = 3;
+        f.index[0] = i;
+        f.index[1] = j;
+        f.index[2] = k;
+        f.weight[1] = vb / sum;
+        f.weight[2] = vc / sum;
+        f.weight[0] = 1.0f - f.weight[1] - f.weight[2];
+        f.point = a + f.weight[1] * ab + f.weight[2] * ac;
+        return f;
+    }
+
+    // Ericson 5.1.6: the origin is enclosed unless it lies beyond one of the faces,
+    // in which case the closest point is on the nearest such face. Faces of a flat
+    // tetrahedron are always tested.
+    bool ClosestOnTetrahedron(const Simplex& s, Feature& best) {
+        static const int faces[4][4] = { { 0, 1, 2, 3 }, { 0, 2, 3, 1 }, { 0, 3, 1, 2 }, { 1, 3, 2, 0 } };
+        bool enclosed = true;
+        float bestDistance = FLT_MAX;
+        for (const auto& face : faces) {
+            const glm::vec3& a = s.v[face[0]].w;
+            glm::vec3 n = glm::cross(s.v[face[1]].w - a, s.v[face[2]].w - a);
+            float originSide = -glm::dot(a, n);
+            float oppositeSide = glm::dot(s.v[face[3]].w - a, n);
+            if (originSide * oppositeSide >= 0.0f && oppositeSide != 0.0f) continue;
+
+            enclosed = false;
+            Feature f = ClosestOnTriangle(s, face[0], face[1], face[2]);
+            float distance = glm::dot(f.point, f.point);
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = f;
+            }
+        }
+        return enclosed;
+    }
+
+    // Reduces the simplex to the sub-simplex closest to the origin and returns the
+    // closest point in 'closest'. Returns true if the simplex encloses the origin.
+    bool Solve(Simplex& s, glm::vec3& closest) {
+        Feature f;
+        if (s.count == 1) f = VertexFeature(s, 0);
+        else if (s.count == 2) f = ClosestOnSegment(s, 0, 1);
+        else if (s.count == 3) f = ClosestOnTriangle(s, 0, 1, 2);
+        else if (ClosestOnTetrahedron(s, f)) {
+            closest = glm::vec3(0.0f);
+            return true;
+        }
+
+        SimplexVertex kept[3];
+        for (int k = 0; k < f.count; k++) kept[k] = s.v[f.index[k]];
+        for (int k = 0; k < f.count; k++) {
+            s.v[k] = kept[k];
+            s.weight[k] = f.weight[k];
+        }
+        s.count = f.count;
+        closest = f.point;
+        return false;
+    }
+
+    // EPA needs a tetrahedron. A simplex that only touches the origin is grown by
+    // support points in directions off its line or plane; this fails only when the
+    // Minkowski difference itself is flat.
+    bool BlowUp(const ConvexCollider& a, const ConvexCollider& b, Simplex& s) {
+        static const glm::vec3 axes[3] = { glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+            glm::vec3(0.0f, 0.0f, 1.0f) };
+
+        if (s.count == 1) {
+            for (int i = 0; i < 6 && s.count == 1; i++) {
+                SimplexVertex w = Support(a, b, (i & 1) ? -axes[i / 2] : axes[i / 2]);
+                glm::vec3 d = w.w - s.v[0].w;
+                if (glm::dot(d, d) > EPA_TOLERANCE * EPA_TOLERANCE) s.v[s.count++] = w;
+            }
+            if (s.count == 1) return false;
+        }
+        if (s.count == 2) {
+            glm::vec3 line = glm::normalize(s.v[1].w - s.v[0].w);
+            glm::vec3 absLine = glm::abs(line);
+            int axis = absLine.x < absLine.y ? (absLine.x < absLine.z ? 0 : 2) : (absLine.y < absLine.z ? 1 : 2);
+            glm::vec3 side = glm::normalize(glm::cross(line, axes[axis]));
+            glm::vec3 directions[4] = { side, -side, glm::cross(line, side), -glm::cross(line, side) };
+            for (int i = 0; i < 4 && s.count == 2; i++) {
+                SimplexVertex w = Support(a, b, directions[i]);
+                if (glm::length(glm::cross(w.w - s.v[0].w, line)) > EPA_TOLERANCE) s.v[s.count++] = w;
+            }
+            if (s.count == 2) return false;
+        }
+        if (s.count == 3) {
+            glm::vec3 n = glm::cross(s.v[1].w - s.v[0].w, s.v[2].w - s.v[0].w);
+            float length = glm::length(n);
+            if (length == 0.0f) return false;
+            n /= length;
+            for (int i = 0; i < 2 && s.count == 3; i++) {
+                SimplexVertex w = Support(a, b, i == 0 ? n : -n);
+                if (std::abs(glm::dot(w.w - s.v[0].w, n)) > EPA_TOLERANCE) s.v[s.count++] = w;
+            }
+            if (s.count == 3) return false;
+        }
+        return true;
+    }
+
+    struct EPAFace {
+        int v[3];
+        glm::vec3 normal;
+        float distance;      // of the face's plane from the origin
+    };
+
+    bool MakeFace(const SimplexVertex* vertices, int a, int b, int c, EPAFace& face) {
+        glm::vec3 n = glm::cross(vertices[b].w - vertices[a].w, vertices[c].w - vertices[a].w);
+        float length = glm::length(n);
+        if (!(length > 1e-12f)) return false;
+        face.v[0] = a;
+        face.v[1] = b;
+        face.v[2] = c;
+        face.normal = n / length;
+        face.distance = glm::dot(face.normal, vertices[a].w);
+        return true;
+    }
+
+    // Barycentric weights of p in triangle abc (Ericson 3.4).
+    void Barycentric(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& p, float weight[3]) {
+        glm::vec3 v0 = b - a, v1 = c - a, v2 = p - a;
+        float d00 = glm::dot(v0, v0), d01 = glm::dot(v0, v1), d11 = glm::dot(v1, v1);
+        float d20 = glm::dot(v2, v0), d21 = glm::dot(v2, v1);
+        float denom = d00 * d11 - d01 * d01;
+        if (!(denom > 0.0f)) {
+            weight[0] = 1.0f;
+            weight[1] = weight[2] = 0.0f;
+            return;
+        }
+        weight[1] = (d11 * d20 - d01 * d21) / denom;
+        weight[2] = (d00 * d21 - d01 * d20) / denom;
+        weight[0] = 1.0f - weight[1] - weight[2];
+    }
+
+    // Expanding polytope algorithm: the face of a - b nearest the origin gives the
+    // penetration normal (from a towards b) and depth. Each step adds the support
+    // point beyond the nearest face, drops the faces that point can see and closes
+    // the hole with a fan from the horizon.
+    bool Penetration(const ConvexCollider& a, const ConvexCollider& b, Simplex& s, glm::vec3& normal, float& depth,
+        glm::vec3& pointA, glm::vec3& pointB) {
+        if (!BlowUp(a, b, s)) return false;
+
+        SimplexVertex vertices[MAX_EPA_VERTICES];
+        EPAFace faces[MAX_EPA_FACES];
+        int edges[3 * MAX_EPA_FACES][2];
+        int vertexCount = 4;
+        int faceCount = 0;
+        for (int i = 0; i < 4; i++) vertices[i] = s.v[i];
+
+        glm::vec3 inside = 0.25f * (vertices[0].w + vertices[1].w + vertices[2].w + vertices[3].w);
+        static const int tetra[4][3] = { { 0, 1, 2 }, { 0, 3, 1 }, { 0, 2, 3 }, { 1, 3, 2 } };
+        for (const auto& t : tetra) {
+            EPAFace& face = faces[faceCount++];
+            if (!MakeFace(vertices, t[0], t[1], t[2], face)) return false;
+            if (glm::dot(face.normal, inside) > face.distance) MakeFace(vertices, t[0], t[2], t[1], face);
+        }
+
+        EPAFace best = faces[0];
+        for (int iteration = 0; iteration < MAX_EPA_ITERATIONS; iteration++) {
+            int nearest = 0;
+            for (int f = 1; f < faceCount; f++) {
+                if (faces[f].distance < faces[nearest].distance) nearest = f;
+            }
+            // The nearest face only moves outwards. On a curved shape the support points
+            // crowd together until rounding opens the polytope; stop at the last good face.
+            if (iteration > 0 && faces[nearest].distance < best.distance - EPA_TOLERANCE) break;
+            best = faces[nearest];
+
+            SimplexVertex w = Support(a, b, best.normal);
+            if (glm::dot(w.w, best.normal) - best.distance < EPA_TOLERANCE || vertexCount == MAX_EPA_VERTICES) break;
+            int added = vertexCount;
+            vertices[vertexCount++] = w;
+
+            // An edge shared by two visible faces shows up once in each direction.
+            int edgeCount = 0;
+            for (int f = 0; f < faceCount;) {
+                if (glm::dot(faces[f].normal, w.w) - faces[f].distance <= -1e-5f) {
+                    f++;
+                    continue;
+                }
+                for (int k = 0; k < 3; k++) {
+                    int from = faces[f].v[k];
+                    int to = faces[f].v[(k + 1) % 3];
+                    int twin = -1;
+                    for (int e = 0; e < edgeCount; e++) {
+                        if (edges[e][0] == to && edges[e][1] == from) {
+                            twin = e;
+                            break;
+                        }
+                    }
+                    if (twin >= 0) {
+                        edges[twin][0] = edges[edgeCount - 1][0];
+                        edges[twin][1] = edges[edgeCount - 1][1];
+                        edgeCount--;
+                    }
+                    else {
+                        edges[edgeCount][0] = from;
+                        edges[edgeCount][1] = to;
+                        edgeCount++;
+                    }
+                }
+                faces[f] = faces[--faceCount];
+            }
+
+            // A sliver face or a full face list leaves the polytope open; the last
+            // nearest face is then as good as it gets.
+            bool closed = true;
+            for (int e = 0; e < edgeCount && closed; e++) {
+                closed = faceCount < MAX_EPA_FACES && MakeFace(vertices, edges[e][0], edges[e][1], added, faces[faceCount]);
+                if (closed) faceCount++;
+            }
+            if (!closed) break;
+        }
+
+        normal = best.normal;
+        depth = best.distance;
+        float weight[3];
+        Barycentric(vertices[best.v[0]].w, vertices[best.v[1]].w, vertices[best.v[2]].w, best.normal * best.distance, weight);
+        pointA = glm::vec3(0.0f);
+        pointB = glm::vec3(0.0f);
+        for (int k = 0; k < 3; k++) {
+            pointA += weight[k] * vertices[best.v[k]].pointA;
+            pointB += weight[k] * vertices[best.v[k]].pointB;
+        }
+        return true;
+    }
+}
+
+bool CollideConvex(const ConvexCollider& a, const ConvexCollider& b, GJKCache& cache, float maxDistance,
+    ConvexContact& contact) {
+    Simplex s;
+    s.count = 0;
+    for (int i = 0; i < cache.count; i++) s.v[s.count++] = MakeVertex(a, b, cache.localA[i], cache.localB[i]);
+    if (s.count == 0) {
+        glm::vec3 direction = a.center - b.center;
+        if (glm::dot(direction, direction) == 0.0f) direction = glm::vec3(1.0f, 0.0f, 0.0f);
+        s.v[s.count++] = Support(a, b, direction);
+    }
+
+    // Beyond 'reach' the cores are too far apart for the rounded shapes to be within maxDistance.
+    float reach = maxDistance + a.radius + b.radius;
+    glm::vec3 v(0.0f);
+    Simplex previous;
+    glm::vec3 previousV(0.0f);
+    bool overlap = false;
+    bool tooFar = false;
+    float previousDistance2 = FLT_MAX;
+    contact.iterations = 0;
+
+    while (contact.iterations < MAX_GJK_ITERATIONS) {
+        contact.iterations++;
+        if (Solve(s, v)) {
+            overlap = true;
+            break;
+        }
+        float distance2 = glm::dot(v, v);
+        if (distance2 <= TOUCHING_DISTANCE * TOUCHING_DISTANCE) {
+            overlap = true;
+            break;
+        }
+        // Near convergence a nearly flat simplex can make the distance creep back
+        // up; the simplex before the last point is then the answer.
+        if (distance2 >= previousDistance2) {
+            s = previous;
+            v = previousV;
+            break;
+        }
+        previousDistance2 = distance2;
+
+        SimplexVertex w = Support(a, b, -v);
+        float vw = glm::dot(v, w.w);
+        // The plane through w normal to v separates the origin from a - b by vw / |v|.
+        if (vw > 0.0f && vw * vw > reach * reach * distance2) {
+            tooFar = true;
+            break;
+        }
+
+        bool repeated = false;
+        for (int i = 0; i < s.count; i++) {
+            repeated = repeated || (s.v[i].localA == w.localA && s.v[i].localB == w.localB);
+        }
+        if (repeated || distance2 - vw <= GJK_RELATIVE_TOLERANCE * distance2) break;
+        previous = s;
+        previousV = v;
+        s.v[s.count++] = w;
+    }
+
+    cache.count = s.count;
+    for (int i = 0; i < s.count; i++) {
+        cache.localA[i] = s.v[i].localA;
+        cache.localB[i] = s.v[i].localB;
+    }
+    if (tooFar) return false;
+
+    float depth;
+    if (!overlap) {
+        contact.distance = std::sqrt(glm::dot(v, v));
+        contact.normal = -v / contact.distance;
+        contact.pointA = glm::vec3(0.0f);
+        contact.pointB = glm::vec3(0.0f);
+        for (int i = 0; i < s.count; i++) {
+            contact.pointA += s.weight[i] * s.v[i].pointA;
+            contact.pointB += s.weight[i] * s.v[i].pointB;
+        }
+    }
+    else if (Penetration(a, b, s, contact.normal, depth, contact.pointA, contact.pointB)) {
+        contact.distance = -depth;
+    }
+    else {
+        // Flat Minkowski difference: the cores touch without overlapping.
+        glm::vec3 between = b.center - a.center;
+        float length = glm::length(between);
+        contact.normal = length > 0.0f ? between / length : glm::vec3(0.0f, 1.0f, 0.0f);
+        contact.pointA = contact.pointB = s.v[0].pointA;
+        contact.distance = 0.0f;
+    }
+
+    contact.pointA += a.radius * contact.normal;
+    contact.pointB -= b.radius * contact.normal;
+    contact.distance -= a.radius + b.radius;
+    return contact.distance <= maxDistance;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <glm/glm.hpp>
+#include "convex_hull.h"
+
+// A convex shape placed in the world, as GJK sees it: a hull, or without one the
+// box of 'halfExtents' (a point when they are zero, a segment when only y is not),
+// moved to 'center', turned by 'rotation' and rounded by 'radius'. A sphere is a
+// rounded point and a capsule a rounded segment. With 'cylinder' set the core is
+// instead the cylinder of radius halfExtents.x and half height halfExtents.y along y.
+struct ConvexCollider {
+    const ConvexHull* hull;
+    glm::vec3 halfExtents;
+    glm::vec3 center;
+    glm::mat3 rotation;
+    float radius;
+    bool cylinder;
+};
+
+// Final GJK simplex of a pair, kept between queries. The support points are
+// stored in each shape's own frame, so the simplex moves with the shapes and
+// the next query starts from it; count 0 means no simplex yet.
+struct GJKCache {
+    int count;
+    glm::vec3 localA[4];
+    glm::vec3 localB[4];
+};
+
+// Result of CollideConvex(). 'normal' points from a towards b. 'distance' is
+// negative when the shapes overlap; then the points are the deepest points of
+// each shape inside the other, otherwise they are the closest points.
+struct ConvexContact {
+    glm::vec3 normal;
+    glm::vec3 pointA;
+    glm::vec3 pointB;
+    float distance;
+    int iterations;      // GJK iterations this query took
+};
+
+// Distance or penetration between two convex shapes.
+// GJK (van den Bergen, with Ericson's closest-point-on-simplex tests) runs on the
+// unrounded cores. When the cores overlap, EPA expands the final simplex over the
+// Minkowski difference to find the penetration depth. The radii are applied last.
+// Returns false, with only 'iterations' set, once the shapes are proven to be more
+// than maxDistance apart. A cache that still fits the shapes ends GJK after one
+// or two iterations, which is the usual case for resting contacts.
+bool CollideConvex(const ConvexCollider& a, const ConvexCollider& b, GJKCache& cache, float maxDistance,
+    ConvexContact& contact);
@@ -0,0 +1,107 @@
+#include "hash_grid.h"
+#include "parallel.h"
+#include <algorithm>
+
+HashGrid::HashGrid(float margin) : margin(margin), cellSize(1.0f), tableSize(1) {
+}
+
+void HashGrid::Update(const std::vector<Sphere>& spheres) {
+    size_t count = spheres.size();
+
+    // Cell size from the largest radius so neighbours are at most one cell away.
+    // Each radius is grown by half the margin, so the plain overlap test
+    // reports every pair within r1 + r2 + margin.
+    float inflate = 0.5f * margin;
+    float maxRadius = 0.0f;
+    for (const Sphere& s : spheres) {
+        maxRadius = std::max(maxRadius, ReachRadius(s));
+    }
+    cellSize = std::max(2.0f * (maxRadius + inflate), 1e-4f);
+
+    // About two buckets per sphere keeps hash collisions rare.
+    tableSize = 1;
+    while (tableSize < 2 * count) tableSize <<= 1;
+
+    sphereBucket.resize(count);
+    sphereCell.resize(count);
+    cellStart.assign(tableSize + 1, 0);
+
+    float invCellSize = 1.0f / cellSize;
+    for (size_t i = 0; i < count; i++) {
+        glm::ivec3 cell = glm::ivec3(glm::floor(spheres[i].position * invCellSize));
+        unsigned int bucket = HashCell(cell, tableSize);
+        sphereCell[i] = cell;
+        sphereBucket[i] = bucket;
+        cellStart[bucket + 1]++;
+    }
+
+    // Counting sort: prefix sum the bucket sizes, then scatter.
+    for (unsigned int b = 0; b < tableSize; b++) {
+        cellStart[b + 1] += cellStart[b];
+    }
+
+    sortedIndex.resize(count);
+    sortedPosition.resize(count);
+    sortedRadius.resize(count);
+    sortedCell.resize(count);
+    sortedBucket.resize(count);
+    std::vector<unsigned int> cursor(cellStart.begin(), cellStart.end() - 1);
+    for (size_t i = 0; i < count; i++) {
+        unsigned int slot = cursor[sphereBucket[i]]++;
+        sortedIndex[slot] = static_cast<unsigned int>(i);
+        sortedPosition[slot] = spheres[i].position;
+        sortedRadius[slot] = ReachRadius(spheres[i]) + inflate;
+        sortedCell[slot] = sphereCell[i];
+        sortedBucket[slot] = sphereBucket[i];
+    }
+}
+
+void HashGrid::FindPairs(std::vector<CollisionPair>& pairs) {
+    size_t count = sortedIndex.size();
+    threadPairs.resize(NumWorkerThreads());
+
+    // Walk spheres in sorted (cell) order so neighbouring cells stay in cache.
+    ParallelForRange(count, [&](size_t left, size_t right, unsigned int thread_id) {
+        std::vector<CollisionPair>& out = threadPairs[thread_id];
+        out.clear();
+
+        auto emit = [&](unsigned int i, unsigned int j) {
+            out.push_back(i < j ? CollisionPair{ i, j } : CollisionPair{ j, i });
+        };
+
+        for (size_t s = left; s < right; s++) {
+            unsigned int i = sortedIndex[s];
+            const glm::vec3& p = sortedPosition[s];
+            float r = sortedRadius[s];
+            const glm::ivec3& cell = sortedCell[s];
+
+            // Own cell: only entries after this one, so each pair is emitted once.
+            // Buckets can hold several cells after hashing, hence the cell check.
+            unsigned int bucket = sortedBucket[s];
+            for (unsigned int k = static_cast<unsigned int>(s) + 1; k < cellStart[bucket + 1]; k++) {
+                if (sortedCell[k] != cell) continue;
+                if (SpheresOverlap(p, r, sortedPosition[k], sortedRadius[k])) emit(i, sortedIndex[k]);
+            }
+
+            for (const glm::ivec3& offset : HalfShellStencil) {
+                glm::ivec3 neighbour = cell + offset;
+                unsigned int b = HashCell(neighbour, tableSize);
+                for (unsigned int k = cellStart[b]; k < cellStart[b + 1]; k++) {
+                    if (sortedCell[k] != neighbour) continue;
+                    if (SpheresOverlap(p, r, sortedPosition[k], sortedRadius[k])) emit(i, sortedIndex[k]);
+                }
+            }
+        }
+    });
+
+    for (std::vector<CollisionPair>& out : threadPairs) {
+        pairs.insert(pairs.end(), out.begin(), out.end());
+        out.clear();
+    }
+}
+
+size_t HashGrid::getMemoryUsage() const {
+    return VectorBytes(sphereBucket) + VectorBytes(sphereCell) + VectorBytes(cellStart) +
+        VectorBytes(sortedIndex) + VectorBytes(sortedPosition) + VectorBytes(sortedRadius) +
+        VectorBytes(sortedCell) + VectorBytes(sortedBucket) + VectorBytes(threadPairs);
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "broadphase.h"
+
+// Hashes integer cell coordinates into a table of 'tableSize' buckets (power of two).
+inline unsigned int HashCell(const glm::ivec3& cell, unsigned int tableSize) {
+    unsigned int h = (static_cast<unsigned int>(cell.x) * 73856093u) ^
+        (static_cast<unsigned int>(cell.y) * 19349663u) ^
+        (static_cast<unsigned int>(cell.z) * 83492791u);
+    // Fold the high bits down; the table only keeps the low ones.
+    h ^= h >> 16;
+    return h & (tableSize - 1);
+}
+
+// Half-shell stencil: 13 of the 26 neighbour cells. Together with the own cell,
+// every pair of neighbouring cells is visited from exactly one side.
+inline const glm::ivec3 HalfShellStencil[13] = {
+    { 1, 0, 0 }, { -1, 1, 0 }, { 0, 1, 0 }, { 1, 1, 0 },
+    { -1, -1, 1 }, { 0, -1, 1 }, { 1, -1, 1 },
+    { -1, 0, 1 }, { 0, 0, 1 }, { 1, 0, 1 },
+    { -1, 1, 1 }, { 0, 1, 1 }, { 1, 1, 1 }
+};
+
+// Uniform spatial hash grid broadphase.
+// The cell size is the largest sphere diameter, so any overlapping pair lives in
+// neighbouring cells. The grid is rebuilt every Update() with a counting sort:
+// sphere data ends up grouped by cell in contiguous arrays, and each cell is
+// addressed through a prefix-sum table (cellStart) instead of per-cell lists.
+class HashGrid : public Broadphase {
+public:
+    // With a margin, pairs closer than r1 + r2 + margin are reported as well.
+    HashGrid(float margin = 0.0f);
+
+    void Update(const std::vector<Sphere>& spheres) override;
+    void FindPairs(std::vector<CollisionPair>& pairs) override;
+    const char* getName() const override { return "HashGrid"; }
+    size_t getMemoryUsage() const override;
+
+    float getCellSize() const { return cellSize; }
+    float getMargin() const { return margin; }
+    void setMargin(float newMargin) { margin = newMargin; }
+    unsigned int getTableSize() const { return tableSize; }
+
+private:
+    float margin;
+    float cellSize;
+    unsigned int tableSize;
+
+    // Per sphere, in input order.
+    std::vector<unsigned int> sphereBucket;
+    std::vector<glm::ivec3> sphereCell;
+
+    // Bucket b holds sorted entries [cellStart[b], cellStart[b + 1]).
+    std::vector<unsigned int> cellStart;
+    std::vector<unsigned int> sortedIndex;
+    std::vector<glm::vec3> sortedPosition;
+    std::vector<float> sortedRadius;   // inflated by half the margin
+    std::vector<glm::ivec3> sortedCell;
+    std::vector<unsigned int> sortedBucket;
+
+    // Per-thread output, merged in thread order so pair order is deterministic.
+    std::vector<std::vector<CollisionPair>> threadPairs;
+};
@@ -0,0 +1,494 @@
+#include "heightfield.h"
+#include "triangle_mesh.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace {
+    // Same response as the walls: perfectly elastic.
+    const float RESTITUTION = 1.0f;
+    const float PARALLEL_EPSILON = 1e-12f;
+
+    // Pending block of a cast: level -1 is a single cell. 't' is the segment's entry time.
+    struct TraversalEntry {
+        int level;
+        unsigned int i, j;
+        float t;
+    };
+
+    // The segment tests below take o + t * d for t in [0, tMax] and return the entry time.
+
+    bool SegmentBox(const glm::vec3& o, const glm::vec3& d, const glm::vec3& lo, const glm::vec3& hi,
+        float tMax, float& t) {
+        float tNear = 0.0f;
+        float tFar = tMax;
+        for (int axis = 0; axis < 3; axis++) {
+            if (std::fabs(d[axis]) < PARALLEL_EPSILON) {
+                if (o[axis] < lo[axis] || o[axis] > hi[axis]) return false;
+                continue;
+            }
+            float inv = 1.0f / d[axis];
+            float t1 = (lo[axis] - o[axis]) * inv;
+            float t2 = (hi[axis] - o[axis]) * inv;
+            tNear = std::max(tNear, std::min(t1, t2));
+            tFar = std::min(tFar, std::max(t1, t2));
+            if (tNear > tFar) return false;
+        }
+        t = tNear;
+        return true;
+    }
+
+    bool SegmentSphere(const glm::vec3& o, const glm::vec3& d, const glm::vec3& center, float radius,
+        float tMax, float& t) {
+        glm::vec3 m = o - center;
+        float a = glm::dot(d, d);
+        float b = glm::dot(m, d);
+        float c = glm::dot(m, m) - radius * radius;
+        if (b >= 0.0f || a < PARALLEL_EPSILON) return false;
+        float disc = b * b - a * c;
+        if (disc < 0.0f) return false;
+        t = std::max(0.0f, (-b - std::sqrt(disc)) / a);
+        return t <= tMax;
+    }
+
+    // Side of the capsule of 'radius' around the edge ab; its ends are the vertex spheres.
+    bool SegmentEdge(const glm::vec3& o, const glm::vec3& d, const glm::vec3& a, const glm::vec3& b, float radius,
+        float tMax, float& t) {
+        glm::vec3 e = b - a;
+        float ee = glm::dot(e, e);
+        if (ee < PARALLEL_EPSILON) return false;
+        glm::vec3 m = o - a;
+        glm::vec3 mPerp = m - (glm::dot(m, e) / ee) * e;
+        glm::vec3 dPerp = d - (glm::dot(d, e) / ee) * e;
+        float qa = glm::dot(dPerp, dPerp);
+        float qb = glm::dot(mPerp, dPerp);
+        float qc = glm::dot(mPerp, mPerp) - radius * radius;
+        if (qb >= 0.0f || qa < PARALLEL_EPSILON) return false;
+        float disc = qb * qb - qa * qc;
+        if (disc < 0.0f) return false;
+        t = std::max(0.0f, (-qb - std::sqrt(disc)) / qa);
+        if (t > tMax) return false;
+        float along = glm::dot(m + t * d, e) / ee;
+        return along >= 0.0f && along <= 1.0f;
+    }
+
+    // Möller-Trumbore, from either side.
+    bool SegmentTriangle(const glm::vec3& o, const glm::vec3& d, const glm::vec3* tri, float tMax, float& t) {
+        glm::vec3 e1 = tri[1] - tri[0];
+        glm::vec3 e2 = tri[2] - tri[0];
+        glm::vec3 p = glm::cross(d, e2);
+        float det = glm::dot(e1, p);
+        if (std::fabs(det) < PARALLEL_EPSILON) return false;
+        float inv = 1.0f / det;
+        glm::vec3 s = o - tri[0];
+        float u = glm::dot(s, p) * inv;
+        if (u < 0.0f || u > 1.0f) return false;
+        glm::vec3 q = glm::cross(s, e1);
+        float v = glm::dot(d, q) * inv;
+        if (v < 0.0f || u + v > 1.0f) return false;
+        t = glm::dot(e2, q) * inv;
+        return t >= 0.0f && t <= tMax;
+    }
+
+    // A sphere of 'radius' swept along the segment against a triangle: the face
+    // moved up by the radius, then the edge capsules and vertex spheres.
+    bool SweptSphereTriangle(const glm::vec3& o, const glm::vec3& d, float radius, const glm::vec3* tri,
+        float tMax, float& t) {
+        glm::vec3 n = glm::cross(tri[1] - tri[0], tri[2] - tri[0]);
+        float length = glm::length(n);
+        if (length == 0.0f) return false;
+        n /= length;
+
+        bool hit = false;
+        t = tMax;
+        float entry;
+        float distance = glm::dot(n, o - tri[0]);
+        float approach = glm::dot(n, d);
+        if (approach < 0.0f && distance >= radius) {
+            entry = (radius - distance) / approach;
+            glm::vec3 p = o + entry * d - radius * n;
+            bool inside = true;
+            for (int k = 0; k < 3; k++) {
+                inside = inside && glm::dot(glm::cross(tri[(k + 1) % 3] - tri[k], p - tri[k]), n) >= 0.0f;
+            }
+            if (inside && entry <= t) {
+                t = entry;
+                hit = true;
+            }
+        }
+        for (int k = 0; k < 3; k++) {
+            if (SegmentEdge(o, d, tri[k], tri[(k + 1) % 3], radius, t, entry) && entry <= t) {
+                t = entry;
+                hit = true;
+            }
+            if (SegmentSphere(o, d, tri[k], radius, t, entry) && entry <= t) {
+                t = entry;
+                hit = true;
+            }
+        }
+        return hit;
+    }
+}
+
+Heightfield::Heightfield()
+    : columns(0), rows(0), tilesX(0), origin(0.0f), cellSize(1.0f), minHeight(0.0f), heightScale(0.0f),
+    bounds{ glm::vec3(0.0f), glm::vec3(0.0f) } {
+}
+
+void Heightfield::Build(const std::vector<float>& heights, unsigned int newColumns, unsigned int newRows,
+    const glm::vec2& newOrigin, float newCellSize) {
+    columns = newColumns;
+    rows = newRows;
+    origin = newOrigin;
+    cellSize = newCellSize;
+    samples.clear();
+    levels.clear();
+    if (columns < 2 || rows < 2) return;
+
+    auto range = std::minmax_element(heights.begin(), heights.begin() + size_t(columns) * rows);
+    minHeight = *range.first;
+    heightScale = (*range.second - minHeight) / 65535.0f;
+    float inverseScale = heightScale > 0.0f ? 1.0f / heightScale : 0.0f;
+
+    tilesX = (columns + TILE_SIZE - 1) / TILE_SIZE;
+    unsigned int tilesZ = (rows + TILE_SIZE - 1) / TILE_SIZE;
+    samples.assign(size_t(tilesX) * tilesZ * TILE_SIZE * TILE_SIZE, 0);
+    for (unsigned int z = 0; z < rows; z++) {
+        for (unsigned int x = 0; x < columns; x++) {
+            float q = std::round((heights[size_t(z) * columns + x] - minHeight) * inverseScale);
+            samples[((z / TILE_SIZE) * tilesX + x / TILE_SIZE) * TILE_SIZE * TILE_SIZE + (z % TILE_SIZE) * TILE_SIZE +
+                x % TILE_SIZE] = static_cast<unsigned short>(std::min(65535.0f, std::max(0.0f, q)));
+        }
+    }
+
+    // First level straight from the samples: block (i, j) covers cells [2i, 2i + 2),
+    // so samples [2i, 2i + 2] on each axis.
+    unsigned int cellColumns = columns - 1, cellRows = rows - 1;
+    MipLevel first = { (cellColumns + 1) / 2, (cellRows + 1) / 2, {} };
+    first.range.resize(size_t(first.columns) * first.rows * 2);
+    for (unsigned int j = 0; j < first.rows; j++) {
+        for (unsigned int i = 0; i < first.columns; i++) {
+            unsigned short lo = 65535, hi = 0;
+            for (unsigned int z = 2 * j; z <= std::min(2 * j + 2, rows - 1); z++) {
+                for (unsigned int x = 2 * i; x <= std::min(2 * i + 2, columns - 1); x++) {
+                    lo = std::min(lo, getSample(x, z));
+                    hi = std::max(hi, getSample(x, z));
+                }
+            }
+            first.range[2 * (size_t(j) * first.columns + i)] = lo;
+            first.range[2 * (size_t(j) * first.columns + i) + 1] = hi;
+        }
+    }
+    levels.push_back(std::move(first));
+
+    while (levels.back().columns > 1 || levels.back().rows > 1) {
+        const MipLevel& below = levels.back();
+        MipLevel next = { (below.columns + 1) / 2, (below.rows + 1) / 2, {} };
+        next.range.resize(size_t(next.columns) * next.rows * 2);
+        for (unsigned int j = 0; j < next.rows; j++) {
+            for (unsigned int i = 0; i < next.columns; i++) {
+                unsigned short lo = 65535, hi = 0;
+                for (unsigned int y = 2 * j; y < std::min(2 * j + 2, below.rows); y++) {
+                    for (unsigned int x = 2 * i; x < std::min(2 * i + 2, below.columns); x++) {
+                        lo = std::min(lo, below.range[2 * (size_t(y) * below.columns + x)]);
+                        hi = std::max(hi, below.range[2 * (size_t(y) * below.columns + x) + 1]);
+                    }
+                }
+                next.range[2 * (size_t(j) * next.columns + i)] = lo;
+                next.range[2 * (size_t(j) * next.columns + i) + 1] = hi;
+            }
+        }
+        levels.push_back(std::move(next));
+    }
+
+    bounds = BlockBounds(static_cast<int>(levels.size()) - 1, 0, 0);
+}
+
+float Heightfield::getHeight(unsigned int x, unsigned int z) const {
+    return Dequantize(getSample(x, z));
+}
+
+glm::vec3 Heightfield::getVertex(unsigned int x, unsigned int z) const {
+    return glm::vec3(origin.x + x * cellSize, getHeight(x, z), origin.y + z * cellSize);
+}
+
+bool Heightfield::HeightAt(float x, float z, float& height) const {
+    if (samples.empty()) return false;
+    float u = (x - origin.x) / cellSize;
+    float v = (z - origin.y) / cellSize;
+    if (!(u >= 0.0f && v >= 0.0f && u <= columns - 1 && v <= rows - 1)) return false;
+
+    unsigned int cx = std::min(static_cast<unsigned int>(u), columns - 2);
+    unsigned int cz = std::min(static_cast<unsigned int>(v), rows - 2);
+    u -= cx;
+    v -= cz;
+    // Same diagonal as getCellTriangles(): from (x + 1, z) to (x, z + 1).
+    if (u + v <= 1.0f) {
+        float h00 = getHeight(cx, cz);
+        height = h00 + u * (getHeight(cx + 1, cz) - h00) + v * (getHeight(cx, cz + 1) - h00);
+    }
+    else {
+        float h11 = getHeight(cx + 1, cz + 1);
+        height = h11 + (1.0f - u) * (getHeight(cx, cz + 1) - h11) + (1.0f - v) * (getHeight(cx + 1, cz) - h11);
+    }
+    return true;
+}
+
+void Heightfield::getCellTriangles(unsigned int x, unsigned int z, glm::vec3 corners[2][3]) const {
+    glm::vec3 v00 = getVertex(x, z), v10 = getVertex(x + 1, z);
+    glm::vec3 v01 = getVertex(x, z + 1), v11 = getVertex(x + 1, z + 1);
+    corners[0][0] = v00;
+    corners[0][1] = v01;
+    corners[0][2] = v10;
+    corners[1][0] = v10;
+    corners[1][1] = v01;
+    corners[1][2] = v11;
+}
+
+AABB Heightfield::BlockBounds(int level, unsigned int i, unsigned int j) const {
+    unsigned int span = level < 0 ? 1u : 2u << level;
+    unsigned int x0 = i * span, x1 = std::min(x0 + span, columns - 1);
+    unsigned int z0 = j * span, z1 = std::min(z0 + span, rows - 1);
+
+    unsigned short lo, hi;
+    if (level < 0) {
+        unsigned short s[4] = { getSample(i, j), getSample(i + 1, j), getSample(i, j + 1), getSample(i + 1, j + 1) };
+        lo = std::min(std::min(s[0], s[1]), std::min(s[2], s[3]));
+        hi = std::max(std::max(s[0], s[1]), std::max(s[2], s[3]));
+    }
+    else {
+        const MipLevel& mip = levels[level];
+        lo = mip.range[2 * (size_t(j) * mip.columns + i)];
+        hi = mip.range[2 * (size_t(j) * mip.columns + i) + 1];
+    }
+    return { glm::vec3(origin.x + x0 * cellSize, Dequantize(lo), origin.y + z0 * cellSize),
+        glm::vec3(origin.x + x1 * cellSize, Dequantize(hi), origin.y + z1 * cellSize) };
+}
+
+template <typename LeafTest>
+void Heightfield::Traverse(const glm::vec3& o, const glm::vec3& d, float grow, float& best, LeafTest leafTest) const {
+    if (levels.empty()) return;
+
+    // Children go on the stack far to near, so blocks come off in the order the
+    // segment enters them. Four per level is enough for any depth.
+    TraversalEntry stack[4 * 34];
+    int top = 0;
+    int root = static_cast<int>(levels.size()) - 1;
+    float t;
+    if (!SegmentBox(o, d, bounds.min - grow, bounds.max + grow, best, t)) return;
+    stack[top++] = { root, 0, 0, t };
+
+    while (top > 0) {
+        TraversalEntry entry = stack[--top];
+        // Something nearer was hit since this block was pushed.
+        if (entry.t > best) continue;
+        if (entry.level < 0) {
+            leafTest(entry.i, entry.j, best);
+            continue;
+        }
+
+        int childLevel = entry.level - 1;
+        unsigned int childColumns = childLevel < 0 ? columns - 1 : levels[childLevel].columns;
+        unsigned int childRows = childLevel < 0 ? rows - 1 : levels[childLevel].rows;
+        TraversalEntry children[4];
+        int count = 0;
+        for (unsigned int j = 2 * entry.j; j < std::min(2 * entry.j + 2, childRows); j++) {
+            for (unsigned int i = 2 * entry.i; i < std::min(2 * entry.i + 2, childColumns); i++) {
+                AABB box = BlockBounds(childLevel, i, j);
+                if (SegmentBox(o, d, box.min - grow, box.max + grow, best, t)) children[count++] = { childLevel, i, j, t };
+            }
+        }
+        // Insertion sort, far first: there are at most four.
+        for (int k = 1; k < count; k++) {
+            TraversalEntry child = children[k];
+            int m = k;
+            for (; m > 0 && children[m - 1].t < child.t; m--) children[m] = children[m - 1];
+            children[m] = child;
+        }
+        for (int k = 0; k < count; k++) stack[top++] = children[k];
+    }
+}
+
+bool Heightfield::Cast(const Ray& ray, RaycastHit& hit) const {
+    hit.type = RaycastHitType::None;
+    hit.body = 0;
+    hit.distance = ray.maxDistance;
+    hit.normal = glm::vec3(0.0f);
+
+    // Starting under the surface counts as starting inside.
+    float surface;
+    if (HeightAt(ray.origin.x, ray.origin.z, surface) && ray.origin.y < surface) {
+        unsigned int x = std::min(static_cast<unsigned int>((ray.origin.x - origin.x) / cellSize), columns - 2);
+        unsigned int z = std::min(static_cast<unsigned int>((ray.origin.z - origin.y) / cellSize), rows - 2);
+        hit.type = RaycastHitType::Heightfield;
+        hit.body = z * (columns - 1) + x;
+        hit.distance = 0.0f;
+        hit.normal = -ray.direction;
+        return true;
+    }
+
+    float best = ray.maxDistance;
+    Traverse(ray.origin, ray.direction, 0.0f, best, [&](unsigned int x, unsigned int z, float& tMax) {
+        glm::vec3 corners[2][3];
+        getCellTriangles(x, z, corners);
+        for (int k = 0; k < 2; k++) {
+            float t;
+            if (!SegmentTriangle(ray.origin, ray.direction, corners[k], tMax, t)) continue;
+            tMax = t;
+            hit.type = RaycastHitType::Heightfield;
+            hit.body = z * (columns - 1) + x;
+            hit.normal = glm::normalize(glm::cross(corners[k][1] - corners[k][0], corners[k][2] - corners[k][0]));
+            // Facing the ray, for rays that come up from below the grid's edge.
+            if (glm::dot(hit.normal, ray.direction) > 0.0f) hit.normal = -hit.normal;
+        }
+    });
+
+    hit.distance = best;
+    return hit.type != RaycastHitType::None;
+}
+
+bool Heightfield::Cast(const ShapeCast& cast, ShapeCastHit& hit) const {
+    glm::vec3 d = cast.end - cast.start;
+    hit.type = RaycastHitType::None;
+    hit.body = 0;
+    hit.time = 1.0f;
+    hit.normal = glm::vec3(0.0f);
+
+    // Overlapping at the start: under the surface, or within the radius of a cell.
+    // A zero-length segment visits exactly the blocks within the radius of the start.
+    float surface;
+    bool overlapping = HeightAt(cast.start.x, cast.start.z, surface) && cast.start.y < surface;
+    glm::vec3 away(0.0f, 1.0f, 0.0f);
+    if (!overlapping) {
+        float nearest2 = cast.radius * cast.radius;
+        float still = 0.0f;
+        Traverse(cast.start, glm::vec3(0.0f), cast.radius, still, [&](unsigned int x, unsigned int z, float&) {
+            glm::vec3 corners[2][3];
+            getCellTriangles(x, z, corners);
+            for (int k = 0; k < 2; k++) {
+                glm::vec3 offset = cast.start - ClosestPointOnTriangle(cast.start, corners[k][0], corners[k][1], corners[k][2]);
+                float dist2 = glm::dot(offset, offset);
+                if (dist2 >= nearest2) continue;
+                nearest2 = dist2;
+                overlapping = true;
+                hit.body = z * (columns - 1) + x;
+                if (dist2 > 0.0f) away = offset / std::sqrt(dist2);
+            }
+        });
+    }
+    if (overlapping) {
+        hit.type = RaycastHitType::Heightfield;
+        hit.time = 0.0f;
+        hit.normal = away;
+        return true;
+    }
+
+    float best = 1.0f;
+    Traverse(cast.start, d, cast.radius, best, [&](unsigned int x, unsigned int z, float& tMax) {
+        glm::vec3 corners[2][3];
+        getCellTriangles(x, z, corners);
+        for (int k = 0; k < 2; k++) {
+            float t;
+            if (!SweptSphereTriangle(cast.start, d, cast.radius, corners[k], tMax, t)) continue;
+            tMax = t;
+            hit.type = RaycastHitType::Heightfield;
+            hit.body = z * (columns - 1) + x;
+            glm::vec3 p = cast.start + t * d;
+            glm::vec3 offset = p - ClosestPointOnTriangle(p, corners[k][0], corners[k][1], corners[k][2]);
+            hit.normal = glm::dot(offset, offset) > 0.0f ? glm::normalize(offset) : -glm::normalize(d);
+        }
+    });
+
+    hit.time = best;
+    return hit.type != RaycastHitType::None;
+}
+
+size_t Heightfield::getMemoryUsage() const {
+    size_t bytes = samples.capacity() * sizeof(unsigned short);
+    for (const MipLevel& level : levels) bytes += level.range.capacity() * sizeof(unsigned short);
+    return bytes;
+}
+
+void ResolveHeightfieldCollision(Sphere& sphere, const Heightfield& heightfield, float deltaTime) {
+    if (heightfield.levels.empty()) return;
+    float r = sphere.mesh->getRadius();
+    glm::vec3& p = sphere.position;
+    // Triangles within a step's travel get a speculative contact.
+    float reach = r + deltaTime * glm::length(sphere.velocity);
+
+    auto respond = [&](const glm::vec3& normal, float penetration) {
+        if (penetration > 0.0f) p += penetration * normal;
+        float velAlongNormal = glm::dot(sphere.velocity, normal);
+        if (velAlongNormal < 0.0f) sphere.velocity -= (1.0f + RESTITUTION) * velAlongNormal * normal;
+    };
+
+    // Tunnelled under the surface: back out along the normal of the triangle below.
+    float surface;
+    if (heightfield.HeightAt(p.x, p.z, surface) && p.y < surface) {
+        float cs = heightfield.cellSize;
+        unsigned int x = std::min(static_cast<unsigned int>((p.x - heightfield.origin.x) / cs), heightfield.columns - 2);
+        unsigned int z = std::min(static_cast<unsigned int>((p.z - heightfield.origin.y) / cs), heightfield.rows - 2);
+        glm::vec3 corners[2][3];
+        heightfield.getCellTriangles(x, z, corners);
+        float u = (p.x - heightfield.origin.x) / cs - x, v = (p.z - heightfield.origin.y) / cs - z;
+        const glm::vec3* tri = corners[u + v <= 1.0f ? 0 : 1];
+        glm::vec3 normal = glm::normalize(glm::cross(tri[1] - tri[0], tri[2] - tri[0]));
+        respond(normal, r - glm::dot(normal, p - tri[0]));
+        return;
+    }
+
+    // The footprint gives the cells directly.
+    float cs = heightfield.cellSize;
+    float lowX = (p.x - reach - heightfield.origin.x) / cs, highX = (p.x + reach - heightfield.origin.x) / cs;
+    float lowZ = (p.z - reach - heightfield.origin.y) / cs, highZ = (p.z + reach - heightfield.origin.y) / cs;
+    float maxX = static_cast<float>(heightfield.columns - 2), maxZ = static_cast<float>(heightfield.rows - 2);
+    if (highX < 0.0f || highZ < 0.0f || lowX >= maxX + 1.0f || lowZ >= maxZ + 1.0f) return;
+    unsigned int x0 = static_cast<unsigned int>(std::max(0.0f, lowX)), x1 = static_cast<unsigned int>(std::min(maxX, highX));
+    unsigned int z0 = static_cast<unsigned int>(std::max(0.0f, lowZ)), z1 = static_cast<unsigned int>(std::min(maxZ, highZ));
+
+    // Of the speculative contacts only the one that would close its gap fastest is kept:
+    // the grid puts many triangles within reach, and the edges of those beside it would
+    // slew the sphere sideways.
+    float speculativeExcess = 0.0f, speculativeGap = 0.0f;
+    glm::vec3 speculativeNormal(0.0f);
+    for (unsigned int z = z0; z <= z1; z++) {
+        for (unsigned int x = x0; x <= x1; x++) {
+            // The cell's samples bound its triangles; most cells are well below the sphere.
+            AABB cell = heightfield.BlockBounds(-1, x, z);
+            if (cell.max.y < p.y - reach || cell.min.y > p.y + reach) continue;
+
+            glm::vec3 corners[2][3];
+            heightfield.getCellTriangles(x, z, corners);
+            for (int k = 0; k < 2; k++) {
+                // Behind a triangle's plane the sphere is only near its edges, which the
+                // triangles it is in front of push out of without driving it into the ground.
+                glm::vec3 normal = glm::cross(corners[k][1] - corners[k][0], corners[k][2] - corners[k][0]);
+                if (glm::dot(normal, p - corners[k][0]) < 0.0f) continue;
+                glm::vec3 offset = p - ClosestPointOnTriangle(p, corners[k][0], corners[k][1], corners[k][2]);
+                float dist2 = glm::dot(offset, offset);
+                if (dist2 >= reach * reach || dist2 == 0.0f) continue;
+                float dist = std::sqrt(dist2);
+                if (dist <= r + CONTACT_SLOP) {
+                    respond(offset / dist, r - dist);
+                    continue;
+                }
+                // Apart, it is a speculative contact only if the step carries it into the
+                // triangle's plane; otherwise the ground ahead of a sphere skimming over it
+                // would hold it back.
+                normal = glm::normalize(normal);
+                if (glm::dot(normal, p - corners[k][0]) + deltaTime * glm::dot(sphere.velocity, normal) > r) continue;
+                float excess = -(glm::dot(sphere.velocity, offset / dist) + (dist - r) / deltaTime);
+                if (excess > speculativeExcess) {
+                    speculativeExcess = excess;
+                    speculativeGap = dist - r;
+                    speculativeNormal = offset / dist;
+                }
+            }
+        }
+    }
+
+    // It only loses the speed that would carry it into the surface within the step,
+    // measured after the touching contacts have bounced it.
+    float excess = -(glm::dot(sphere.velocity, speculativeNormal) + speculativeGap / deltaTime);
+    if (speculativeExcess > 0.0f && excess > 0.0f) sphere.velocity += excess * speculativeNormal;
+}
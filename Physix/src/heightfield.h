@@ -0,0 +1,85 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "aabb.h"
+#include "raycast.h"
+#include "shape_cast.h"
+#include "sphere.h"
+
+// Static terrain as a regular grid of heights, solid below the surface.
+// Sample (x, z) sits at origin + (x, z) * cellSize; each cell between four samples
+// is split into two triangles along the same diagonal. Heights are quantized to 16
+// bits over the terrain's height range and stored in 8 x 8 sample tiles, so a
+// sphere's cells share one or two cache lines. On top of them is a min/max pyramid
+// whose first level covers 2 x 2 cells, for about 3.3 bytes per sample in all.
+// A sphere finds its cells directly from its XZ footprint; ray and shape casts walk
+// the pyramid front to back, skipping every block the cast passes above or below.
+class Heightfield {
+public:
+    static const unsigned int TILE_SIZE = 8;
+
+    Heightfield();
+
+    // 'heights' is row-major along x: heights[z * columns + x]. At least 2 x 2 samples.
+    void Build(const std::vector<float>& heights, unsigned int columns, unsigned int rows,
+        const glm::vec2& origin, float cellSize);
+
+    float getHeight(unsigned int x, unsigned int z) const;
+    glm::vec3 getVertex(unsigned int x, unsigned int z) const;
+    // Surface height under (x, z), or false outside the grid.
+    bool HeightAt(float x, float z, float& height) const;
+
+    // First contact along the ray / sweep, reported like the other static bodies:
+    // 'body' is the cell index z * (columns - 1) + x, type Heightfield.
+    bool Cast(const Ray& ray, RaycastHit& hit) const;
+    bool Cast(const ShapeCast& cast, ShapeCastHit& hit) const;
+
+    unsigned int getColumns() const { return columns; }
+    unsigned int getRows() const { return rows; }
+    float getCellSize() const { return cellSize; }
+    const AABB& getBounds() const { return bounds; }
+    size_t getLevelCount() const { return levels.size(); }
+    size_t getMemoryUsage() const;
+
+private:
+    // One level of the pyramid: a (min, max) sample pair per block of cells.
+    struct MipLevel {
+        unsigned int columns;
+        unsigned int rows;
+        std::vector<unsigned short> range;
+    };
+
+    std::vector<unsigned short> samples;
+    std::vector<MipLevel> levels;
+    unsigned int columns, rows;
+    unsigned int tilesX;
+    glm::vec2 origin;
+    float cellSize;
+    float minHeight;
+    float heightScale;
+    AABB bounds;
+
+    unsigned short getSample(unsigned int x, unsigned int z) const {
+        return samples[((z / TILE_SIZE) * tilesX + x / TILE_SIZE) * TILE_SIZE * TILE_SIZE +
+            (z % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE];
+    }
+    float Dequantize(unsigned short sample) const { return minHeight + sample * heightScale; }
+
+    // The two triangles of cell (x, z), corners in counter-clockwise order seen from above.
+    void getCellTriangles(unsigned int x, unsigned int z, glm::vec3 corners[2][3]) const;
+    // Box of cell block (i, j) of a pyramid level, or of a single cell for level -1.
+    AABB BlockBounds(int level, unsigned int i, unsigned int j) const;
+
+    // Front-to-back walk of the blocks the segment o + t * d (t in [0, best]) passes
+    // within 'grow' of. leafTest(x, z, best) tests cell (x, z) and lowers 'best' on a hit.
+    template <typename LeafTest>
+    void Traverse(const glm::vec3& o, const glm::vec3& d, float grow, float& best, LeafTest leafTest) const;
+
+    friend void ResolveHeightfieldCollision(Sphere& sphere, const Heightfield& heightfield, float deltaTime);
+};
+
+// Sphere against the terrain: a center below the surface is lifted out along the
+// normal of the triangle under it, otherwise the cells under the sphere's footprint
+// are resolved through the closest point, as the walls are. Cells within a step's
+// travel get a speculative contact that only removes the speed that would close the gap.
+void ResolveHeightfieldCollision(Sphere& sphere, const Heightfield& heightfield, float deltaTime);
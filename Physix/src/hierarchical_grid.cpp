@@ -0,0 +1,155 @@
+#include "hierarchical_grid.h"
+#include "hash_grid.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+
+HierarchicalGrid::HierarchicalGrid() : baseCellSize(1.0f), levelCount(0), occupiedLevels(0) {
+    for (int level = 0; level < MAX_LEVELS; level++) {
+        cellSize[level] = 1.0f;
+        levelPopulation[level] = 0;
+        tableSize[level] = 1;
+        tableOffset[level] = 0;
+    }
+}
+
+void HierarchicalGrid::Update(const std::vector<Sphere>& spheres) {
+    size_t count = spheres.size();
+
+    float minRadius = count > 0 ? ReachRadius(spheres[0]) : 1.0f;
+    for (const Sphere& s : spheres) {
+        minRadius = std::min(minRadius, ReachRadius(s));
+    }
+    baseCellSize = std::max(2.0f * minRadius, 1e-4f);
+
+    // Assign each sphere the finest level whose cell fits its diameter.
+    sphereLevel.resize(count);
+    levelCount = 0;
+    occupiedLevels = 0;
+    std::fill(levelPopulation, levelPopulation + MAX_LEVELS, 0u);
+    for (size_t i = 0; i < count; i++) {
+        float ratio = 2.0f * ReachRadius(spheres[i]) / baseCellSize;
+        int level = ratio <= 1.0f ? 0 : static_cast<int>(std::ceil(std::log2(ratio)));
+        level = std::min(level, MAX_LEVELS - 1);
+        sphereLevel[i] = static_cast<unsigned char>(level);
+        levelPopulation[level]++;
+        occupiedLevels |= 1u << level;
+        levelCount = std::max(levelCount, level + 1);
+    }
+
+    // Per-level tables of about two buckets per sphere, packed one after another.
+    unsigned int totalBuckets = 0;
+    for (int level = 0; level < MAX_LEVELS; level++) {
+        cellSize[level] = baseCellSize * static_cast<float>(1u << level);
+        tableSize[level] = 1;
+        while (tableSize[level] < 2 * levelPopulation[level]) tableSize[level] <<= 1;
+        tableOffset[level] = totalBuckets;
+        totalBuckets += tableSize[level];
+    }
+
+    sphereBucket.resize(count);
+    sphereCell.resize(count);
+    cellStart.assign(totalBuckets + 1, 0);
+    for (size_t i = 0; i < count; i++) {
+        int level = sphereLevel[i];
+        glm::ivec3 cell = glm::ivec3(glm::floor(spheres[i].position / cellSize[level]));
+        unsigned int bucket = tableOffset[level] + HashCell(cell, tableSize[level]);
+        sphereCell[i] = cell;
+        sphereBucket[i] = bucket;
+        cellStart[bucket + 1]++;
+    }
+
+    for (unsigned int b = 0; b < totalBuckets; b++) {
+        cellStart[b + 1] += cellStart[b];
+    }
+
+    sortedIndex.resize(count);
+    sortedPosition.resize(count);
+    sortedRadius.resize(count);
+    sortedCell.resize(count);
+    sortedBucket.resize(count);
+    sortedLevel.resize(count);
+    std::vector<unsigned int> cursor(cellStart.begin(), cellStart.end() - 1);
+    for (size_t i = 0; i < count; i++) {
+        unsigned int slot = cursor[sphereBucket[i]]++;
+        sortedIndex[slot] = static_cast<unsigned int>(i);
+        sortedPosition[slot] = spheres[i].position;
+        sortedRadius[slot] = ReachRadius(spheres[i]);
+        sortedCell[slot] = sphereCell[i];
+        sortedBucket[slot] = sphereBucket[i];
+        sortedLevel[slot] = sphereLevel[i];
+    }
+}
+
+void HierarchicalGrid::FindPairs(std::vector<CollisionPair>& pairs) {
+    size_t count = sortedIndex.size();
+    threadPairs.resize(NumWorkerThreads());
+
+    ParallelForRange(count, [&](size_t left, size_t right, unsigned int thread_id) {
+        std::vector<CollisionPair>& out = threadPairs[thread_id];
+        out.clear();
+
+        auto emit = [&](unsigned int i, unsigned int j) {
+            out.push_back(i < j ? CollisionPair{ i, j } : CollisionPair{ j, i });
+        };
+
+        // Tests sphere s against every entry of 'cell' on 'level'.
+        auto scanCell = [&](size_t s, int level, const glm::ivec3& cell) {
+            unsigned int b = tableOffset[level] + HashCell(cell, tableSize[level]);
+            for (unsigned int k = cellStart[b]; k < cellStart[b + 1]; k++) {
+                if (sortedCell[k] != cell) continue;
+                if (SpheresOverlap(sortedPosition[s], sortedRadius[s], sortedPosition[k], sortedRadius[k])) {
+                    emit(sortedIndex[s], sortedIndex[k]);
+                }
+            }
+        };
+
+        for (size_t s = left; s < right; s++) {
+            int level = sortedLevel[s];
+            const glm::ivec3& cell = sortedCell[s];
+
+            // Same level: own cell (later entries only) plus the half-shell.
+            unsigned int bucket = sortedBucket[s];
+            for (unsigned int k = static_cast<unsigned int>(s) + 1; k < cellStart[bucket + 1]; k++) {
+                if (sortedCell[k] != cell) continue;
+                if (SpheresOverlap(sortedPosition[s], sortedRadius[s], sortedPosition[k], sortedRadius[k])) {
+                    emit(sortedIndex[s], sortedIndex[k]);
+                }
+            }
+            for (const glm::ivec3& offset : HalfShellStencil) {
+                scanCell(s, level, cell + offset);
+            }
+
+            // Coarser levels: an overlapping sphere there has radius at most half a
+            // cell, so its center lies within (r + cell / 2) of ours. Our radius is at
+            // most a quarter of that cell, so the box is up to 1.5 cells wide and
+            // spans at most three cells per axis.
+            unsigned int coarser = occupiedLevels & ~((2u << level) - 1u);
+            for (int upper = level + 1; coarser != 0; upper++) {
+                if (!(coarser & (1u << upper))) continue;
+                coarser &= ~(1u << upper);
+
+                float reach = sortedRadius[s] + 0.5f * cellSize[upper];
+                glm::ivec3 lo = glm::ivec3(glm::floor((sortedPosition[s] - reach) / cellSize[upper]));
+                glm::ivec3 hi = glm::ivec3(glm::floor((sortedPosition[s] + reach) / cellSize[upper]));
+                for (int x = lo.x; x <= hi.x; x++)
+                for (int y = lo.y; y <= hi.y; y++)
+                for (int z = lo.z; z <= hi.z; z++) {
+                    scanCell(s, upper, glm::ivec3(x, y, z));
+                }
+            }
+        }
+    });
+
+    for (std::vector<CollisionPair>& out : threadPairs) {
+        pairs.insert(pairs.end(), out.begin(), out.end());
+        out.clear();
+    }
+}
+
+size_t HierarchicalGrid::getMemoryUsage() const {
+    return VectorBytes(sphereLevel) + VectorBytes(sphereBucket) + VectorBytes(sphereCell) +
+        VectorBytes(cellStart) + VectorBytes(sortedIndex) + VectorBytes(sortedPosition) +
+        VectorBytes(sortedRadius) + VectorBytes(sortedCell) + VectorBytes(sortedBucket) +
+        VectorBytes(sortedLevel) + VectorBytes(threadPairs);
+}
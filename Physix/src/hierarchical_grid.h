@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "broadphase.h"
+
+// Hierarchical hash grid broadphase for spheres of widely different radii.
+// Level L has cells of size baseCellSize * 2^L, where the base size is the
+// smallest sphere diameter, and each sphere goes into the finest level whose
+// cells are at least its diameter. Pairs within a level use the half-shell
+// stencil. A pair across levels is found once, from the smaller sphere, by
+// checking the few cells around it on each coarser, occupied level. A sphere
+// never spans more than one cell, so cost stays flat as radii vary.
+class HierarchicalGrid : public Broadphase {
+public:
+    static const int MAX_LEVELS = 16;
+
+    HierarchicalGrid();
+
+    void Update(const std::vector<Sphere>& spheres) override;
+    void FindPairs(std::vector<CollisionPair>& pairs) override;
+    const char* getName() const override { return "HierarchicalGrid"; }
+    size_t getMemoryUsage() const override;
+
+    int getLevelCount() const { return levelCount; }
+    unsigned int getLevelPopulation(int level) const { return levelPopulation[level]; }
+    float getCellSize(int level) const { return cellSize[level]; }
+
+private:
+    float baseCellSize;
+    int levelCount;
+    unsigned int occupiedLevels;   // bit L set if level L holds any sphere
+
+    float cellSize[MAX_LEVELS];
+    unsigned int levelPopulation[MAX_LEVELS];
+    unsigned int tableSize[MAX_LEVELS];
+    unsigned int tableOffset[MAX_LEVELS];   // start of each level's buckets in cellStart
+
+    std::vector<unsigned char> sphereLevel;
+    std::vector<unsigned int> sphereBucket;
+    std::vector<glm::ivec3> sphereCell;
+
+    // All levels share one counting sort; bucket b of level L is global bucket tableOffset[L] + b.
+    std::vector<unsigned int> cellStart;
+    std::vector<unsigned int> sortedIndex;
+    std::vector<glm::vec3> sortedPosition;
+    std::vector<float> sortedRadius;
+    std::vector<glm::ivec3> sortedCell;
+    std::vector<unsigned int> sortedBucket;
+    std::vector<unsigned char> sortedLevel;
+
+    std::vector<std::vector<CollisionPair>> threadPairs;
+};
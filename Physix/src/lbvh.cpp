@@ -0,0 +1,295 @@
+#include "lbvh.h"
+#include "parallel.h"
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+    // Number of leading zero bits of a non-zero value.
+    inline int CountLeadingZeros(unsigned int value) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse(&index, value);
+        return 31 - static_cast<int>(index);
+#else
+        return __builtin_clz(value);
+#endif
+    }
+
+    // Spreads the low 10 bits of v so there are two zero bits between each.
+    inline unsigned int ExpandBits(unsigned int v) {
+        v = (v * 0x00010001u) & 0xFF0000FFu;
+        v = (v * 0x00000101u) & 0x0F00F00Fu;
+        v = (v * 0x00000011u) & 0xC30C30C3u;
+        v = (v * 0x00000005u) & 0x49249249u;
+        return v;
+    }
+
+    // 30-bit Morton code of a point in the unit cube.
+    inline unsigned int MortonCode(const glm::vec3& p) {
+        glm::vec3 q = glm::clamp(p * 1024.0f, glm::vec3(0.0f), glm::vec3(1023.0f));
+        return (ExpandBits(static_cast<unsigned int>(q.x)) << 2) |
+            (ExpandBits(static_cast<unsigned int>(q.y)) << 1) |
+            ExpandBits(static_cast<unsigned int>(q.z));
+    }
+}
+
+LBVH::LBVH() : visitCapacity(0), buildTime(0.0f) {
+    sceneBounds = { glm::vec3(0.0f), glm::vec3(0.0f) };
+}
+
+void LBVH::Update(const std::vector<Sphere>& spheres) {
+    auto start = std::chrono::steady_clock::now();
+
+    ComputeMortonCodes(spheres);
+    RadixSort();
+
+    // Gather leaf data in Morton order so traversal reads it sequentially.
+    size_t count = spheres.size();
+    leafBoxes.resize(count);
+    leafPositions.resize(count);
+    leafRadii.resize(count);
+    ParallelForRange(count, [&](size_t left, size_t right, unsigned int) {
+        for (size_t k = left; k < right; k++) {
+            const Sphere& s = spheres[leafOrder[k]];
+            float radius = ReachRadius(s);
+            leafPositions[k] = s.position;
+            leafRadii[k] = radius;
+            leafBoxes[k] = AABB::FromSphere(s.position, radius);
+        }
+    });
+
+    EmitHierarchy();
+    ComputeBounds();
+
+    auto end = std::chrono::steady_clock::now();
+    buildTime = std::chrono::duration<float, std::milli>(end - start).count();
+}
+
+void LBVH::ComputeMortonCodes(const std::vector<Sphere>& spheres) {
+    size_t count = spheres.size();
+    codes.resize(count);
+    leafOrder.resize(count);
+
+    // Scene bounds of the sphere centers, reduced per batch.
+    const float inf = std::numeric_limits<float>::max();
+    std::vector<AABB> batchBounds(NumWorkerThreads(), AABB{ glm::vec3(inf), glm::vec3(-inf) });
+    ParallelForRange(count, [&](size_t left, size_t right, unsigned int batch) {
+        AABB box = batchBounds[batch];
+        for (size_t i = left; i < right; i++) {
+            box.min = glm::min(box.min, spheres[i].position);
+            box.max = glm::max(box.max, spheres[i].position);
+        }
+        batchBounds[batch] = box;
+    });
+    sceneBounds = batchBounds[0];
+    for (const AABB& box : batchBounds) {
+        sceneBounds = Merge(sceneBounds, box);
+    }
+
+    glm::vec3 extent = glm::max(sceneBounds.max - sceneBounds.min, glm::vec3(1e-6f));
+    glm::vec3 invExtent = 1.0f / extent;
+    ParallelForRange(count, [&](size_t left, size_t right, unsigned int) {
+        for (size_t i = left; i < right; i++) {
+            codes[i] = MortonCode((spheres[i].position - sceneBounds.min) * invExtent);
+            leafOrder[i] = static_cast<unsigned int>(i);
+        }
+    });
+}
+
+void LBVH::RadixSort() {
+    size_t count = codes.size();
+    unsigned int num_batches = NumWorkerThreads();
+    sortKeys.resize(count);
+    sortValues.resize(count);
+
+    unsigned int* srcKeys = codes.data();
+    unsigned int* srcValues = leafOrder.data();
+    unsigned int* dstKeys = sortKeys.data();
+    unsigned int* dstValues = sortValues.data();
+
+    // Four stable 8-bit passes. The batch partition is identical in the histogram
+    // and scatter passes, so batch b writes exactly the slots it counted.
+    for (int shift = 0; shift < 32; shift += 8) {
+        histograms.assign(static_cast<size_t>(num_batches) * 256, 0);
+
+        ParallelForRange(count, [&](size_t left, size_t right, unsigned int batch) {
+            unsigned int* histogram = &histograms[static_cast<size_t>(batch) * 256];
+            for (size_t i = left; i < right; i++) {
+                histogram[(srcKeys[i] >> shift) & 0xFFu]++;
+            }
+        });
+
+        // Exclusive prefix sum, digit-major then batch, gives each batch its write cursor.
+        unsigned int sum = 0;
+        for (unsigned int digit = 0; digit < 256; digit++) {
+            for (unsigned int batch = 0; batch < num_batches; batch++) {
+                unsigned int& slot = histograms[static_cast<size_t>(batch) * 256 + digit];
+                unsigned int bucketCount = slot;
+                slot = sum;
+                sum += bucketCount;
+            }
+        }
+
+        ParallelForRange(count, [&](size_t left, size_t right, unsigned int batch) {
+            unsigned int* cursor = &histograms[static_cast<size_t>(batch) * 256];
+            for (size_t i = left; i < right; i++) {
+                unsigned int slot = cursor[(srcKeys[i] >> shift) & 0xFFu]++;
+                dstKeys[slot] = srcKeys[i];
+                dstValues[slot] = srcValues[i];
+            }
+        });
+
+        std::swap(srcKeys, dstKeys);
+        std::swap(srcValues, dstValues);
+    }
+    // An even number of passes leaves the result back in codes/leafOrder.
+}
+
+int LBVH::CommonPrefix(int i, int j) const {
+    int count = static_cast<int>(codes.size());
+    if (j < 0 || j >= count) return -1;
+    unsigned int a = codes[i];
+    unsigned int b = codes[j];
+    // Equal codes are told apart by their index, which is unique.
+    if (a == b) return 32 + CountLeadingZeros(static_cast<unsigned int>(i ^ j));
+    return CountLeadingZeros(a ^ b);
+}
+
+void LBVH::EmitHierarchy() {
+    int count = static_cast<int>(codes.size());
+    nodes.resize(count > 1 ? count - 1 : 0);
+    leafParent.assign(count, -1);
+    if (count < 2) return;
+    nodes[0].parent = -1;
+
+    // Karras 2012: every internal node finds its own range and split independently.
+    ParallelForRange(nodes.size(), [&](size_t left, size_t right, unsigned int) {
+        for (size_t n = left; n < right; n++) {
+            int i = static_cast<int>(n);
+
+            // Direction of the range: towards the neighbour with the longer common prefix.
+            int d = (CommonPrefix(i, i + 1) - CommonPrefix(i, i - 1)) > 0 ? 1 : -1;
+
+            // Upper bound for the range length, then binary search for the other end.
+            int minPrefix = CommonPrefix(i, i - d);
+            int maxLength = 2;
+            while (CommonPrefix(i, i + maxLength * d) > minPrefix) maxLength *= 2;
+            int length = 0;
+            for (int t = maxLength / 2; t >= 1; t /= 2) {
+                if (CommonPrefix(i, i + (length + t) * d) > minPrefix) length += t;
+            }
+            int j = i + length * d;
+
+            // Binary search for the split: the last leaf sharing more than the node prefix.
+            int nodePrefix = CommonPrefix(i, j);
+            int split = 0;
+            int t = length;
+            do {
+                t = (t + 1) / 2;
+                if (CommonPrefix(i, i + (split + t) * d) > nodePrefix) split += t;
+            } while (t > 1);
+            int gamma = i + split * d + std::min(d, 0);
+
+            LBVHNode& node = nodes[i];
+            node.first = std::min(i, j);
+            node.last = std::max(i, j);
+            node.left = (node.first == gamma) ? ~gamma : gamma;
+            node.right = (node.last == gamma + 1) ? ~(gamma + 1) : gamma + 1;
+
+            // Every node has exactly one parent, so these writes never collide.
+            if (node.left >= 0) nodes[node.left].parent = i;
+            else leafParent[gamma] = i;
+            if (node.right >= 0) nodes[node.right].parent = i;
+            else leafParent[gamma + 1] = i;
+        }
+    });
+}
+
+void LBVH::ComputeBounds() {
+    size_t internalCount = nodes.size();
+    if (internalCount == 0) return;
+
+    if (visitCapacity < internalCount) {
+        visitCapacity = internalCount;
+        visitCount.reset(new std::atomic<int>[visitCapacity]);
+    }
+    for (size_t i = 0; i < internalCount; i++) {
+        visitCount[i].store(0, std::memory_order_relaxed);
+    }
+
+    auto childBox = [&](int child) -> const AABB& {
+        return child >= 0 ? nodes[child].box : leafBoxes[~child];
+    };
+
+    // Each leaf walks towards the root; the second thread to reach a node has
+    // both children ready and computes its box, the first one stops there.
+    ParallelForRange(leafParent.size(), [&](size_t left, size_t right, unsigned int) {
+        for (size_t leaf = left; leaf < right; leaf++) {
+            int node = leafParent[leaf];
+            while (node != -1) {
+                if (visitCount[node].fetch_add(1, std::memory_order_acq_rel) == 0) break;
+                nodes[node].box = Merge(childBox(nodes[node].left), childBox(nodes[node].right));
+                node = nodes[node].parent;
+            }
+        }
+    });
+}
+
+void LBVH::FindPairs(std::vector<CollisionPair>& pairs) {
+    size_t count = leafOrder.size();
+    if (count < 2) return;
+    threadPairs.resize(NumWorkerThreads());
+
+    ParallelForRange(count, [&](size_t left, size_t right, unsigned int batch) {
+        std::vector<CollisionPair>& out = threadPairs[batch];
+        out.clear();
+
+        // Depth is bounded by the 30 code bits plus the index bits used on ties.
+        int stack[128];
+        for (size_t leaf = left; leaf < right; leaf++) {
+            int self = static_cast<int>(leaf);
+            const AABB& box = leafBoxes[leaf];
+            const glm::vec3& p = leafPositions[leaf];
+            float r = leafRadii[leaf];
+
+            int top = 0;
+            stack[top++] = 0;
+            while (top > 0) {
+                const LBVHNode& node = nodes[stack[--top]];
+                // Only leaves after this one, so each pair is reported once.
+                if (node.last <= self || !node.box.Overlaps(box)) continue;
+
+                int children[2] = { node.left, node.right };
+                for (int child : children) {
+                    if (child >= 0) {
+                        stack[top++] = child;
+                        continue;
+                    }
+                    int other = ~child;
+                    if (other <= self) continue;
+                    if (SpheresOverlap(p, r, leafPositions[other], leafRadii[other])) {
+                        unsigned int a = leafOrder[leaf];
+                        unsigned int b = leafOrder[other];
+                        out.push_back(a < b ? CollisionPair{ a, b } : CollisionPair{ b, a });
+                    }
+                }
+            }
+        }
+    });
+
+    for (std::vector<CollisionPair>& out : threadPairs) {
+        pairs.insert(pairs.end(), out.begin(), out.end());
+        out.clear();
+    }
+}
+
+size_t LBVH::getMemoryUsage() const {
+    return VectorBytes(codes) + VectorBytes(leafOrder) + VectorBytes(sortKeys) + VectorBytes(sortValues) +
+        VectorBytes(histograms) + VectorBytes(leafBoxes) + VectorBytes(leafPositions) +
+        VectorBytes(leafRadii) + VectorBytes(leafParent) + VectorBytes(nodes) +
+        visitCapacity * sizeof(std::atomic<int>) + VectorBytes(threadPairs);
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include "aabb.h"
+#include "broadphase.h"
+
+// Internal node of the linear BVH. A child index >= 0 is another internal node,
+// a negative child ~k is leaf k (the k-th sphere in Morton order).
+// Every node covers the contiguous leaf range [first, last].
+struct LBVHNode {
+    AABB box;
+    int left;
+    int right;
+    int parent;
+    int first;
+    int last;
+};
+
+// Linear BVH rebuilt from scratch every Update().
+// Spheres are sorted along a 30-bit Morton curve (parallel code computation and
+// parallel LSD radix sort), then every internal node is emitted independently
+// with Karras' split search and bounds are reduced bottom-up, all on the worker
+// pool. For chaotic scenes a fresh tree is cheaper than refitting a degraded one.
+class LBVH : public Broadphase {
+public:
+    LBVH();
+
+    void Update(const std::vector<Sphere>& spheres) override;
+    void FindPairs(std::vector<CollisionPair>& pairs) override;
+    const char* getName() const override { return "LBVH"; }
+    size_t getMemoryUsage() const override;
+
+    // Tree access for queries. Node 0 is the root when there are 2+ leaves.
+    const std::vector<LBVHNode>& getNodes() const { return nodes; }
+    size_t getLeafCount() const { return leafOrder.size(); }
+    // Sphere index and bounds of leaf k.
+    unsigned int getLeafBody(size_t leaf) const { return leafOrder[leaf]; }
+    const AABB& getLeafBox(size_t leaf) const { return leafBoxes[leaf]; }
+    const glm::vec3& getLeafPosition(size_t leaf) const { return leafPositions[leaf]; }
+    float getLeafRadius(size_t leaf) const { return leafRadii[leaf]; }
+    const AABB& getSceneBounds() const { return sceneBounds; }
+
+    // Calls callback(leaf) for every leaf whose box overlaps 'box'.
+    template <typename Callback>
+    void Query(const AABB& box, Callback callback) const;
+
+    // Wall-clock time of the last Update(), in milliseconds.
+    float getBuildTime() const { return buildTime; }
+
+private:
+    AABB sceneBounds;
+    std::vector<unsigned int> codes;
+    std::vector<unsigned int> leafOrder;
+    std::vector<unsigned int> sortKeys;
+    std::vector<unsigned int> sortValues;
+    std::vector<unsigned int> histograms;
+
+    std::vector<AABB> leafBoxes;
+    std::vector<glm::vec3> leafPositions;
+    std::vector<float> leafRadii;
+    std::vector<int> leafParent;
+    std::vector<LBVHNode> nodes;
+    std::unique_ptr<std::atomic<int>[]> visitCount;
+    size_t visitCapacity;
+    float buildTime;
+
+    std::vector<std::vector<CollisionPair>> threadPairs;
+
+    void ComputeMortonCodes(const std::vector<Sphere>& spheres);
+    void RadixSort();
+    void EmitHierarchy();
+    void ComputeBounds();
+    // Length of the common prefix of leaves i and j, or -1 when j is out of range.
+    int CommonPrefix(int i, int j) const;
+};
+
+template <typename Callback>
+void LBVH::Query(const AABB& box, Callback callback) const {
+    if (nodes.empty()) {
+        // A single sphere has no internal node.
+        if (leafOrder.size() == 1 && leafBoxes[0].Overlaps(box)) callback(0);
+        return;
+    }
+
+    int stack[128];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const LBVHNode& node = nodes[stack[--top]];
+        if (!node.box.Overlaps(box)) continue;
+
+        int children[2] = { node.left, node.right };
+        for (int child : children) {
+            if (child >= 0) stack[top++] = child;
+            else if (leafBoxes[~child].Overlaps(box)) callback(~child);
+        }
+    }
+}
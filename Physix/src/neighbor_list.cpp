@@ -0,0 +1,119 @@
+#include "neighbor_list.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+
+NeighborList::NeighborList(float skin)
+    : skin(skin), dirty(true), grid(skin), rebuildCount(0), updateCount(0) {
+}
+
+void NeighborList::setSkin(float newSkin) {
+    skin = newSkin;
+    grid.setMargin(newSkin);
+    dirty = true;
+}
+
+float NeighborList::getRebuildFrequency() const {
+    if (updateCount == 0) return 0.0f;
+    return static_cast<float>(rebuildCount) / static_cast<float>(updateCount);
+}
+
+void NeighborList::ResetStats() {
+    rebuildCount = 0;
+    updateCount = 0;
+}
+
+bool NeighborList::NeedsRebuild(const std::vector<Sphere>& spheres) const {
+    if (dirty || spheres.size() != referencePositions.size()) return true;
+
+    // Two spheres can only close the skin if one of them moved, or grew, by more
+    // than half of it.
+    float limit = 0.5f * skin;
+    std::atomic<bool> moved(false);
+    ParallelForRange(spheres.size(), [&](size_t left, size_t right, unsigned int) {
+        for (size_t i = left; i < right && !moved.load(std::memory_order_relaxed); i++) {
+            glm::vec3 d = spheres[i].position - referencePositions[i];
+            float margin = limit - std::max(0.0f, ReachRadius(spheres[i]) - referenceRadii[i]);
+            if (margin < 0.0f || glm::dot(d, d) > margin * margin) {
+                moved.store(true, std::memory_order_relaxed);
+            }
+        }
+    }, 4096);
+    return moved.load();
+}
+
+void NeighborList::Rebuild(const std::vector<Sphere>& spheres) {
+    size_t count = spheres.size();
+
+    buildPairs.clear();
+    grid.setSpeculativeTime(speculativeTime);
+    grid.Update(spheres);
+    grid.FindPairs(buildPairs);
+
+    // Counting sort of the pairs by their first body into CSR arrays.
+    offsets.assign(count + 1, 0);
+    for (const CollisionPair& pair : buildPairs) {
+        offsets[pair.a + 1]++;
+    }
+    for (size_t i = 0; i < count; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+    neighbors.resize(buildPairs.size());
+    std::vector<unsigned int> cursor(offsets.begin(), offsets.end() - 1);
+    for (const CollisionPair& pair : buildPairs) {
+        neighbors[cursor[pair.a]++] = pair.b;
+    }
+
+    referencePositions.resize(count);
+    referenceRadii.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        referencePositions[i] = spheres[i].position;
+        referenceRadii[i] = ReachRadius(spheres[i]);
+    }
+    dirty = false;
+    rebuildCount++;
+}
+
+void NeighborList::Update(const std::vector<Sphere>& spheres) {
+    updateCount++;
+    bool rebuild = NeedsRebuild(spheres);
+
+    size_t count = spheres.size();
+    positions.resize(count);
+    radii.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        positions[i] = spheres[i].position;
+        radii[i] = ReachRadius(spheres[i]);
+    }
+
+    if (rebuild) Rebuild(spheres);
+}
+
+void NeighborList::FindPairs(std::vector<CollisionPair>& pairs) {
+    size_t count = positions.size();
+    threadPairs.resize(NumWorkerThreads());
+
+    ParallelForRange(count, [&](size_t left, size_t right, unsigned int thread_id) {
+        std::vector<CollisionPair>& out = threadPairs[thread_id];
+        out.clear();
+        for (size_t i = left; i < right; i++) {
+            for (unsigned int k = offsets[i]; k < offsets[i + 1]; k++) {
+                unsigned int j = neighbors[k];
+                if (SpheresOverlap(positions[i], radii[i], positions[j], radii[j])) {
+                    out.push_back({ static_cast<unsigned int>(i), j });
+                }
+            }
+        }
+    });
+
+    for (std::vector<CollisionPair>& out : threadPairs) {
+        pairs.insert(pairs.end(), out.begin(), out.end());
+        out.clear();
+    }
+}
+
+size_t NeighborList::getMemoryUsage() const {
+    return grid.getMemoryUsage() + VectorBytes(offsets) + VectorBytes(neighbors) +
+        VectorBytes(referencePositions) + VectorBytes(referenceRadii) + VectorBytes(positions) + VectorBytes(radii) +
+        VectorBytes(buildPairs) + VectorBytes(threadPairs);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "broadphase.h"
+#include "hash_grid.h"
+
+// Verlet neighbour lists reused across substeps and frames.
+// Each sphere keeps the spheres within r1 + r2 + skin of it, stored as flat CSR
+// arrays (neighbours of i are neighbors[offsets[i] .. offsets[i + 1]), only j > i).
+// The lists stay valid until some sphere has moved more than half the skin since
+// the last build. Until then Update() only refreshes positions, and FindPairs()
+// tests just the listed neighbours. With a speculative time, growing reach counts
+// as moving.
+class NeighborList : public Broadphase {
+public:
+    NeighborList(float skin = 0.5f);
+
+    void Update(const std::vector<Sphere>& spheres) override;
+    void FindPairs(std::vector<CollisionPair>& pairs) override;
+    const char* getName() const override { return "NeighborList"; }
+    size_t getMemoryUsage() const override;
+
+    float getSkin() const { return skin; }
+    void setSkin(float newSkin);
+
+    size_t getRebuildCount() const { return rebuildCount; }
+    size_t getUpdateCount() const { return updateCount; }
+    // Fraction of Update() calls that rebuilt the lists; use it to tune the skin.
+    float getRebuildFrequency() const;
+    void ResetStats();
+
+private:
+    float skin;
+    bool dirty;
+    HashGrid grid;
+
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> neighbors;
+    std::vector<glm::vec3> referencePositions;
+    std::vector<float> referenceRadii;
+    std::vector<glm::vec3> positions;
+    std::vector<float> radii;
+    std::vector<CollisionPair> buildPairs;
+    std::vector<std::vector<CollisionPair>> threadPairs;
+
+    size_t rebuildCount;
+    size_t updateCount;
+
+    bool NeedsRebuild(const std::vector<Sphere>& spheres) const;
+    void Rebuild(const std::vector<Sphere>& spheres);
+};
@@ -0,0 +1,121 @@
+#include "pair_cache.h"
+
+PairCache::PairCache(size_t initialCapacity)
+    : count(0), generation(0) {
+    size_t capacity = 16;
+    while (capacity < initialCapacity) capacity *= 2;
+    slots.assign(capacity, PairCacheEntry{ 0, 0, 0, 0 });
+}
+
+size_t PairCache::HomeSlot(unsigned int a, unsigned int b) const {
+    // Fibonacci hashing of the 64-bit key; the high half is the well mixed one.
+    unsigned long long key = (static_cast<unsigned long long>(a) << 32) | b;
+    key *= 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>(key >> 32) & (slots.size() - 1);
+}
+
+// Index of the slot holding (a, b), or of the empty slot where it would go.
+size_t PairCache::Probe(unsigned int a, unsigned int b) const {
+    size_t mask = slots.size() - 1;
+    size_t slot = HomeSlot(a, b);
+    while (slots[slot].generation != 0 && (slots[slot].a != a || slots[slot].b != b)) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Backward-shift deletion: entries after the hole are moved up if their probe
+// sequence passes through it, so lookups never need tombstones.
+void PairCache::Erase(size_t slot) {
+    size_t mask = slots.size() - 1;
+    size_t hole = slot;
+    size_t next = (hole + 1) & mask;
+    while (slots[next].generation != 0) {
+        size_t home = HomeSlot(slots[next].a, slots[next].b);
+        // Distance from home to the hole versus from home to the entry, cyclically.
+        if (((hole - home) & mask) < ((next - home) & mask)) {
+            slots[hole] = slots[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    slots[hole].generation = 0;
+    count--;
+}
+
+void PairCache::Rehash(size_t capacity) {
+    std::vector<PairCacheEntry> old;
+    old.swap(slots);
+    slots.assign(capacity, PairCacheEntry{ 0, 0, 0, 0 });
+    for (const PairCacheEntry& entry : old) {
+        if (entry.generation != 0) slots[Probe(entry.a, entry.b)] = entry;
+    }
+}
+
+void PairCache::Update(const std::vector<CollisionPair>& pairs) {
+    beginPairs.clear();
+    persistPairs.clear();
+    endPairs.clear();
+
+    generation++;
+    if (generation == 0) {
+        // The counter wrapped: restamp the live pairs so 0 still means empty.
+        for (PairCacheEntry& entry : slots) {
+            if (entry.generation != 0) entry.generation = 1;
+        }
+        generation = 2;
+    }
+
+    // Keep the load factor at or below one half, even if every pair is new.
+    size_t capacity = slots.size();
+    while (2 * (count + pairs.size()) > capacity) capacity *= 2;
+    if (capacity != slots.size()) Rehash(capacity);
+
+    for (const CollisionPair& pair : pairs) {
+        PairCacheEntry& entry = slots[Probe(pair.a, pair.b)];
+        if (entry.generation == 0) {
+            entry = PairCacheEntry{ pair.a, pair.b, generation, 0 };
+            count++;
+            beginPairs.push_back(pair);
+        }
+        else if (entry.generation != generation) {
+            entry.generation = generation;
+            persistPairs.push_back(pair);
+        }
+    }
+
+    // Pairs that were not stamped this step have ended.
+    for (const PairCacheEntry& entry : slots) {
+        if (entry.generation != 0 && entry.generation != generation) {
+            endPairs.push_back({ entry.a, entry.b });
+        }
+    }
+    for (const CollisionPair& pair : endPairs) {
+        Erase(Probe(pair.a, pair.b));
+    }
+}
+
+void PairCache::Clear() {
+    for (PairCacheEntry& entry : slots) {
+        entry.generation = 0;
+    }
+    count = 0;
+    beginPairs.clear();
+    persistPairs.clear();
+    endPairs.clear();
+}
+
+PairCacheEntry* PairCache::Find(unsigned int a, unsigned int b) {
+    PairCacheEntry& entry = slots[Probe(a, b)];
+    return entry.generation != 0 ? &entry : nullptr;
+}
+
+const PairCacheEntry* PairCache::Find(unsigned int a, unsigned int b) const {
+    const PairCacheEntry& entry = slots[Probe(a, b)];
+    return entry.generation != 0 ? &entry : nullptr;
+}
+
+size_t PairCache::getMemoryUsage() const {
+    return slots.capacity() * sizeof(PairCacheEntry) +
+        (beginPairs.capacity() + persistPairs.capacity() + endPairs.capacity()) * sizeof(CollisionPair);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <vector>
+#include "broadphase.h"
+
+// Slot of the pair cache. generation is the last step the pair was reported in
+// (0 marks an empty slot). userData is free for solvers and game logic; it is
+// zeroed when the pair begins and kept for as long as the pair persists.
+struct PairCacheEntry {
+    unsigned int a;
+    unsigned int b;
+    unsigned int generation;
+    unsigned int userData;
+};
+
+// Persistent set of overlapping body pairs, carried across steps.
+// Pairs are stored in an open-addressing hash table (linear probing, power of two
+// capacity) keyed by (a, b). Every Update() stamps the reported pairs with the
+// current generation; pairs that were not stamped have ended and are removed.
+// The pairs of each step are classified into begin / persist / end batches.
+class PairCache {
+public:
+    PairCache(size_t initialCapacity = 1024);
+
+    // Feeds the pairs found this step (a < b, each at most once) and refills the event batches.
+    void Update(const std::vector<CollisionPair>& pairs);
+    void Clear();
+
+    // Returns the entry of a live pair, or nullptr if the pair is not in the cache.
+    PairCacheEntry* Find(unsigned int a, unsigned int b);
+    const PairCacheEntry* Find(unsigned int a, unsigned int b) const;
+
+    // Event batches of the last Update().
+    const std::vector<CollisionPair>& getBeginPairs() const { return beginPairs; }
+    const std::vector<CollisionPair>& getPersistPairs() const { return persistPairs; }
+    const std::vector<CollisionPair>& getEndPairs() const { return endPairs; }
+
+    size_t getPairCount() const { return count; }
+    size_t getCapacity() const { return slots.size(); }
+    unsigned int getGeneration() const { return generation; }
+    size_t getMemoryUsage() const;
+
+private:
+    std::vector<PairCacheEntry> slots;
+    size_t count;
+    unsigned int generation;
+
+    std::vector<CollisionPair> beginPairs;
+    std::vector<CollisionPair> persistPairs;
+    std::vector<CollisionPair> endPairs;
+
+    size_t HomeSlot(unsigned int a, unsigned int b) const;
+    size_t Probe(unsigned int a, unsigned int b) const;
+    void Erase(size_t slot);
+    void Rehash(size_t capacity);
+};
@@ -0,0 +1,87 @@
+#include "parallel.h"
+
+namespace {
+    thread_local bool isWorkerThread = false;
+}
+
+WorkerPool& WorkerPool::Get() {
+    static WorkerPool pool(NumWorkerThreads() - 1);
+    return pool;
+}
+
+WorkerPool::WorkerPool(unsigned int workerCount)
+    : job(nullptr), batchCount(0), nextBatch(0), finished(0), active(0), generation(0), stopping(false) {
+    for (unsigned int i = 0; i < workerCount; i++) {
+        workers.emplace_back(&WorkerPool::WorkerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : workers) {
+        t.join();
+    }
+}
+
+bool WorkerPool::IsWorkerThread() {
+    return isWorkerThread;
+}
+
+void WorkerPool::Run(size_t count, const std::function<void(size_t)>& task) {
+    // One job at a time; other callers queue up here.
+    std::lock_guard<std::mutex> runLock(runMutex);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        // A worker that woke late for the previous job may still be leaving Drain().
+        done.wait(lock, [&] { return active == 0; });
+        job = &task;
+        batchCount = count;
+        nextBatch.store(0);
+        finished = 0;
+        generation++;
+    }
+    wake.notify_all();
+
+    Drain();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return finished == batchCount && active == 0; });
+    job = nullptr;
+}
+
+void WorkerPool::Drain() {
+    size_t batch;
+    while ((batch = nextBatch.fetch_add(1)) < batchCount) {
+        (*job)(batch);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (++finished == batchCount) done.notify_all();
+    }
+}
+
+void WorkerPool::WorkerLoop() {
+    isWorkerThread = true;
+    unsigned long long seen = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            active++;
+        }
+
+        Drain();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            active--;
+        }
+        done.notify_all();
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Number of worker threads used by the physics step.
+// Falls back to 10 (the original fixed thread count) if the hardware query fails.
+inline unsigned int NumWorkerThreads() {
+    unsigned int count = std::thread::hardware_concurrency();
+    return count == 0 ? 10u : count;
+}
+
+// Persistent pool of worker threads. Spawning threads on every call costs more
+// than a whole broadphase build at the sizes we run, so the workers are created
+// once and woken for each job. The calling thread takes part in every job.
+class WorkerPool {
+public:
+    static WorkerPool& Get();
+    ~WorkerPool();
+
+    // Runs job(batch) for every batch in [0, batchCount) and blocks until all are done.
+    void Run(size_t batchCount, const std::function<void(size_t)>& job);
+
+    // True on a pool worker; nested Run() calls from a job execute inline.
+    static bool IsWorkerThread();
+
+private:
+    WorkerPool(unsigned int workerCount);
+    void WorkerLoop();
+    void Drain();
+
+    std::vector<std::thread> workers;
+    std::mutex runMutex;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const std::function<void(size_t)>* job;
+    size_t batchCount;
+    std::atomic<size_t> nextBatch;
+    size_t finished;
+    int active;
+    unsigned long long generation;
+    bool stopping;
+};
+
+// Splits [0, count) into contiguous batches, at most one per worker thread, and
+// runs body(begin, end, batch) on each batch. Blocks until every batch is done.
+// 'batch' is below NumWorkerThreads(), so it can index per-thread buffers.
+// Small ranges run inline on the calling thread.
+template <typename Func>
+void ParallelForRange(size_t count, Func body, size_t minBatch = 256) {
+    if (count == 0) return;
+    size_t num_batches = std::min<size_t>(NumWorkerThreads(), (count + minBatch - 1) / minBatch);
+    if (num_batches <= 1 || WorkerPool::IsWorkerThread()) {
+        body(size_t(0), count, 0u);
+        return;
+    }
+
+    size_t batch_size = (count + num_batches - 1) / num_batches;
+    WorkerPool::Get().Run(num_batches, [&](size_t batch) {
+        size_t left = batch_size * batch;
+        size_t right = std::min(count, left + batch_size);
+        if (left < right) body(left, right, static_cast<unsigned int>(batch));
+    });
+}
@@ -0,0 +1,355 @@
+#include "raycast.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+
+namespace {
+    // Lane value of a packet slot that has not hit anything.
+    const int NO_HIT = 0x7FFFFFFF;
+    // Entries of the fixed traversal stack; deeper static trees spill to the heap.
+    const unsigned int PACKET_STACK_SIZE = 128;
+
+    // Four rays in SoA form. Empty lanes have tMax = -1, so they never hit.
+    struct RayPacket {
+        __m128 ox, oy, oz;
+        __m128 dx, dy, dz;
+        __m128 ix, iy, iz;    // 1 / direction
+        __m128 tMax;          // distance to the closest hit so far
+        __m128i hit;          // leaf k for a sphere, ~k for Cuboid k, NO_HIT otherwise
+    };
+
+    // Stack entry of a packet traversal: a node and the distance at which each lane enters it.
+    struct PacketStackEntry {
+        __m128 entry;
+        int node;
+    };
+
+    inline __m128 Select(__m128 mask, __m128 a, __m128 b) {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    inline __m128i Select(__m128 mask, __m128i a, __m128i b) {
+        __m128i m = _mm_castps_si128(mask);
+        return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b));
+    }
+
+    // Keeps direction components away from zero, so the slab test never computes 0 * inf.
+    inline __m128 NonZero(__m128 d) {
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+        __m128 magnitude = _mm_max_ps(_mm_andnot_ps(signMask, d), _mm_set1_ps(1e-20f));
+        return _mm_or_ps(magnitude, _mm_and_ps(signMask, d));
+    }
+
+    // Slab test against a box. Returns the lanes that enter it before their tMax;
+    // 'entry' receives the entry distances.
+    inline __m128 PacketBoxHit(const RayPacket& p, const glm::vec3& lo, const glm::vec3& hi, __m128& entry) {
+        __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(lo.x), p.ox), p.ix);
+        __m128 tx2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(hi.x), p.ox), p.ix);
+        __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(lo.y), p.oy), p.iy);
+        __m128 ty2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(hi.y), p.oy), p.iy);
+        __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(lo.z), p.oz), p.iz);
+        __m128 tz2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(hi.z), p.oz), p.iz);
+
+        __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx1, tx2), _mm_min_ps(ty1, ty2)),
+            _mm_max_ps(_mm_min_ps(tz1, tz2), _mm_setzero_ps()));
+        __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx1, tx2), _mm_max_ps(ty1, ty2)),
+            _mm_min_ps(_mm_max_ps(tz1, tz2), p.tMax));
+        entry = tNear;
+        return _mm_cmple_ps(tNear, tFar);
+    }
+
+    inline void PacketSphereHit(RayPacket& p, const glm::vec3& center, float radius, int id) {
+        __m128 ocx = _mm_sub_ps(p.ox, _mm_set1_ps(center.x));
+        __m128 ocy = _mm_sub_ps(p.oy, _mm_set1_ps(center.y));
+        __m128 ocz = _mm_sub_ps(p.oz, _mm_set1_ps(center.z));
+        __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, p.dx), _mm_mul_ps(ocy, p.dy)), _mm_mul_ps(ocz, p.dz));
+        __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocx, ocx), _mm_mul_ps(ocy, ocy)), _mm_mul_ps(ocz, ocz)),
+            _mm_set1_ps(radius * radius));
+        __m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), c);
+
+        __m128 t = _mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), b), _mm_sqrt_ps(_mm_max_ps(disc, _mm_setzero_ps())));
+        // Rays starting inside the sphere hit it right away.
+        t = Select(_mm_cmplt_ps(c, _mm_setzero_ps()), _mm_setzero_ps(), t);
+
+        __m128 hit = _mm_and_ps(_mm_cmpge_ps(disc, _mm_setzero_ps()),
+            _mm_and_ps(_mm_cmpge_ps(t, _mm_setzero_ps()), _mm_cmplt_ps(t, p.tMax)));
+        p.tMax = Select(hit, t, p.tMax);
+        p.hit = Select(hit, _mm_set1_epi32(id), p.hit);
+    }
+
+    // Slab test in the Cuboid's local frame, where it is an axis-aligned box.
+    inline void PacketCuboidHit(RayPacket& p, const glm::vec3& center, const glm::mat3& rotation,
+        const glm::vec3& halfExtents, int id) {
+        __m128 rx = _mm_sub_ps(p.ox, _mm_set1_ps(center.x));
+        __m128 ry = _mm_sub_ps(p.oy, _mm_set1_ps(center.y));
+        __m128 rz = _mm_sub_ps(p.oz, _mm_set1_ps(center.z));
+
+        __m128 tNear = _mm_setzero_ps();
+        __m128 tFar = p.tMax;
+        for (int axis = 0; axis < 3; axis++) {
+            // Local coordinates are the projections onto the rotated axes.
+            const glm::vec3& u = rotation[axis];
+            __m128 ux = _mm_set1_ps(u.x), uy = _mm_set1_ps(u.y), uz = _mm_set1_ps(u.z);
+            __m128 o = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, ux), _mm_mul_ps(ry, uy)), _mm_mul_ps(rz, uz));
+            __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p.dx, ux), _mm_mul_ps(p.dy, uy)), _mm_mul_ps(p.dz, uz));
+            __m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), NonZero(d));
+            __m128 h = _mm_set1_ps(halfExtents[axis]);
+
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(_mm_setzero_ps(), h), o), inv);
+            __m128 t2 = _mm_mul_ps(_mm_sub_ps(h, o), inv);
+            tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+            tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+        }
+
+        __m128 hit = _mm_and_ps(_mm_cmple_ps(tNear, tFar), _mm_cmplt_ps(tNear, p.tMax));
+        p.tMax = Select(hit, tNear, p.tMax);
+        p.hit = Select(hit, _mm_set1_epi32(~id), p.hit);
+    }
+
+    // Spreads the low 'bits' bits of v so that there are two zero bits between each.
+    unsigned int SpreadBits(unsigned int v, int bits) {
+        unsigned int result = 0;
+        for (int k = 0; k < bits; k++) {
+            result |= ((v >> k) & 1u) << (3 * k);
+        }
+        return result;
+    }
+
+    unsigned int Quantize(float value, float lo, float hi, unsigned int levels) {
+        float t = hi > lo ? (value - lo) / (hi - lo) : 0.0f;
+        return static_cast<unsigned int>(std::min(std::max(t, 0.0f), 1.0f) * (levels - 1) + 0.5f);
+    }
+}
+
+Raycaster::Raycaster()
+    : staticWorld(nullptr) {
+}
+
+void Raycaster::SetStatic(const std::vector<Cuboid>& cuboids, const StaticBVH& world) {
+    staticWorld = &world;
+    cuboidFrames.resize(cuboids.size());
+    for (size_t i = 0; i < cuboids.size(); i++) {
+        const CuboidCollider& collider = cuboids[i].getCollider();
+        cuboidFrames[i].center = collider.center;
+        cuboidFrames[i].rotation = collider.rotation;
+        cuboidFrames[i].halfExtents = collider.halfExtents;
+    }
+}
+
+void Raycaster::Update(const std::vector<Sphere>& spheres) {
+    sphereTree.Update(spheres);
+}
+
+void Raycaster::CastPacket(const Ray* const* rays, RaycastHit* const* hits) const {
+    alignas(16) float ox[PACKET_SIZE], oy[PACKET_SIZE], oz[PACKET_SIZE];
+    alignas(16) float dx[PACKET_SIZE], dy[PACKET_SIZE], dz[PACKET_SIZE];
+    alignas(16) float tMax[PACKET_SIZE];
+    for (int k = 0; k < PACKET_SIZE; k++) {
+        // Empty lanes copy lane 0, so they follow the same path but never hit.
+        const Ray& ray = rays[k] ? *rays[k] : *rays[0];
+        ox[k] = ray.origin.x; oy[k] = ray.origin.y; oz[k] = ray.origin.z;
+        dx[k] = ray.direction.x; dy[k] = ray.direction.y; dz[k] = ray.direction.z;
+        tMax[k] = rays[k] ? ray.maxDistance : -1.0f;
+    }
+
+    RayPacket p;
+    p.ox = _mm_load_ps(ox); p.oy = _mm_load_ps(oy); p.oz = _mm_load_ps(oz);
+    p.dx = _mm_load_ps(dx); p.dy = _mm_load_ps(dy); p.dz = _mm_load_ps(dz);
+    p.ix = _mm_div_ps(_mm_set1_ps(1.0f), NonZero(p.dx));
+    p.iy = _mm_div_ps(_mm_set1_ps(1.0f), NonZero(p.dy));
+    p.iz = _mm_div_ps(_mm_set1_ps(1.0f), NonZero(p.dz));
+    p.tMax = _mm_load_ps(tMax);
+    p.hit = _mm_set1_epi32(NO_HIT);
+
+    PacketStackEntry stack[PACKET_STACK_SIZE];
+    int top;
+    __m128 entry;
+
+    // Spheres: the children of a node are tested before they are pushed, nearer
+    // one last so it is popped first. A popped node is skipped if every lane has
+    // since found a hit closer than its entry distance.
+    const std::vector<LBVHNode>& nodes = sphereTree.getNodes();
+    size_t leafCount = sphereTree.getLeafCount();
+    if (leafCount == 1) {
+        PacketSphereHit(p, sphereTree.getLeafPosition(0), sphereTree.getLeafRadius(0), 0);
+    }
+    else if (leafCount > 1 && _mm_movemask_ps(PacketBoxHit(p, nodes[0].box.min, nodes[0].box.max, entry))) {
+        top = 0;
+        stack[top++] = { entry, 0 };
+        while (top > 0) {
+            PacketStackEntry current = stack[--top];
+            if (!_mm_movemask_ps(_mm_cmple_ps(current.entry, p.tMax))) continue;
+            const LBVHNode& node = nodes[current.node];
+
+            int children[2] = { node.left, node.right };
+            __m128 childEntry[2];
+            int childMask[2] = { 0, 0 };
+            for (int c = 0; c < 2; c++) {
+                if (children[c] < 0) {
+                    int leaf = ~children[c];
+                    PacketSphereHit(p, sphereTree.getLeafPosition(leaf), sphereTree.getLeafRadius(leaf), leaf);
+                    continue;
+                }
+                const AABB& box = nodes[children[c]].box;
+                childMask[c] = _mm_movemask_ps(PacketBoxHit(p, box.min, box.max, childEntry[c]));
+            }
+
+            // Visit first the child the packet enters earlier on average.
+            int first = 0;
+            if (childMask[0] && childMask[1]) {
+                alignas(16) float e0[PACKET_SIZE], e1[PACKET_SIZE];
+                _mm_store_ps(e0, childEntry[0]);
+                _mm_store_ps(e1, childEntry[1]);
+                float sum0 = 0.0f, sum1 = 0.0f;
+                for (int k = 0; k < PACKET_SIZE; k++) {
+                    sum0 += e0[k];
+                    sum1 += e1[k];
+                }
+                if (sum1 < sum0) first = 1;
+            }
+            if (childMask[1 - first]) stack[top++] = { childEntry[1 - first], children[1 - first] };
+            if (childMask[first]) stack[top++] = { childEntry[first], children[first] };
+        }
+    }
+
+    // Cuboids: same walk over the depth-first StaticBVH.
+    const std::vector<StaticBVHNode>* staticNodes = staticWorld ? &staticWorld->getNodes() : nullptr;
+    if (staticNodes && !staticNodes->empty() &&
+        _mm_movemask_ps(PacketBoxHit(p, (*staticNodes)[0].min, (*staticNodes)[0].max, entry))) {
+        // Each level pushes at most two children.
+        std::vector<PacketStackEntry> heapStack;
+        PacketStackEntry* staticStack = stack;
+        if (2 * staticWorld->getDepth() + 1 > PACKET_STACK_SIZE) {
+            heapStack.resize(2 * static_cast<size_t>(staticWorld->getDepth()) + 1);
+            staticStack = heapStack.data();
+        }
+        top = 0;
+        staticStack[top++] = { entry, 0 };
+        while (top > 0) {
+            PacketStackEntry current = staticStack[--top];
+            if (!_mm_movemask_ps(_mm_cmple_ps(current.entry, p.tMax))) continue;
+            int index = current.node;
+            const StaticBVHNode& node = (*staticNodes)[index];
+
+            if (node.count > 0) {
+                for (unsigned int k = node.offset; k < node.offset + node.count; k++) {
+                    unsigned int item = staticWorld->getItem(k);
+                    const CuboidFrame& frame = cuboidFrames[item];
+                    PacketCuboidHit(p, frame.center, frame.rotation, frame.halfExtents, static_cast<int>(item));
+                }
+                continue;
+            }
+
+            int children[2] = { index + 1, static_cast<int>(node.offset) };
+            for (int c = 1; c >= 0; c--) {
+                const StaticBVHNode& child = (*staticNodes)[children[c]];
+                if (_mm_movemask_ps(PacketBoxHit(p, child.min, child.max, entry))) {
+                    staticStack[top++] = { entry, children[c] };
+                }
+            }
+        }
+    }
+
+    alignas(16) float distance[PACKET_SIZE];
+    alignas(16) int hitId[PACKET_SIZE];
+    _mm_store_ps(distance, p.tMax);
+    _mm_store_si128(reinterpret_cast<__m128i*>(hitId), p.hit);
+
+    for (int k = 0; k < PACKET_SIZE; k++) {
+        if (!rays[k]) continue;
+        const Ray& ray = *rays[k];
+        RaycastHit& hit = *hits[k];
+        hit.distance = distance[k];
+        hit.normal = -ray.direction;
+        if (hitId[k] == NO_HIT) {
+            hit.type = RaycastHitType::None;
+            hit.body = 0;
+            hit.distance = ray.maxDistance;
+            continue;
+        }
+
+        glm::vec3 point = ray.origin + hit.distance * ray.direction;
+        if (hitId[k] >= 0) {
+            hit.type = RaycastHitType::Sphere;
+            hit.body = sphereTree.getLeafBody(hitId[k]);
+            glm::vec3 offset = point - sphereTree.getLeafPosition(hitId[k]);
+            if (hit.distance > 0.0f && glm::dot(offset, offset) > 0.0f) hit.normal = glm::normalize(offset);
+        }
+        else {
+            hit.type = RaycastHitType::Cuboid;
+            hit.body = static_cast<unsigned int>(~hitId[k]);
+            if (hit.distance > 0.0f) {
+                // The face hit is the one whose slab the ray entered last.
+                const CuboidFrame& frame = cuboidFrames[hit.body];
+                glm::vec3 local = glm::transpose(frame.rotation) * (point - frame.center);
+                glm::vec3 depth = frame.halfExtents - glm::abs(local);
+                int axis = depth.x < depth.y ? (depth.x < depth.z ? 0 : 2) : (depth.y < depth.z ? 1 : 2);
+                hit.normal = frame.rotation[axis] * (local[axis] < 0.0f ? -1.0f : 1.0f);
+            }
+        }
+    }
+}
+
+bool Raycaster::Cast(const Ray& ray, RaycastHit& hit) const {
+    const Ray* rays[PACKET_SIZE] = { &ray, nullptr, nullptr, nullptr };
+    RaycastHit* hits[PACKET_SIZE] = { &hit, nullptr, nullptr, nullptr };
+    CastPacket(rays, hits);
+    return hit.type != RaycastHitType::None;
+}
+
+size_t Raycaster::CastBatch(const Ray* rays, size_t count, RaycastHit* hits) {
+    if (count == 0) return 0;
+
+    // Sort key: direction octant, then a coarse Morton code of the origin, then of
+    // the direction, so neighbouring rays start close together and point the same way.
+    glm::vec3 lo = rays[0].origin, hi = rays[0].origin;
+    for (size_t i = 1; i < count; i++) {
+        lo = glm::min(lo, rays[i].origin);
+        hi = glm::max(hi, rays[i].origin);
+    }
+    sortKeys.resize(count);
+    ParallelForRange(count, [&](size_t left, size_t right, unsigned int) {
+        for (size_t i = left; i < right; i++) {
+            const glm::vec3& o = rays[i].origin;
+            const glm::vec3& d = rays[i].direction;
+            unsigned int octant = (d.x < 0.0f ? 4u : 0u) | (d.y < 0.0f ? 2u : 0u) | (d.z < 0.0f ? 1u : 0u);
+            unsigned int origin = (SpreadBits(Quantize(o.x, lo.x, hi.x, 32), 5) << 2) |
+                (SpreadBits(Quantize(o.y, lo.y, hi.y, 32), 5) << 1) | SpreadBits(Quantize(o.z, lo.z, hi.z, 32), 5);
+            unsigned int direction = (SpreadBits(Quantize(d.x, -1.0f, 1.0f, 16), 4) << 2) |
+                (SpreadBits(Quantize(d.y, -1.0f, 1.0f, 16), 4) << 1) | SpreadBits(Quantize(d.z, -1.0f, 1.0f, 16), 4);
+            unsigned long long key = (octant << 27) | (origin << 12) | direction;
+            sortKeys[i] = (key << 32) | i;
+        }
+    }, 4096);
+    std::sort(sortKeys.begin(), sortKeys.end());
+
+    size_t packetCount = (count + PACKET_SIZE - 1) / PACKET_SIZE;
+    threadHits.assign(NumWorkerThreads(), 0);
+    ParallelForRange(packetCount, [&](size_t left, size_t right, unsigned int batch) {
+        const Ray* packetRays[PACKET_SIZE];
+        RaycastHit* packetHits[PACKET_SIZE];
+        for (size_t packet = left; packet < right; packet++) {
+            for (int k = 0; k < PACKET_SIZE; k++) {
+                size_t slot = packet * PACKET_SIZE + k;
+                if (slot < count) {
+                    size_t ray = static_cast<size_t>(sortKeys[slot] & 0xFFFFFFFFu);
+                    packetRays[k] = &rays[ray];
+                    packetHits[k] = &hits[ray];
+                }
+                else {
+                    packetRays[k] = nullptr;
+                    packetHits[k] = nullptr;
+                }
+            }
+            CastPacket(packetRays, packetHits);
+            for (int k = 0; k < PACKET_SIZE; k++) {
+                if (packetHits[k] && packetHits[k]->type != RaycastHitType::None) threadHits[batch]++;
+            }
+        }
+    }, 64);
+
+    size_t hitCount = 0;
+    for (size_t n : threadHits) hitCount += n;
+    return hitCount;
+}
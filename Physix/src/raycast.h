@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "cuboid.h"
+#include "lbvh.h"
+#include "static_bvh.h"
+
+// A ray with a normalized direction, tested over [0, maxDistance].
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    float maxDistance;
+};
+
+enum class RaycastHitType : unsigned int {
+    None,
+    Sphere,
+    Cuboid,
+    Heightfield
+};
+
+// Closest hit of a ray. 'body' indexes the spheres, the Cuboids or a heightfield's
+// cells, depending on 'type'. A ray starting inside a body hits it at distance 0,
+// facing the ray.
+struct RaycastHit {
+    unsigned int body;
+    RaycastHitType type;
+    float distance;
+    glm::vec3 normal;
+};
+
+// Raycast queries against the spheres and the static Cuboids.
+// Spheres are found through an LBVH rebuilt by Update(), Cuboids through the
+// StaticBVH of the physics step. Rays are traced four at a time as an SSE packet:
+// a node costs one packet/box slab test and is only skipped when no ray of the
+// packet can hit it. Batches are sorted by origin and direction first, so rays in
+// a packet tend to visit the same nodes.
+class Raycaster {
+public:
+    static const int PACKET_SIZE = 4;
+
+    Raycaster();
+
+    // The Cuboids and their StaticBVH must outlive the raycaster and stay unmoved.
+    void SetStatic(const std::vector<Cuboid>& cuboids, const StaticBVH& staticWorld);
+    // Rebuilds the sphere tree; call it after the spheres have moved.
+    void Update(const std::vector<Sphere>& spheres);
+
+    bool Cast(const Ray& ray, RaycastHit& hit) const;
+    // Writes the closest hit of rays[i] to hits[i] (type None on a miss) and returns
+    // the number of rays that hit. Packets run in parallel; the sort and hit-count
+    // buffers are kept between calls, so nothing is allocated per ray.
+    size_t CastBatch(const Ray* rays, size_t count, RaycastHit* hits);
+
+    const LBVH& getSphereTree() const { return sphereTree; }
+
+private:
+    // World frame of a Cuboid: the ray is moved into it for the slab test.
+    struct CuboidFrame {
+        glm::vec3 center;
+        glm::mat3 rotation;
+        glm::vec3 halfExtents;
+    };
+
+    LBVH sphereTree;
+    const StaticBVH* staticWorld;
+    std::vector<CuboidFrame> cuboidFrames;
+    std::vector<unsigned long long> sortKeys;
+    std::vector<size_t> threadHits;
+
+    // Traces up to PACKET_SIZE rays; rays[k] == nullptr marks an empty lane.
+    void CastPacket(const Ray* const* rays, RaycastHit* const* hits) const;
+};
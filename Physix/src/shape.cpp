@@ -0,0 +1,55 @@
+#include "shape.h"
+#include "compound_shape.h"
+
+Shape MakeSphereShape(float radius) {
+    return { ShapeType::Sphere, radius, 0.0f, glm::vec3(radius), nullptr, nullptr };
+}
+
+Shape MakeCapsuleShape(float radius, float halfHeight) {
+    return { ShapeType::Capsule, radius, halfHeight, glm::vec3(radius, halfHeight + radius, radius), nullptr, nullptr };
+}
+
+Shape MakeCylinderShape(float radius, float halfHeight) {
+    return { ShapeType::Cylinder, radius, halfHeight, glm::vec3(radius, halfHeight, radius), nullptr, nullptr };
+}
+
+Shape MakeBoxShape(const glm::vec3& halfExtents) {
+    return { ShapeType::Box, 0.0f, 0.0f, halfExtents, nullptr, nullptr };
+}
+
+Shape MakeHullShape(const ConvexHull& hull) {
+    return { ShapeType::Hull, 0.0f, 0.0f, glm::vec3(hull.getBoundingRadius()), &hull, nullptr };
+}
+
+Shape MakeCompoundShape(const CompoundShape& compound) {
+    return { ShapeType::Compound, 0.0f, 0.0f, compound.getBounds().Extents(), nullptr, &compound };
+}
+
+AABB ShapeBounds(const ShapeBody& body) {
+    // halfExtents bound every shape in its own frame; the rotated box's extent on
+    // each world axis is the absolute rotation times it.
+    const glm::mat3& r = body.rotation;
+    glm::mat3 absolute(glm::abs(r[0]), glm::abs(r[1]), glm::abs(r[2]));
+    glm::vec3 extent = absolute * body.shape.halfExtents;
+    if (body.shape.type == ShapeType::Sphere || body.shape.type == ShapeType::Hull) extent = body.shape.halfExtents;
+    // A compound's bounds need not be centered on its origin.
+    glm::vec3 center = body.position;
+    if (body.shape.type == ShapeType::Compound) center += r * body.shape.compound->getBounds().Center();
+    return { center - extent, center + extent };
+}
+
+ConvexCollider ToConvexCollider(const ShapeBody& body) {
+    const Shape& shape = body.shape;
+    switch (shape.type) {
+    case ShapeType::Sphere:
+        return { nullptr, glm::vec3(0.0f), body.position, body.rotation, shape.radius, false };
+    case ShapeType::Capsule:
+        return { nullptr, glm::vec3(0.0f, shape.halfHeight, 0.0f), body.position, body.rotation, shape.radius, false };
+    case ShapeType::Cylinder:
+        return { nullptr, glm::vec3(shape.radius, shape.halfHeight, shape.radius), body.position, body.rotation, 0.0f, true };
+    case ShapeType::Hull:
+        return { shape.hull, glm::vec3(0.0f), body.position, body.rotation, 0.0f, false };
+    default:
+        return { nullptr, shape.halfExtents, body.position, body.rotation, 0.0f, false };
+    }
+}
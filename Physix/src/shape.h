@@ -0,0 +1,52 @@
+#pragma once
+#include <glm/glm.hpp>
+#include "aabb.h"
+#include "convex_hull.h"
+#include "gjk.h"
+
+class CompoundShape;
+
+// What a body is shaped like. COUNT sizes the shape-pair dispatch table.
+enum class ShapeType : unsigned char {
+    Sphere,
+    Capsule,
+    Cylinder,
+    Box,
+    Hull,
+    Compound,
+    COUNT
+};
+
+// A body's shape: the tag and the parameters it uses, all in the body's frame.
+// Sphere: 'radius'. Capsule: the segment from -halfHeight to +halfHeight along y,
+// rounded by 'radius'. Cylinder: 'radius' and 'halfHeight' along y. Box:
+// 'halfExtents'. Hull: 'hull', which must outlive the shape. Compound: 'compound',
+// likewise.
+struct Shape {
+    ShapeType type;
+    float radius;
+    float halfHeight;
+    glm::vec3 halfExtents;
+    const ConvexHull* hull;
+    const CompoundShape* compound;
+};
+
+// A shape placed in the world.
+struct ShapeBody {
+    Shape shape;
+    glm::vec3 position;
+    glm::mat3 rotation;
+};
+
+Shape MakeSphereShape(float radius);
+Shape MakeCapsuleShape(float radius, float halfHeight);
+Shape MakeCylinderShape(float radius, float halfHeight);
+Shape MakeBoxShape(const glm::vec3& halfExtents);
+Shape MakeHullShape(const ConvexHull& hull);
+// The compound must be built.
+Shape MakeCompoundShape(const CompoundShape& compound);
+
+AABB ShapeBounds(const ShapeBody& body);
+// The body as GJK sees it, for the shape pairs without a closed-form test.
+// Compounds are not convex and never reach GJK whole, only their children.
+ConvexCollider ToConvexCollider(const ShapeBody& body);
@@ -0,0 +1,194 @@
+#include "shape_cast.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const float PARALLEL_EPSILON = 1e-12f;
+
+    // The segment tests below take o + t * d for t in [0, tMax] and return the
+    // entry time. The segment is known to start outside the shape.
+
+    bool SegmentSphere(const glm::vec3& o, const glm::vec3& d, const glm::vec3& center, float radius,
+        float tMax, float& t) {
+        glm::vec3 m = o - center;
+        float a = glm::dot(d, d);
+        float b = glm::dot(m, d);
+        float c = glm::dot(m, m) - radius * radius;
+        // Moving away, or not moving at all.
+        if (b >= 0.0f || a < PARALLEL_EPSILON) return false;
+        float disc = b * b - a * c;
+        if (disc < 0.0f) return false;
+        t = std::max(0.0f, (-b - std::sqrt(disc)) / a);
+        return t <= tMax;
+    }
+
+    bool SegmentBox(const glm::vec3& o, const glm::vec3& d, const glm::vec3& lo, const glm::vec3& hi,
+        float tMax, float& t) {
+        float tNear = 0.0f;
+        float tFar = tMax;
+        for (int axis = 0; axis < 3; axis++) {
+            if (std::fabs(d[axis]) < PARALLEL_EPSILON) {
+                if (o[axis] < lo[axis] || o[axis] > hi[axis]) return false;
+                continue;
+            }
+            float inv = 1.0f / d[axis];
+            float t1 = (lo[axis] - o[axis]) * inv;
+            float t2 = (hi[axis] - o[axis]) * inv;
+            tNear = std::max(tNear, std::min(t1, t2));
+            tFar = std::min(tFar, std::max(t1, t2));
+            if (tNear > tFar) return false;
+        }
+        t = tNear;
+        return true;
+    }
+
+    // Cylinder of 'radius' around the line through (u, v) = (cu, cv) along 'axis',
+    // limited to [lo, hi] on that axis. Its ends are covered by the caller's other shapes.
+    bool SegmentCylinder(const glm::vec3& o, const glm::vec3& d, int axis, float cu, float cv, float radius,
+        float lo, float hi, float tMax, float& t) {
+        int u = (axis + 1) % 3;
+        int v = (axis + 2) % 3;
+        float mu = o[u] - cu, mv = o[v] - cv;
+        float a = d[u] * d[u] + d[v] * d[v];
+        float b = mu * d[u] + mv * d[v];
+        float c = mu * mu + mv * mv - radius * radius;
+        if (b >= 0.0f || a < PARALLEL_EPSILON) return false;
+        float disc = b * b - a * c;
+        if (disc < 0.0f) return false;
+        t = std::max(0.0f, (-b - std::sqrt(disc)) / a);
+        if (t > tMax) return false;
+        float along = o[axis] + t * d[axis];
+        return along >= lo && along <= hi;
+    }
+
+    // Segment against the box [-h, h] rounded by 'radius': the union of the box grown
+    // along each axis, a cylinder along each edge and a sphere at each corner.
+    bool SegmentRoundedBox(const glm::vec3& o, const glm::vec3& d, const glm::vec3& h, float radius,
+        float tMax, float& t) {
+        float entry;
+        // Cheap reject against the box grown by the radius on every axis.
+        if (!SegmentBox(o, d, -h - radius, h + radius, tMax, entry)) return false;
+
+        bool hit = false;
+        t = tMax;
+        for (int axis = 0; axis < 3; axis++) {
+            glm::vec3 grow(0.0f);
+            grow[axis] = radius;
+            if (SegmentBox(o, d, -h - grow, h + grow, t, entry) && entry <= t) {
+                t = entry;
+                hit = true;
+            }
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            int u = (axis + 1) % 3;
+            int v = (axis + 2) % 3;
+            for (int corner = 0; corner < 4; corner++) {
+                float cu = (corner & 1) ? h[u] : -h[u];
+                float cv = (corner & 2) ? h[v] : -h[v];
+                if (SegmentCylinder(o, d, axis, cu, cv, radius, -h[axis], h[axis], t, entry) && entry <= t) {
+                    t = entry;
+                    hit = true;
+                }
+            }
+        }
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 c((corner & 1) ? h.x : -h.x, (corner & 2) ? h.y : -h.y, (corner & 4) ? h.z : -h.z);
+            if (SegmentSphere(o, d, c, radius, t, entry) && entry <= t) {
+                t = entry;
+                hit = true;
+            }
+        }
+        return hit;
+    }
+
+    // Direction from the box [-h, h] towards the local point p. For a point inside,
+    // the face it is closest to.
+    glm::vec3 BoxNormal(const glm::vec3& p, const glm::vec3& h) {
+        glm::vec3 offset = p - glm::clamp(p, -h, h);
+        if (glm::dot(offset, offset) > 0.0f) return glm::normalize(offset);
+
+        glm::vec3 depth = h - glm::abs(p);
+        int axis = depth.x < depth.y ? (depth.x < depth.z ? 0 : 2) : (depth.y < depth.z ? 1 : 2);
+        glm::vec3 normal(0.0f);
+        normal[axis] = p[axis] < 0.0f ? -1.0f : 1.0f;
+        return normal;
+    }
+}
+
+ShapeCaster::ShapeCaster(const LBVH& tree)
+    : tree(tree), cuboids(nullptr), staticWorld(nullptr) {
+}
+
+void ShapeCaster::SetStatic(const std::vector<Cuboid>& newCuboids, const StaticBVH& world) {
+    cuboids = &newCuboids;
+    staticWorld = &world;
+}
+
+bool ShapeCaster::Cast(const ShapeCast& cast, ShapeCastHit& hit) const {
+    glm::vec3 d = cast.end - cast.start;
+    AABB sweep = Merge(AABB::FromSphere(cast.start, cast.radius), AABB::FromSphere(cast.end, cast.radius));
+
+    hit.type = RaycastHitType::None;
+    hit.body = 0;
+    hit.time = 1.0f;
+    hit.normal = glm::vec3(0.0f);
+    float best = 1.0f;
+
+    tree.Query(sweep, [&](size_t leaf) {
+        unsigned int body = tree.getLeafBody(leaf);
+        if (body == cast.ignoreBody) return;
+        const glm::vec3& center = tree.getLeafPosition(leaf);
+        float radius = cast.radius + tree.getLeafRadius(leaf);
+
+        float t;
+        if (SpheresOverlap(cast.start, cast.radius, center, tree.getLeafRadius(leaf))) t = 0.0f;
+        else if (!SegmentSphere(cast.start, d, center, radius, best, t)) return;
+        if (hit.type != RaycastHitType::None && t >= best) return;
+
+        best = t;
+        hit.type = RaycastHitType::Sphere;
+        hit.body = body;
+        glm::vec3 offset = cast.start + t * d - center;
+        hit.normal = glm::dot(offset, offset) > 0.0f ? glm::normalize(offset) : -glm::normalize(d);
+    });
+
+    if (staticWorld) {
+        staticWorld->Query(sweep, [&](unsigned int index) {
+            const CuboidCollider& collider = (*cuboids)[index].getCollider();
+            const glm::mat3& rotation = collider.rotation;
+            const glm::vec3& h = collider.halfExtents;
+            // The rotation is orthonormal, so its transpose takes world vectors into the box frame.
+            glm::mat3 toLocal = glm::transpose(rotation);
+            glm::vec3 o = toLocal * (cast.start - collider.center);
+            glm::vec3 localD = toLocal * d;
+
+            float t;
+            glm::vec3 gap = o - glm::clamp(o, -h, h);
+            if (glm::dot(gap, gap) < cast.radius * cast.radius) t = 0.0f;
+            else if (!SegmentRoundedBox(o, localD, h, cast.radius, best, t)) return;
+            if (hit.type != RaycastHitType::None && t >= best) return;
+
+            best = t;
+            hit.type = RaycastHitType::Cuboid;
+            hit.body = index;
+            hit.normal = rotation * BoxNormal(o + t * localD, h);
+        });
+    }
+
+    hit.time = best;
+    return hit.type != RaycastHitType::None;
+}
+
+size_t ShapeCaster::CastBatch(const ShapeCast* casts, size_t count, ShapeCastHit* hits) const {
+    threadHits.assign(NumWorkerThreads(), 0);
+    ParallelForRange(count, [&](size_t left, size_t right, unsigned int batch) {
+        for (size_t i = left; i < right; i++) {
+            if (Cast(casts[i], hits[i])) threadHits[batch]++;
+        }
+    }, 64);
+
+    size_t hitCount = 0;
+    for (size_t n : threadHits) hitCount += n;
+    return hitCount;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "cuboid.h"
+#include "lbvh.h"
+#include "raycast.h"
+#include "static_bvh.h"
+
+// A sphere of 'radius' swept from 'start' to 'end'. 'ignoreBody' is a sphere index
+// the cast passes through (usually the moving body itself), or NO_BODY.
+struct ShapeCast {
+    glm::vec3 start;
+    glm::vec3 end;
+    float radius;
+    unsigned int ignoreBody;
+};
+
+// First contact of a shape cast. 'time' is the fraction of the sweep at impact
+// (0 if the sphere already overlaps at the start), 'normal' points from the body
+// hit towards the swept sphere.
+struct ShapeCastHit {
+    unsigned int body;
+    RaycastHitType type;
+    float time;
+    glm::vec3 normal;
+};
+
+// Swept-sphere queries for kinematic movement.
+// Candidates come from the sweep's bounding box: spheres from an LBVH kept up to
+// date by the caller, Cuboids from the StaticBVH. A sphere against a sphere is a
+// segment against the sphere inflated by the cast radius; a sphere against a
+// Cuboid is a segment against the box rounded by the cast radius (Ericson,
+// Real-Time Collision Detection 5.5.7), done in the box's local frame.
+class ShapeCaster {
+public:
+    static const unsigned int NO_BODY = 0xFFFFFFFFu;
+
+    ShapeCaster(const LBVH& tree);
+
+    // The Cuboids and their StaticBVH must outlive the caster.
+    void SetStatic(const std::vector<Cuboid>& cuboids, const StaticBVH& staticWorld);
+
+    bool Cast(const ShapeCast& cast, ShapeCastHit& hit) const;
+    // Writes the first contact of casts[i] to hits[i] (type None on a miss) and
+    // returns the number of casts that hit. Casts run in parallel.
+    size_t CastBatch(const ShapeCast* casts, size_t count, ShapeCastHit* hits) const;
+
+private:
+    const LBVH& tree;
+    const std::vector<Cuboid>* cuboids;
+    const StaticBVH* staticWorld;
+    mutable std::vector<size_t> threadHits;
+};
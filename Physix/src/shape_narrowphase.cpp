@@ -0,0 +1,434 @@
+#include "shape_narrowphase.h"
+#include "compound_shape.h"
+#include "simd_lanes.h"
+#include "parallel.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <utility>
+
+namespace {
+    // Perfectly elastic, like the sphere-sphere and sphere-wall contacts.
+    const float RESTITUTION = 1.0f;
+    const size_t SHAPE_TYPES = static_cast<size_t>(ShapeType::COUNT);
+
+    // Runs test(a, b, contact) over a bucket and keeps the touching pairs.
+    template <typename Test>
+    void ForEachPair(const ShapeBody* bodies, const CollisionPair* pairs, size_t count,
+        std::vector<ShapeContact>& contacts, Test test) {
+        for (size_t k = 0; k < count; k++) {
+            ShapeContact contact;
+            if (!test(bodies[pairs[k].a], bodies[pairs[k].b], contact)) continue;
+            contact.a = pairs[k].a;
+            contact.b = pairs[k].b;
+            contacts.push_back(contact);
+        }
+    }
+
+    // Two spheres at a and b; the building block of the round shapes.
+    bool TouchSpheres(const glm::vec3& a, float ra, const glm::vec3& b, float rb, ShapeContact& contact) {
+        glm::vec3 offset = b - a;
+        float dist2 = glm::dot(offset, offset);
+        float reach = ra + rb;
+        if (dist2 >= reach * reach) return false;
+        float dist = std::sqrt(dist2);
+        contact.normal = dist > 0.0f ? offset / dist : glm::vec3(0.0f, 1.0f, 0.0f);
+        contact.depth = reach - dist;
+        contact.point = a + (ra - 0.5f * contact.depth) * contact.normal;
+        return true;
+    }
+
+    // A capsule's segment in world space.
+    void CapsuleSegment(const ShapeBody& body, glm::vec3& p, glm::vec3& q) {
+        glm::vec3 axis = body.rotation[1] * body.shape.halfHeight;
+        p = body.position - axis;
+        q = body.position + axis;
+    }
+
+    glm::vec3 ClosestPointOnSegment(const glm::vec3& c, const glm::vec3& p, const glm::vec3& q) {
+        glm::vec3 d = q - p;
+        float dd = glm::dot(d, d);
+        float t = dd > 0.0f ? glm::clamp(glm::dot(c - p, d) / dd, 0.0f, 1.0f) : 0.0f;
+        return p + t * d;
+    }
+
+    // Ericson, Real-Time Collision Detection 5.1.9: closest points c1, c2 of the
+    // segments p1q1 and p2q2.
+    void ClosestPointsOfSegments(const glm::vec3& p1, const glm::vec3& q1, const glm::vec3& p2, const glm::vec3& q2,
+        glm::vec3& c1, glm::vec3& c2) {
+        glm::vec3 d1 = q1 - p1, d2 = q2 - p2, r = p1 - p2;
+        float a = glm::dot(d1, d1), e = glm::dot(d2, d2), f = glm::dot(d2, r);
+        float s, t;
+        if (a <= 1e-12f && e <= 1e-12f) {
+            s = t = 0.0f;
+        }
+        else if (a <= 1e-12f) {
+            s = 0.0f;
+            t = glm::clamp(f / e, 0.0f, 1.0f);
+        }
+        else {
+            float c = glm::dot(d1, r);
+            if (e <= 1e-12f) {
+                t = 0.0f;
+                s = glm::clamp(-c / a, 0.0f, 1.0f);
+            }
+            else {
+                float b = glm::dot(d1, d2);
+                float denom = a * e - b * b;
+                s = denom > 0.0f ? glm::clamp((b * f - c * e) / denom, 0.0f, 1.0f) : 0.0f;
+                t = (b * s + f) / e;
+                if (t < 0.0f) {
+                    t = 0.0f;
+                    s = glm::clamp(-c / a, 0.0f, 1.0f);
+                }
+                else if (t > 1.0f) {
+                    t = 1.0f;
+                    s = glm::clamp((b - c) / a, 0.0f, 1.0f);
+                }
+            }
+        }
+        c1 = p1 + s * d1;
+        c2 = p2 + t * d2;
+    }
+
+    // Kernel of the shape pair (A, B) over a bucket whose pairs have an A in 'a' and
+    // a B in 'b'. Pairs without a closed form go through GJK/EPA from a cold start.
+    template <ShapeType A, ShapeType B>
+    struct PairKernel {
+        static void Run(const ShapeBody* bodies, const CollisionPair* pairs, size_t count,
+            std::vector<ShapeContact>& contacts) {
+            ForEachPair(bodies, pairs, count, contacts, [](const ShapeBody& a, const ShapeBody& b, ShapeContact& contact) {
+                GJKCache cache;
+                cache.count = 0;
+                ConvexContact result;
+                if (!CollideConvex(ToConvexCollider(a), ToConvexCollider(b), cache, 0.0f, result)) return false;
+                contact.normal = result.normal;
+                contact.depth = -result.distance;
+                contact.point = 0.5f * (result.pointA + result.pointB);
+                return true;
+            });
+        }
+    };
+
+    // Sphere pairs, a SIMD block of pairs at a time; only the touching lanes reach
+    // the scalar contact code.
+    template <typename L>
+    void RunSpherePairs(const ShapeBody* bodies, const CollisionPair* pairs, size_t count,
+        std::vector<ShapeContact>& contacts) {
+        const int W = L::WIDTH;
+        alignas(32) float lanes[7][W];
+        for (size_t first = 0; first < count; first += W) {
+            for (int k = 0; k < W; k++) {
+                // The tail repeats the last pair.
+                const CollisionPair& pair = pairs[std::min(first + k, count - 1)];
+                const ShapeBody& a = bodies[pair.a];
+                const ShapeBody& b = bodies[pair.b];
+                for (int i = 0; i < 3; i++) {
+                    lanes[i][k] = a.position[i];
+                    lanes[3 + i][k] = b.position[i];
+                }
+                lanes[6][k] = a.shape.radius + b.shape.radius;
+            }
+            typename L::Float dist2 = L::Set(0.0f);
+            for (int i = 0; i < 3; i++) {
+                typename L::Float d = L::Sub(L::Load(lanes[3 + i]), L::Load(lanes[i]));
+                dist2 = L::Add(dist2, L::Mul(d, d));
+            }
+            typename L::Float reach = L::Load(lanes[6]);
+            unsigned int hits = L::MoveMask(L::Less(dist2, L::Mul(reach, reach)));
+            for (int k = 0; hits && first + k < count; k++, hits >>= 1) {
+                if (!(hits & 1)) continue;
+                const CollisionPair& pair = pairs[first + k];
+                ShapeContact contact;
+                const ShapeBody& a = bodies[pair.a];
+                const ShapeBody& b = bodies[pair.b];
+                if (!TouchSpheres(a.position, a.shape.radius, b.position, b.shape.radius, contact)) continue;
+                contact.a = pair.a;
+                contact.b = pair.b;
+                contacts.push_back(contact);
+            }
+        }
+    }
+
+    template <>
+    struct PairKernel<ShapeType::Sphere, ShapeType::Sphere> {
+        static void Run(const ShapeBody* bodies, const CollisionPair* pairs, size_t count,
+            std::vector<ShapeContact>& contacts) {
+#ifdef __AVX__
+            RunSpherePairs<AVXLanes>(bodies, pairs, count, contacts);
+#else
+            RunSpherePairs<SSELanes>(bodies, pairs, count, contacts);
+#endif
+        }
+    };
+
+    template <>
+    struct PairKernel<ShapeType::Sphere, ShapeType::Capsule> {
+        static void Run(const ShapeBody* bodies, const CollisionPair* pairs, size_t count,
+            std::vector<ShapeContact>& contacts) {
+            ForEachPair(bodies, pairs, count, contacts, [](const ShapeBody& a, const ShapeBody& b, ShapeContact& contact) {
+                glm::vec3 p, q;
+                CapsuleSegment(b, p, q);
+                return TouchSpheres(a.position, a.shape.radius, ClosestPointOnSegment(a.position, p, q), b.shape.radius,
+                    contact);
+            });
+        }
+    };
+
+    template <>
+    struct PairKernel<ShapeType::Capsule, ShapeType::Capsule> {
+        static void Run(const ShapeBody* bodies, const CollisionPair* pairs, size_t count,
+            std::vector<ShapeContact>& contacts) {
+            ForEachPair(bodies, pairs, count, contacts, [](const ShapeBody& a, const ShapeBody& b, ShapeContact& contact) {
+                glm::vec3 p1, q1, p2, q2, c1, c2;
+                CapsuleSegment(a, p1, q1);
+                CapsuleSegment(b, p2, q2);
+                ClosestPointsOfSegments(p1, q1, p2, q2, c1, c2);
+                return TouchSpheres(c1, a.shape.radius, c2, b.shape.radius, contact);
+            });
+        }
+    };
+
+    template <>
+    struct PairKernel<ShapeType::Sphere, ShapeType::Cylinder> {
+        static void Run(const ShapeBody* bodies, const CollisionPair* pairs, size_t count,
+            std::vector<ShapeContact>& contacts) {
+            ForEachPair(bodies, pairs, count, contacts, [](const ShapeBody& a, const ShapeBody& b, ShapeContact& contact) {
+                float R = b.shape.radius, H = b.shape.halfHeight, r = a.shape.radius;
+                // The rotation is orthonormal, so its transpose takes world vectors into the cylinder frame.
+                glm::vec3 local = glm::transpose(b.rotation) * (a.position - b.position);
+                float radial = std::sqrt(local.x * local.x + local.z * local.z);
+
+                glm::vec3 closest = local;
+                if (radial > R) {
+                    closest.x *= R / radial;
+                    closest.z *= R / radial;
+                }
+                closest.y = glm::clamp(local.y, -H, H);
+                glm::vec3 offset = local - closest;
+                float dist2 = glm::dot(offset, offset);
+                if (dist2 >= r * r) return false;
+
+                glm::vec3 outward;
+                if (dist2 > 0.0f) {
+                    float dist = std::sqrt(dist2);
+                    outward = offset / dist;
+                    contact.depth = r - dist;
+                }
+                else if (R - radial < H - std::fabs(local.y)) {
+                    // Center inside: out through the nearer of the side and the caps.
+                    outward = radial > 0.0f ? glm::vec3(local.x / radial, 0.0f, local.z / radial) : glm::vec3(1.0f, 0.0f, 0.0f);
+                    contact.depth = r + R - radial;
+                }
+                else {
+                    outward = glm::vec3(0.0f, local.y < 0.0f ? -1.0f : 1.0f, 0.0f);
+                    contact.depth = r + H - std::fabs(local.y);
+                }
+                contact.normal = -(b.rotation * outward);
+                contact.point = b.position + b.rotation * closest - 0.5f * contact.depth * contact.normal;
+                return true;
+            });
+        }
+    };
+
+    template <>
+    struct PairKernel<ShapeType::Sphere, ShapeType::Box> {
+        static void Run(const ShapeBody* bodies, const CollisionPair* pairs, size_t count,
+            std::vector<ShapeContact>& contacts) {
+            ForEachPair(bodies, pairs, count, contacts, [](const ShapeBody& a, const ShapeBody& b, ShapeContact& contact) {
+                const glm::vec3& h = b.shape.halfExtents;
+                float r = a.shape.radius;
+                glm::vec3 local = glm::transpose(b.rotation) * (a.position - b.position);
+                glm::vec3 closest = glm::clamp(local, -h, h);
+                glm::vec3 offset = local - closest;
+                float dist2 = glm::dot(offset, offset);
+                if (dist2 >= r * r) return false;
+
+                glm::vec3 outward(0.0f);
+                if (dist2 > 0.0f) {
+                    float dist = std::sqrt(dist2);
+                    outward = offset / dist;
+                    contact.depth = r - dist;
+                }
+                else {
+                    glm::vec3 depth = h - glm::abs(local);
+                    int axis = depth.x < depth.y ? (depth.x < depth.z ? 0 : 2) : (depth.y < depth.z ? 1 : 2);
+                    outward[axis] = local[axis] < 0.0f ? -1.0f : 1.0f;
+                    contact.depth = r + depth[axis];
+                }
+                contact.normal = -(b.rotation * outward);
+                contact.point = b.position + b.rotation * closest - 0.5f * contact.depth * contact.normal;
+                return true;
+            });
+        }
+    };
+
+    void CollideCompound(const ShapeBody& other, const ShapeBody& compound, unsigned int otherIndex,
+        unsigned int compoundIndex, std::vector<ShapeContact>& contacts);
+
+    // Any shape against a compound, compounds included: a single proxy in the world,
+    // the children come from the compound's local BVH.
+    template <ShapeType A>
+    struct PairKernel<A, ShapeType::Compound> {
+        static void Run(const ShapeBody* bodies, const CollisionPair* pairs, size_t count,
+            std::vector<ShapeContact>& contacts) {
+            for (size_t k = 0; k < count; k++) {
+                CollideCompound(bodies[pairs[k].a], bodies[pairs[k].b], pairs[k].a, pairs[k].b, contacts);
+            }
+        }
+    };
+
+    typedef void (*ShapeKernel)(const ShapeBody*, const CollisionPair*, size_t, std::vector<ShapeContact>&);
+
+    // Entry A * SHAPE_TYPES + B is PairKernel<A, B>::Run. Pairs are ordered before
+    // dispatch, so the entries with A > B are never used.
+    template <size_t... I>
+    constexpr std::array<ShapeKernel, sizeof...(I)> MakeDispatchTable(std::index_sequence<I...>) {
+        return { { &PairKernel<static_cast<ShapeType>(I / SHAPE_TYPES), static_cast<ShapeType>(I % SHAPE_TYPES)>::Run... } };
+    }
+
+    constexpr std::array<ShapeKernel, SHAPE_TYPES * SHAPE_TYPES> DISPATCH_TABLE =
+        MakeDispatchTable(std::make_index_sequence<SHAPE_TYPES * SHAPE_TYPES>());
+
+    size_t BucketOf(const ShapeBody& a, const ShapeBody& b) {
+        return static_cast<size_t>(a.shape.type) * SHAPE_TYPES + static_cast<size_t>(b.shape.type);
+    }
+}
+
+namespace {
+    // 'other' is taken into the compound's frame to query its BVH. Each child it
+    // touches is placed in the world and goes through the table with 'other' as a
+    // pair of its own; a compound 'other' descends in turn against the child.
+    void CollideCompound(const ShapeBody& other, const ShapeBody& compound, unsigned int otherIndex,
+        unsigned int compoundIndex, std::vector<ShapeContact>& contacts) {
+        const CompoundShape& shape = *compound.shape.compound;
+        glm::mat3 toLocal = glm::transpose(compound.rotation);
+        ShapeBody local = { other.shape, toLocal * (other.position - compound.position), toLocal * other.rotation };
+        shape.Query(ShapeBounds(local), [&](size_t k) {
+            const ShapeBody& child = shape.getChild(k);
+            ShapeBody bodies[2] = {
+                other,
+                { child.shape, compound.position + compound.rotation * child.position, compound.rotation * child.rotation }
+            };
+            if (other.shape.type == ShapeType::Compound) {
+                CollideCompound(bodies[1], other, compoundIndex, otherIndex, contacts);
+                return;
+            }
+
+            // Bodies 0 and 1 stand for the pair's bodies; the contacts are mapped back.
+            size_t first = contacts.size();
+            CollisionPair pair = other.shape.type <= child.shape.type ? CollisionPair{ 0, 1 } : CollisionPair{ 1, 0 };
+            DISPATCH_TABLE[BucketOf(bodies[pair.a], bodies[pair.b])](bodies, &pair, 1, contacts);
+            for (size_t c = first; c < contacts.size(); c++) {
+                contacts[c].a = contacts[c].a == 0 ? otherIndex : compoundIndex;
+                contacts[c].b = contacts[c].b == 0 ? otherIndex : compoundIndex;
+            }
+        });
+    }
+}
+
+ShapeNarrowphase::ShapeNarrowphase()
+    : bucketOffsets(SHAPE_TYPES * SHAPE_TYPES + 1, 0), threadContacts(NumWorkerThreads()), tree(0.0f, 0.0f),
+    staticCount(0), threadPairs(NumWorkerThreads()) {
+}
+
+void ShapeNarrowphase::Collide(const std::vector<ShapeBody>& shapeBodies, const std::vector<CollisionPair>& candidates,
+    std::vector<ShapeContact>& out) {
+    // Counting sort by shape pair, lower type first.
+    std::fill(bucketOffsets.begin(), bucketOffsets.end(), 0);
+    for (const CollisionPair& pair : candidates) {
+        const ShapeBody& a = shapeBodies[pair.a];
+        const ShapeBody& b = shapeBodies[pair.b];
+        bucketOffsets[(a.shape.type <= b.shape.type ? BucketOf(a, b) : BucketOf(b, a)) + 1]++;
+    }
+    for (size_t k = 1; k < bucketOffsets.size(); k++) bucketOffsets[k] += bucketOffsets[k - 1];
+    sortedPairs.resize(candidates.size());
+    bucketFill.assign(bucketOffsets.begin(), bucketOffsets.end() - 1);
+    for (const CollisionPair& pair : candidates) {
+        const ShapeBody& a = shapeBodies[pair.a];
+        const ShapeBody& b = shapeBodies[pair.b];
+        if (a.shape.type <= b.shape.type) sortedPairs[bucketFill[BucketOf(a, b)]++] = pair;
+        else sortedPairs[bucketFill[BucketOf(b, a)]++] = { pair.b, pair.a };
+    }
+
+    for (std::vector<ShapeContact>& buffer : threadContacts) buffer.clear();
+    for (size_t bucket = 0; bucket + 1 < bucketOffsets.size(); bucket++) {
+        size_t first = bucketOffsets[bucket];
+        size_t count = bucketOffsets[bucket + 1] - first;
+        if (count == 0) continue;
+        ShapeKernel kernel = DISPATCH_TABLE[bucket];
+        ParallelForRange(count, [&](size_t left, size_t right, unsigned int batch) {
+            kernel(shapeBodies.data(), sortedPairs.data() + first + left, right - left, threadContacts[batch]);
+        }, 64);
+    }
+    for (const std::vector<ShapeContact>& buffer : threadContacts) out.insert(out.end(), buffer.begin(), buffer.end());
+}
+
+void ShapeNarrowphase::SetStatic(const std::vector<ShapeBody>& shapes) {
+    for (int proxy : proxies) tree.DestroyProxy(proxy);
+    proxies.clear();
+
+    bodies = shapes;
+    staticCount = shapes.size();
+    for (size_t i = 0; i < shapes.size(); i++) proxies.push_back(tree.CreateProxy(ShapeBounds(shapes[i]), static_cast<unsigned int>(i)));
+}
+
+void ShapeNarrowphase::Resolve(std::vector<Sphere>& spheres, float deltaTime) {
+    if (staticCount == 0) return;
+
+    // Pairs of a sphere index and a static shape; a sphere's pairs come out together.
+    for (std::vector<CollisionPair>& buffer : threadPairs) buffer.clear();
+    ParallelForRange(spheres.size(), [&](size_t left, size_t right, unsigned int batch) {
+        std::vector<CollisionPair>& buffer = threadPairs[batch];
+        for (size_t i = left; i < right; i++) {
+            const Sphere& sphere = spheres[i];
+            float r = sphere.mesh->getRadius() + deltaTime * glm::length(sphere.velocity);
+            tree.Query(AABB::FromSphere(sphere.position, r), [&](int proxy) {
+                buffer.push_back({ static_cast<unsigned int>(i), tree.getUserData(proxy) });
+            });
+        }
+    });
+    pairs.clear();
+    for (const std::vector<CollisionPair>& buffer : threadPairs) pairs.insert(pairs.end(), buffer.begin(), buffer.end());
+
+    // Only the spheres near a shape join the bodies, after the static shapes.
+    bodies.resize(staticCount);
+    bodySpheres.clear();
+    for (CollisionPair& pair : pairs) {
+        if (bodySpheres.empty() || bodySpheres.back() != pair.a) {
+            const Sphere& sphere = spheres[pair.a];
+            float r = sphere.mesh->getRadius() + deltaTime * glm::length(sphere.velocity);
+            bodies.push_back({ MakeSphereShape(r), sphere.position, glm::mat3(1.0f) });
+            bodySpheres.push_back(pair.a);
+        }
+        pair.a = static_cast<unsigned int>(bodies.size() - 1);
+    }
+
+    contacts.clear();
+    Collide(bodies, pairs, contacts);
+
+    // Few spheres touch a post at once, so the pushes are applied in order here.
+    for (const ShapeContact& contact : contacts) {
+        bool sphereIsA = contact.a >= staticCount;
+        unsigned int body = sphereIsA ? contact.a : contact.b;
+        Sphere& sphere = spheres[bodySpheres[body - staticCount]];
+        // Away from the post.
+        glm::vec3 normal = sphereIsA ? -contact.normal : contact.normal;
+        float velAlongNormal = glm::dot(sphere.velocity, normal);
+        // The contact is with the grown sphere; the gap is the real one's.
+        float gap = bodies[body].shape.radius - sphere.mesh->getRadius() - contact.depth;
+        if (gap <= CONTACT_SLOP) {
+            if (gap < 0.0f) sphere.position -= gap * normal;
+            if (velAlongNormal < 0.0f) sphere.velocity -= (1.0f + RESTITUTION) * velAlongNormal * normal;
+            continue;
+        }
+        // Apart: it only loses the speed that would close the gap within the step.
+        float excess = -(velAlongNormal + gap / deltaTime);
+        if (excess > 0.0f) sphere.velocity += excess * normal;
+    }
+}
+
+size_t ShapeNarrowphase::getBucketSize(ShapeType a, ShapeType b) const {
+    size_t bucket = static_cast<size_t>(a) * SHAPE_TYPES + static_cast<size_t>(b);
+    return bucketOffsets[bucket + 1] - bucketOffsets[bucket];
+}
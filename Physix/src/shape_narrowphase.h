@@ -0,0 +1,59 @@
+#pragma once
+#include <vector>
+#include "aabb_tree.h"
+#include "broadphase.h"
+#include "shape.h"
+#include "sphere.h"
+
+// Contact between two shaped bodies. 'normal' points from a towards b, 'depth' is
+// how far they overlap and 'point' lies halfway between the two surfaces.
+struct ShapeContact {
+    unsigned int a;
+    unsigned int b;
+    glm::vec3 normal;
+    float depth;
+    glm::vec3 point;
+};
+
+// Narrowphase for bodies described by a Shape.
+// Candidate pairs are ordered so the lower shape type comes first and bucketed by
+// their shape pair with a counting sort. Each bucket then runs, in parallel, the
+// kernel that a ShapeType x ShapeType table built at compile time holds for it: a
+// closed form for the pairs that have one (sphere-sphere in SIMD lanes), GJK/EPA
+// for the rest. Adding a shape means a tag, a GJK support and optionally kernels.
+// A compound is one body here; its children are paired through its own BVH.
+class ShapeNarrowphase {
+public:
+    ShapeNarrowphase();
+
+    // Appends the contacts of the touching pairs. The pairs' bodies may be swapped
+    // in the contacts, which say which body is which.
+    void Collide(const std::vector<ShapeBody>& bodies, const std::vector<CollisionPair>& pairs,
+        std::vector<ShapeContact>& contacts);
+
+    // Spheres against static shaped bodies (posts, furniture), found through an AABB tree.
+    // A touching sphere is pushed out and reflected, like the walls do. Each sphere
+    // is grown by the distance it covers in deltaTime, so one that reaches a shape
+    // within the step is a speculative contact and loses the speed that would carry
+    // it in.
+    void SetStatic(const std::vector<ShapeBody>& shapes);
+    void Resolve(std::vector<Sphere>& spheres, float deltaTime);
+
+    // Pairs of the last Collide() in the bucket of shapes a and b.
+    size_t getBucketSize(ShapeType a, ShapeType b) const;
+
+private:
+    std::vector<size_t> bucketOffsets;           // one per shape pair, plus the end
+    std::vector<CollisionPair> sortedPairs;
+    std::vector<size_t> bucketFill;              // next free slot of each bucket
+    std::vector<std::vector<ShapeContact>> threadContacts;
+
+    AABBTree tree;
+    std::vector<int> proxies;                    // one per static shape
+    size_t staticCount;
+    std::vector<ShapeBody> bodies;               // the static shapes, then the spheres near one
+    std::vector<unsigned int> bodySpheres;       // sphere of each body after the static shapes
+    std::vector<std::vector<CollisionPair>> threadPairs;
+    std::vector<CollisionPair> pairs;
+    std::vector<ShapeContact> contacts;
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <immintrin.h>
+
+// Float lanes for kernels written once for SSE and AVX. SSELanes is 4 wide and
+// always available; AVXLanes is 8 wide and only defined when AVX is enabled.
+// Comparisons return masks with every bit of a true lane set.
+struct SSELanes {
+    typedef __m128 Float;
+    static const int WIDTH = 4;
+
+    static Float Load(const float* p) { return _mm_load_ps(p); }
+    static void Store(float* p, Float a) { _mm_store_ps(p, a); }
+    static Float Set(float x) { return _mm_set1_ps(x); }
+    static Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+    static Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+    static Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    static Float Div(Float a, Float b) { return _mm_div_ps(a, b); }
+    static Float Sqrt(Float a) { return _mm_sqrt_ps(a); }
+    // If a lane of 'a' is NaN, the lane of 'b'.
+    static Float Min(Float a, Float b) { return _mm_min_ps(a, b); }
+    static Float Max(Float a, Float b) { return _mm_max_ps(a, b); }
+    static Float Less(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+    static Float LessEqual(Float a, Float b) { return _mm_cmple_ps(a, b); }
+    static Float And(Float a, Float b) { return _mm_and_ps(a, b); }
+    static Float Select(Float mask, Float a, Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    static unsigned int MoveMask(Float mask) { return static_cast<unsigned int>(_mm_movemask_ps(mask)); }
+};
+
+#ifdef __AVX__
+struct AVXLanes {
+    typedef __m256 Float;
+    static const int WIDTH = 8;
+
+    static Float Load(const float* p) { return _mm256_load_ps(p); }
+    static void Store(float* p, Float a) { _mm256_store_ps(p, a); }
+    static Float Set(float x) { return _mm256_set1_ps(x); }
+    static Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    static Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+    static Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    static Float Div(Float a, Float b) { return _mm256_div_ps(a, b); }
+    static Float Sqrt(Float a) { return _mm256_sqrt_ps(a); }
+    static Float Min(Float a, Float b) { return _mm256_min_ps(a, b); }
+    static Float Max(Float a, Float b) { return _mm256_max_ps(a, b); }
+    static Float Less(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static Float LessEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+    static Float And(Float a, Float b) { return _mm256_and_ps(a, b); }
+    static Float Select(Float mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+    static unsigned int MoveMask(Float mask) { return static_cast<unsigned int>(_mm256_movemask_ps(mask)); }
+};
+#endif
@@ -0,0 +1,145 @@
+#include "spatial_query.h"
+#include "parallel.h"
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace {
+    // Distance from a point to a box, 0 inside it.
+    float BoxDistance(const AABB& box, const glm::vec3& p) {
+        glm::vec3 d = glm::max(glm::max(box.min - p, p - box.max), glm::vec3(0.0f));
+        return glm::length(d);
+    }
+
+    bool SphereOverlapsBox(const glm::vec3& center, float radius, const AABB& box) {
+        glm::vec3 d = center - glm::clamp(center, box.min, box.max);
+        return glm::dot(d, d) < radius * radius;
+    }
+
+    bool FartherFirst(const std::pair<float, unsigned int>& x, const std::pair<float, unsigned int>& y) {
+        return x.first < y.first;
+    }
+}
+
+SpatialQuery::SpatialQuery(const LBVH& tree)
+    : tree(tree) {
+}
+
+template <typename Query>
+void SpatialQuery::RunBatch(size_t count, QueryResults& results, Query query) {
+    unsigned int threadCount = NumWorkerThreads();
+    threadBodies.resize(threadCount);
+    threadDistances.resize(threadCount);
+    for (unsigned int t = 0; t < threadCount; t++) {
+        threadBodies[t].clear();
+        threadDistances[t].clear();
+    }
+
+    // Each query stores its result count; batches cover ascending query ranges,
+    // so joining the thread buffers in batch order keeps the results in query order.
+    results.offsets.resize(count + 1);
+    results.offsets[0] = 0;
+    ParallelForRange(count, [&](size_t left, size_t right, unsigned int batch) {
+        std::vector<unsigned int>& bodies = threadBodies[batch];
+        std::vector<float>& distances = threadDistances[batch];
+        for (size_t i = left; i < right; i++) {
+            size_t before = bodies.size();
+            query(i, batch, bodies, distances);
+            results.offsets[i + 1] = static_cast<unsigned int>(bodies.size() - before);
+        }
+    }, 64);
+
+    for (size_t i = 0; i < count; i++) {
+        results.offsets[i + 1] += results.offsets[i];
+    }
+    results.bodies.clear();
+    results.distances.clear();
+    for (unsigned int t = 0; t < threadCount; t++) {
+        results.bodies.insert(results.bodies.end(), threadBodies[t].begin(), threadBodies[t].end());
+        results.distances.insert(results.distances.end(), threadDistances[t].begin(), threadDistances[t].end());
+    }
+}
+
+void SpatialQuery::OverlapSphere(const glm::vec3* centers, const float* radii, size_t count, QueryResults& results) {
+    RunBatch(count, results, [&](size_t i, unsigned int, std::vector<unsigned int>& bodies, std::vector<float>&) {
+        const glm::vec3& center = centers[i];
+        float radius = radii[i];
+        tree.Query(AABB::FromSphere(center, radius), [&](size_t leaf) {
+            if (SpheresOverlap(center, radius, tree.getLeafPosition(leaf), tree.getLeafRadius(leaf))) {
+                bodies.push_back(tree.getLeafBody(leaf));
+            }
+        });
+    });
+}
+
+void SpatialQuery::OverlapBox(const AABB* boxes, size_t count, QueryResults& results) {
+    RunBatch(count, results, [&](size_t i, unsigned int, std::vector<unsigned int>& bodies, std::vector<float>&) {
+        const AABB& box = boxes[i];
+        tree.Query(box, [&](size_t leaf) {
+            if (SphereOverlapsBox(tree.getLeafPosition(leaf), tree.getLeafRadius(leaf), box)) {
+                bodies.push_back(tree.getLeafBody(leaf));
+            }
+        });
+    });
+}
+
+void SpatialQuery::Nearest(const glm::vec3* points, size_t count, unsigned int k, QueryResults& results) {
+    const std::vector<LBVHNode>& nodes = tree.getNodes();
+    size_t leafCount = tree.getLeafCount();
+
+    threadHeaps.resize(NumWorkerThreads());
+
+    RunBatch(count, results, [&](size_t i, unsigned int batch, std::vector<unsigned int>& bodies,
+        std::vector<float>& distances) {
+        if (k == 0 || leafCount == 0) return;
+        const glm::vec3& p = points[i];
+
+        // Max-heap of the best k so far, kept per thread so queries do not allocate.
+        std::vector<std::pair<float, unsigned int>>& best = threadHeaps[batch];
+        best.clear();
+        auto bound = [&]() {
+            return best.size() < k ? std::numeric_limits<float>::max() : best.front().first;
+        };
+        auto visitLeaf = [&](int leaf) {
+            float d = std::max(0.0f, glm::length(p - tree.getLeafPosition(leaf)) - tree.getLeafRadius(leaf));
+            if (d >= bound()) return;
+            if (best.size() == k) {
+                std::pop_heap(best.begin(), best.end(), FartherFirst);
+                best.pop_back();
+            }
+            best.push_back({ d, static_cast<unsigned int>(leaf) });
+            std::push_heap(best.begin(), best.end(), FartherFirst);
+        };
+
+        if (nodes.empty()) {
+            visitLeaf(0);
+        }
+        else {
+            // Depth-first, nearer child first; boxes farther than the k-th distance are pruned.
+            std::pair<float, int> stack[128];
+            int top = 0;
+            stack[top++] = { BoxDistance(nodes[0].box, p), 0 };
+            while (top > 0) {
+                std::pair<float, int> current = stack[--top];
+                if (current.first >= bound()) continue;
+                const LBVHNode& node = nodes[current.second];
+
+                int children[2] = { node.left, node.right };
+                float childDistance[2] = { 0.0f, 0.0f };
+                for (int c = 0; c < 2; c++) {
+                    if (children[c] < 0) visitLeaf(~children[c]);
+                    else childDistance[c] = BoxDistance(nodes[children[c]].box, p);
+                }
+                int nearer = childDistance[1] < childDistance[0] ? 1 : 0;
+                if (children[1 - nearer] >= 0) stack[top++] = { childDistance[1 - nearer], children[1 - nearer] };
+                if (children[nearer] >= 0) stack[top++] = { childDistance[nearer], children[nearer] };
+            }
+        }
+
+        std::sort_heap(best.begin(), best.end(), FartherFirst);
+        for (const std::pair<float, unsigned int>& entry : best) {
+            bodies.push_back(tree.getLeafBody(entry.second));
+            distances.push_back(entry.first);
+        }
+    });
+}
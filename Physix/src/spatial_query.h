@@ -0,0 +1,47 @@
+#pragma once
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include "aabb.h"
+#include "lbvh.h"
+
+// Output of a batched query, reused between calls so the buffers only grow.
+// The sphere indices found for query i are bodies[offsets[i] .. offsets[i + 1]).
+// Nearest() also fills 'distances' in step with 'bodies'.
+struct QueryResults {
+    std::vector<unsigned int> offsets;
+    std::vector<unsigned int> bodies;
+    std::vector<float> distances;
+
+    size_t getQueryCount() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    size_t getResultCount(size_t query) const { return offsets[query + 1] - offsets[query]; }
+};
+
+// Proximity queries over the spheres, answered from an LBVH that the caller keeps
+// up to date (the Raycaster's tree, or any LBVH broadphase). Every function takes a
+// batch of queries and splits it across the worker threads; each thread collects
+// its results in its own buffer, and the buffers are joined in query order.
+class SpatialQuery {
+public:
+    SpatialQuery(const LBVH& tree);
+
+    // Spheres overlapping the query spheres.
+    void OverlapSphere(const glm::vec3* centers, const float* radii, size_t count, QueryResults& results);
+    // Spheres overlapping the query boxes.
+    void OverlapBox(const AABB* boxes, size_t count, QueryResults& results);
+    // The k spheres closest to each point, nearest first. The distance is measured to
+    // the sphere's surface and is 0 for a point inside it.
+    void Nearest(const glm::vec3* points, size_t count, unsigned int k, QueryResults& results);
+
+private:
+    const LBVH& tree;
+
+    // Per-thread output of the current batch.
+    std::vector<std::vector<unsigned int>> threadBodies;
+    std::vector<std::vector<float>> threadDistances;
+    std::vector<std::vector<std::pair<float, unsigned int>>> threadHeaps;
+
+    // Runs query(index, thread, bodies, distances) over the batch and joins the results.
+    template <typename Query>
+    void RunBatch(size_t count, QueryResults& results, Query query);
+};
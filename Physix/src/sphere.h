@@ -6,6 +6,10 @@
 #include "shader.h"
 #include "cuboid.h"
 
+// A speculative contact brings a sphere just up to a surface; a gap up to this still
+// counts as touching, so the sphere bounces there on the next substep.
+const float CONTACT_SLOP = 0.01f;
+
 class Sphere {
 public:
 	// declare physical properties
@@ -35,7 +39,10 @@ public:
 
 	void Update(float deltaTime);
 	void ProcessCuboidCollision(const std::vector<Cuboid>& cuboids);
+	void ResolveCuboidCollision(const Cuboid& cuboid);
 	void ProcessSphereCollision(std::vector<Sphere>& spheres);
+	// Narrowphase for a single pair reported by a broadphase.
+	void ResolveSphereCollision(Sphere& other);
 
 	void Render(const Shader& shader);
 	glm::mat4 getModelMatrix() const;
@@ -0,0 +1,268 @@
+#include "sphere_narrowphase.h"
+#include "simd_lanes.h"
+#include "parallel.h"
+#include <algorithm>
+
+namespace {
+    typedef SphereNarrowphase::BodyState BodyState;
+    static_assert(sizeof(BodyState) == 8 * sizeof(float), "BodyState must be two SSE registers");
+
+    // Same as Sphere::ResolveSphereCollision: perfectly elastic.
+    const float RESTITUTION = 1.0f;
+    // Body slot of a sphere that is not staged.
+    const unsigned int NO_SLOT = 0xFFFFFFFFu;
+
+    // Four records' halves (part 0: position and radius, part 1: velocity and
+    // inverse mass) loaded as rows and transposed into x, y, z, w lanes.
+    inline void Gather4(const BodyState* states, const unsigned int* index, int part,
+        __m128& x, __m128& y, __m128& z, __m128& w) {
+        const float* base = reinterpret_cast<const float*>(states) + part * 4;
+        x = _mm_load_ps(base + index[0] * 8);
+        y = _mm_load_ps(base + index[1] * 8);
+        z = _mm_load_ps(base + index[2] * 8);
+        w = _mm_load_ps(base + index[3] * 8);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+    }
+
+    inline void Scatter4(BodyState* states, const unsigned int* index, int part,
+        __m128 x, __m128 y, __m128 z, __m128 w) {
+        float* base = reinterpret_cast<float*>(states) + part * 4;
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        _mm_store_ps(base + index[0] * 8, x);
+        _mm_store_ps(base + index[1] * 8, y);
+        _mm_store_ps(base + index[2] * 8, z);
+        _mm_store_ps(base + index[3] * 8, w);
+    }
+
+    // Lanes that also move whole records in and out of the staged states.
+    struct SSEStates : SSELanes {
+        static void Gather(const BodyState* states, const unsigned int* index, int part,
+            Float& x, Float& y, Float& z, Float& w) {
+            Gather4(states, index, part, x, y, z, w);
+        }
+        static void Scatter(BodyState* states, const unsigned int* index, int part,
+            Float x, Float y, Float z, Float w) {
+            Scatter4(states, index, part, x, y, z, w);
+        }
+    };
+
+#ifdef __AVX__
+    struct AVXStates : AVXLanes {
+        static Float Join(__m128 lo, __m128 hi) { return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1); }
+
+        static void Gather(const BodyState* states, const unsigned int* index, int part,
+            Float& x, Float& y, Float& z, Float& w) {
+            __m128 x0, y0, z0, w0, x1, y1, z1, w1;
+            Gather4(states, index, part, x0, y0, z0, w0);
+            Gather4(states, index + 4, part, x1, y1, z1, w1);
+            x = Join(x0, x1); y = Join(y0, y1); z = Join(z0, z1); w = Join(w0, w1);
+        }
+        static void Scatter(BodyState* states, const unsigned int* index, int part,
+            Float x, Float y, Float z, Float w) {
+            Scatter4(states, index, part, _mm256_castps256_ps128(x), _mm256_castps256_ps128(y),
+                _mm256_castps256_ps128(z), _mm256_castps256_ps128(w));
+            Scatter4(states, index + 4, part, _mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1),
+                _mm256_extractf128_ps(z, 1), _mm256_extractf128_ps(w, 1));
+        }
+    };
+#endif
+
+    // One lane per pair (a[k], b[k]). Lanes that do not collide get a zero normal
+    // and a zero impulse, so their records are written back unchanged.
+    template <typename L>
+    void ResolveLanes(BodyState* states, const unsigned int* a, const unsigned int* b, float deltaTime) {
+        typedef typename L::Float F;
+        const F zero = L::Set(0.0f);
+
+        F ax, ay, az, ar, avx, avy, avz, aInv;
+        F bx, by, bz, br, bvx, bvy, bvz, bInv;
+        L::Gather(states, a, 0, ax, ay, az, ar);
+        L::Gather(states, a, 1, avx, avy, avz, aInv);
+        L::Gather(states, b, 0, bx, by, bz, br);
+        L::Gather(states, b, 1, bvx, bvy, bvz, bInv);
+
+        F dx = L::Sub(ax, bx), dy = L::Sub(ay, by), dz = L::Sub(az, bz);
+        F dist = L::Sqrt(L::Add(L::Add(L::Mul(dx, dx), L::Mul(dy, dy)), L::Mul(dz, dz)));
+        F minDist = L::Add(ar, br);
+
+        F valid = L::Less(zero, dist);
+        F invDist = L::Select(valid, L::Div(L::Set(1.0f), dist), zero);
+        F nx = L::Mul(dx, invDist), ny = L::Mul(dy, invDist), nz = L::Mul(dz, invDist);
+        F velAlongNormal = L::Add(L::Add(L::Mul(L::Sub(avx, bvx), nx), L::Mul(L::Sub(avy, bvy), ny)),
+            L::Mul(L::Sub(avz, bvz), nz));
+
+        // Split push-out along the normal, for overlapping pairs only.
+        F gap = L::Sub(dist, minDist);
+        F overlap = L::And(L::Less(gap, zero), valid);
+        F halfPush = L::And(overlap, L::Mul(L::Set(-0.5f), gap));
+        F px = L::Mul(halfPush, nx), py = L::Mul(halfPush, ny), pz = L::Mul(halfPush, nz);
+
+        // Touching pairs that approach bounce. Speculative ones, still apart, only lose
+        // the closing speed that would overlap them within the step, so that afterwards
+        // velAlongNormal + gap / deltaTime >= 0.
+        F touching = L::LessEqual(gap, L::Set(CONTACT_SLOP));
+        F bounce = L::Mul(L::Set(-(1.0f + RESTITUTION)), velAlongNormal);
+        F excess = deltaTime > 0.0f ? L::Sub(zero, L::Add(velAlongNormal, L::Mul(gap, L::Set(1.0f / deltaTime)))) : zero;
+        F j = L::Div(L::Max(L::Select(touching, bounce, excess), zero), L::Add(aInv, bInv));
+        j = L::And(valid, j);
+        F ja = L::Mul(j, aInv), jb = L::Mul(j, bInv);
+
+        L::Scatter(states, a, 0, L::Add(ax, px), L::Add(ay, py), L::Add(az, pz), ar);
+        L::Scatter(states, a, 1, L::Add(avx, L::Mul(ja, nx)), L::Add(avy, L::Mul(ja, ny)),
+            L::Add(avz, L::Mul(ja, nz)), aInv);
+        L::Scatter(states, b, 0, L::Sub(bx, px), L::Sub(by, py), L::Sub(bz, pz), br);
+        L::Scatter(states, b, 1, L::Sub(bvx, L::Mul(jb, nx)), L::Sub(bvy, L::Mul(jb, ny)),
+            L::Sub(bvz, L::Mul(jb, nz)), bInv);
+    }
+
+    unsigned int FindFreeBlock(std::vector<unsigned int>& nextFree, unsigned int block) {
+        // Path halving: full blocks point further ahead each time they are passed.
+        while (nextFree[block] != block) {
+            nextFree[block] = nextFree[nextFree[block]];
+            block = nextFree[block];
+        }
+        return block;
+    }
+}
+
+const CollisionPair* SphereNarrowphase::StageBodies(const std::vector<Sphere>& spheres,
+    const std::vector<CollisionPair>& pairs) {
+    const CollisionPair* stagedPairs;
+    bodies.clear();
+    if (2 * pairs.size() >= spheres.size()) {
+        // Most spheres are in a pair: staging all of them costs less than numbering
+        // them, and the pairs can be used as they are.
+        for (size_t i = 0; i < spheres.size(); i++) bodies.push_back(static_cast<unsigned int>(i));
+        stagedPairs = pairs.data();
+    }
+    else {
+        if (bodySlot.size() < spheres.size()) bodySlot.resize(spheres.size(), NO_SLOT);
+
+        // Mark the spheres in pairs, then number them in sphere order, so staging and
+        // writing back walk the spheres front to back.
+        for (const CollisionPair& pair : pairs) bodySlot[pair.a] = bodySlot[pair.b] = 0;
+        for (size_t i = 0; i < spheres.size(); i++) {
+            if (bodySlot[i] == NO_SLOT) continue;
+            bodySlot[i] = static_cast<unsigned int>(bodies.size());
+            bodies.push_back(static_cast<unsigned int>(i));
+        }
+
+        slotPairs.resize(pairs.size());
+        ParallelForRange(pairs.size(), [&](size_t left, size_t right, unsigned int) {
+            for (size_t k = left; k < right; k++) slotPairs[k] = { bodySlot[pairs[k].a], bodySlot[pairs[k].b] };
+        }, 4096);
+        for (unsigned int i : bodies) bodySlot[i] = NO_SLOT;
+        stagedPairs = slotPairs.data();
+    }
+
+    // The spare record sits at the origin with zero radius, so its lanes never collide.
+    states.resize(bodies.size() + 1);
+    ParallelForRange(bodies.size(), [&](size_t left, size_t right, unsigned int) {
+        for (size_t k = left; k < right; k++) {
+            const Sphere& sphere = spheres[bodies[k]];
+            states[k].position = sphere.position;
+            states[k].radius = sphere.mesh->getRadius();
+            states[k].velocity = sphere.velocity;
+            states[k].invMass = 1.0f / sphere.mass;
+        }
+    }, 4096);
+    states.back() = { glm::vec3(0.0f), 0.0f, glm::vec3(0.0f), 1.0f };
+    return stagedPairs;
+}
+
+void SphereNarrowphase::BuildChunk(PairChunk& chunk, const CollisionPair* pairs, size_t count, unsigned int bodyCount) {
+    if (chunk.lastBlock.size() < bodyCount) chunk.lastBlock.resize(bodyCount, -1);
+    std::vector<int>& lastBlock = chunk.lastBlock;
+    std::vector<unsigned int>& blockBodies = chunk.blockBodies;
+    std::vector<unsigned char>& blockFill = chunk.blockFill;
+    std::vector<unsigned int>& nextFree = chunk.nextFree;
+
+    // The last block is always empty, so a search never runs off the end.
+    // Empty slots point at the spare record past the last body.
+    auto addBlock = [&]() {
+        nextFree.push_back(static_cast<unsigned int>(blockFill.size()));
+        blockFill.push_back(0);
+        blockBodies.resize(blockBodies.size() + 2 * BLOCK_SIZE, bodyCount);
+    };
+    addBlock();
+
+    for (size_t k = 0; k < count; k++) {
+        const CollisionPair& pair = pairs[k];
+        int after = std::max(lastBlock[pair.a], lastBlock[pair.b]);
+        unsigned int block = FindFreeBlock(nextFree, static_cast<unsigned int>(after + 1));
+
+        unsigned int* slot = &blockBodies[static_cast<size_t>(block) * 2 * BLOCK_SIZE + blockFill[block]];
+        slot[0] = pair.a;
+        slot[BLOCK_SIZE] = pair.b;
+        if (++blockFill[block] == BLOCK_SIZE) nextFree[block] = block + 1;
+        lastBlock[pair.a] = lastBlock[pair.b] = static_cast<int>(block);
+
+        if (block + 1 == blockFill.size()) addBlock();
+    }
+
+    // Reset for the next call: a short chunk clears only the bodies it touched.
+    if (2 * count >= bodyCount) std::fill(lastBlock.begin(), lastBlock.end(), -1);
+    else for (size_t k = 0; k < count; k++) lastBlock[pairs[k].a] = lastBlock[pairs[k].b] = -1;
+}
+
+void SphereNarrowphase::BuildBlocks(const CollisionPair* pairs, size_t count) {
+    chunks.resize(NumWorkerThreads());
+    for (PairChunk& chunk : chunks) {
+        chunk.blockBodies.clear();
+        chunk.blockFill.clear();
+        chunk.nextFree.clear();
+    }
+
+    // Chunks that get no batch stay empty and are skipped.
+    unsigned int bodyCount = static_cast<unsigned int>(bodies.size());
+    ParallelForRange(count, [&](size_t left, size_t right, unsigned int batch) {
+        BuildChunk(chunks[batch], pairs + left, right - left, bodyCount);
+    }, MIN_CHUNK_PAIRS);
+    pairCount = count;
+}
+
+void SphereNarrowphase::Resolve(std::vector<Sphere>& spheres, const std::vector<CollisionPair>& pairs,
+    float deltaTime) {
+    if (pairs.empty()) return;
+    BuildBlocks(StageBodies(spheres, pairs), pairs.size());
+
+    // Chunks run one after another: a later chunk may share bodies with an earlier one.
+    BodyState* data = states.data();
+    for (const PairChunk& chunk : chunks) {
+        for (size_t block = 0; block < chunk.blockFill.size(); block++) {
+            int fill = chunk.blockFill[block];
+            if (fill == 0) continue;
+
+            const unsigned int* a = &chunk.blockBodies[block * 2 * BLOCK_SIZE];
+            const unsigned int* b = a + BLOCK_SIZE;
+#ifdef __AVX__
+            ResolveLanes<AVXStates>(data, a, b, deltaTime);
+#else
+            ResolveLanes<SSEStates>(data, a, b, deltaTime);
+            if (fill > SSELanes::WIDTH) ResolveLanes<SSEStates>(data, a + SSELanes::WIDTH, b + SSELanes::WIDTH, deltaTime);
+#endif
+        }
+    }
+
+    ParallelForRange(bodies.size(), [&](size_t left, size_t right, unsigned int) {
+        for (size_t k = left; k < right; k++) {
+            Sphere& sphere = spheres[bodies[k]];
+            sphere.position = states[k].position;
+            sphere.velocity = states[k].velocity;
+        }
+    }, 4096);
+}
+
+size_t SphereNarrowphase::getBlockCount() const {
+    size_t blocks = 0;
+    for (const PairChunk& chunk : chunks) {
+        if (!chunk.blockFill.empty()) blocks += chunk.blockFill.size() - 1;
+    }
+    return blocks;
+}
+
+float SphereNarrowphase::getOccupancy() const {
+    size_t blocks = getBlockCount();
+    if (blocks == 0) return 0.0f;
+    return static_cast<float>(pairCount) / static_cast<float>(blocks * BLOCK_SIZE);
+}
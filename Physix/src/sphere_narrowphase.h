@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include "broadphase.h"
+#include "sphere.h"
+
+// Vectorized version of Sphere::ResolveSphereCollision over a list of pairs.
+// The spheres are first staged as compact 32-byte records (position, radius,
+// velocity, inverse mass). Pairs are packed into blocks of BLOCK_SIZE in which no
+// sphere appears twice, so a block is resolved as SIMD lanes: records are gathered
+// with 4x4 transposes, the push-out and elastic impulse are computed branch-free
+// with masks, and the results are scattered back (one AVX block or two SSE halves).
+// A pair goes into the first free block after every block already holding one of
+// its spheres, so each sphere still sees its pairs in input order and the result
+// matches resolving the pairs one after another. The pair list is cut into
+// contiguous chunks whose blocks are built in parallel and resolved in chunk
+// order, which keeps that guarantee. When few spheres are in pairs, only those
+// are staged.
+// Pairs that are still apart but close their gap within deltaTime are speculative
+// contacts: they lose just the closing speed that would overlap them by the end of
+// the step, so fast spheres cannot pass through each other, and only bounce once
+// they touch. A deltaTime of zero resolves overlapping pairs only.
+class SphereNarrowphase {
+public:
+    static const int BLOCK_SIZE = 8;
+
+    void Resolve(std::vector<Sphere>& spheres, const std::vector<CollisionPair>& pairs, float deltaTime);
+
+    size_t getBlockCount() const;
+    // Spheres staged by the last Resolve().
+    size_t getStagedCount() const { return bodies.size(); }
+    // Average number of used lanes per block in the last Resolve().
+    float getOccupancy() const;
+
+    // Staged sphere state; 16-byte aligned so a half loads as one SSE register.
+    struct alignas(16) BodyState {
+        glm::vec3 position;
+        float radius;
+        glm::vec3 velocity;
+        float invMass;
+    };
+
+private:
+    // Fewest pairs worth a chunk of their own.
+    static const size_t MIN_CHUNK_PAIRS = 2048;
+
+    // Blocks of one contiguous run of pairs, over staged body slots.
+    struct PairChunk {
+        // Per block, the BLOCK_SIZE first bodies of its pairs and then the second
+        // ones, so a block is one cache line.
+        std::vector<unsigned int> blockBodies;
+        std::vector<unsigned char> blockFill;
+        std::vector<unsigned int> nextFree;     // union-find over full blocks
+        std::vector<int> lastBlock;             // per body slot, -1 between calls
+    };
+
+    std::vector<unsigned int> bodySlot;     // per sphere, unset between calls
+    std::vector<unsigned int> bodies;       // sphere of each staged slot
+    std::vector<CollisionPair> slotPairs;   // the pairs over body slots
+    std::vector<BodyState> states;          // one extra entry used by empty lanes
+    std::vector<PairChunk> chunks;
+    size_t pairCount = 0;
+
+    // Returns the pairs over body slots.
+    const CollisionPair* StageBodies(const std::vector<Sphere>& spheres, const std::vector<CollisionPair>& pairs);
+    void BuildBlocks(const CollisionPair* pairs, size_t count);
+    static void BuildChunk(PairChunk& chunk, const CollisionPair* pairs, size_t count, unsigned int bodyCount);
+};
@@ -0,0 +1,123 @@
+#include "static_bvh.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+    const int SAH_BINS = 12;
+}
+
+void StaticBVH::Build(const std::vector<Cuboid>& cuboids) {
+    unsigned int count = static_cast<unsigned int>(cuboids.size());
+    nodes.clear();
+    depth = 0;
+    items.resize(count);
+    itemBounds.resize(count);
+    if (count == 0) return;
+
+    std::vector<AABB> bounds(count);
+    std::vector<glm::vec3> centers(count);
+    for (unsigned int i = 0; i < count; i++) {
+        bounds[i] = cuboids[i].getBounds();
+        centers[i] = bounds[i].Center();
+        items[i] = i;
+    }
+
+    nodes.reserve(2 * static_cast<size_t>(count));
+    BuildRange(bounds, centers, 0, count, 0);
+
+    // Store the bounds in leaf order, next to the item indices.
+    for (unsigned int k = 0; k < count; k++) {
+        itemBounds[k] = bounds[items[k]];
+    }
+    nodes.shrink_to_fit();
+}
+
+void StaticBVH::BuildRange(const std::vector<AABB>& bounds, const std::vector<glm::vec3>& centers,
+    unsigned int first, unsigned int count, unsigned int level) {
+    depth = std::max(depth, level);
+    unsigned int index = static_cast<unsigned int>(nodes.size());
+    nodes.emplace_back();
+
+    AABB box = bounds[items[first]];
+    AABB centerBox = { centers[items[first]], centers[items[first]] };
+    for (unsigned int k = first; k < first + count; k++) {
+        box = Merge(box, bounds[items[k]]);
+        centerBox.min = glm::min(centerBox.min, centers[items[k]]);
+        centerBox.max = glm::max(centerBox.max, centers[items[k]]);
+    }
+    nodes[index].min = box.min;
+    nodes[index].max = box.max;
+
+    if (count <= MAX_LEAF_SIZE) {
+        nodes[index].offset = first;
+        nodes[index].count = count;
+        return;
+    }
+
+    // Binned SAH: bucket the centers on each axis and evaluate every bin boundary.
+    int bestAxis = -1;
+    int bestSplit = 0;
+    float bestCost = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; axis++) {
+        float lo = centerBox.min[axis];
+        float extent = centerBox.max[axis] - lo;
+        if (extent <= 0.0f) continue;
+
+        int binCount[SAH_BINS] = {};
+        AABB binBox[SAH_BINS];
+        for (unsigned int k = first; k < first + count; k++) {
+            int bin = std::min(SAH_BINS - 1, static_cast<int>(SAH_BINS * (centers[items[k]][axis] - lo) / extent));
+            binBox[bin] = binCount[bin] == 0 ? bounds[items[k]] : Merge(binBox[bin], bounds[items[k]]);
+            binCount[bin]++;
+        }
+
+        for (int split = 1; split < SAH_BINS; split++) {
+            int leftCount = 0, rightCount = 0;
+            AABB leftBox = {}, rightBox = {};
+            for (int b = 0; b < split; b++) {
+                if (binCount[b] == 0) continue;
+                leftBox = leftCount == 0 ? binBox[b] : Merge(leftBox, binBox[b]);
+                leftCount += binCount[b];
+            }
+            for (int b = split; b < SAH_BINS; b++) {
+                if (binCount[b] == 0) continue;
+                rightBox = rightCount == 0 ? binBox[b] : Merge(rightBox, binBox[b]);
+                rightCount += binCount[b];
+            }
+            if (leftCount == 0 || rightCount == 0) continue;
+
+            float cost = leftCount * leftBox.SurfaceArea() + rightCount * rightBox.SurfaceArea();
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    unsigned int mid;
+    if (bestAxis >= 0) {
+        float lo = centerBox.min[bestAxis];
+        float extent = centerBox.max[bestAxis] - lo;
+        auto middle = std::partition(items.begin() + first, items.begin() + first + count, [&](unsigned int item) {
+            int bin = std::min(SAH_BINS - 1, static_cast<int>(SAH_BINS * (centers[item][bestAxis] - lo) / extent));
+            return bin < bestSplit;
+            });
+        mid = static_cast<unsigned int>(middle - items.begin());
+    }
+    else {
+        // All centers coincide: split the range in half.
+        mid = first + count / 2;
+    }
+
+    BuildRange(bounds, centers, first, mid - first, level + 1);
+    nodes[index].offset = static_cast<unsigned int>(nodes.size());
+    nodes[index].count = 0;
+    BuildRange(bounds, centers, mid, first + count - mid, level + 1);
+}
+
+size_t StaticBVH::getMemoryUsage() const {
+    return nodes.capacity() * sizeof(StaticBVHNode) +
+        items.capacity() * sizeof(unsigned int) +
+        itemBounds.capacity() * sizeof(AABB);
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "aabb.h"
+#include "cuboid.h"
+
+// 32-byte node of the static BVH, stored depth-first: the left child of an
+// internal node is the next node, 'offset' is the index of its right child.
+// For a leaf (count > 0), 'offset' is the first entry in the item array.
+struct StaticBVHNode {
+    glm::vec3 min;
+    unsigned int offset;
+    glm::vec3 max;
+    unsigned int count;
+};
+
+// Immutable acceleration structure for static colliders (the Cuboid walls and
+// level geometry). Built once with a binned SAH split, separate from the dynamic
+// body broadphase, so a sphere only tests the few boxes near it.
+class StaticBVH {
+public:
+    static const unsigned int MAX_LEAF_SIZE = 4;
+    static const unsigned int STACK_SIZE = 64;
+
+    // Builds the tree over the world bounds of every Cuboid; call again only if
+    // the static set itself changes.
+    void Build(const std::vector<Cuboid>& cuboids);
+
+    // Calls callback(cuboidIndex) for every Cuboid whose bounds overlap 'box'.
+    template <typename Callback>
+    void Query(const AABB& box, Callback callback) const;
+
+    size_t getNodeCount() const { return nodes.size(); }
+    // Levels below the root; a leaf-only tree has depth 0.
+    unsigned int getDepth() const { return depth; }
+    size_t getItemCount() const { return items.size(); }
+    size_t getMemoryUsage() const;
+    const std::vector<StaticBVHNode>& getNodes() const { return nodes; }
+    // Cuboid index of the item at slot k in leaf order.
+    unsigned int getItem(size_t k) const { return items[k]; }
+
+private:
+    std::vector<StaticBVHNode> nodes;
+    std::vector<unsigned int> items;      // Cuboid indices in leaf order
+    std::vector<AABB> itemBounds;         // bounds in leaf order
+    unsigned int depth = 0;
+
+    void BuildRange(const std::vector<AABB>& bounds, const std::vector<glm::vec3>& centers,
+        unsigned int first, unsigned int count, unsigned int level);
+};
+
+template <typename Callback>
+void StaticBVH::Query(const AABB& box, Callback callback) const {
+    if (nodes.empty()) return;
+
+    // Depth-first, a query holds at most depth + 1 nodes. SAH splits of level
+    // geometry stay well inside the fixed stack; a degenerate tree spills to the heap.
+    unsigned int fixedStack[STACK_SIZE];
+    std::vector<unsigned int> heapStack;
+    unsigned int* stack = fixedStack;
+    if (depth >= STACK_SIZE) {
+        heapStack.resize(static_cast<size_t>(depth) + 1);
+        stack = heapStack.data();
+    }
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        unsigned int index = stack[--top];
+        const StaticBVHNode& node = nodes[index];
+        if (node.min.x > box.max.x || node.max.x < box.min.x ||
+            node.min.y > box.max.y || node.max.y < box.min.y ||
+            node.min.z > box.max.z || node.max.z < box.min.z) continue;
+
+        if (node.count > 0) {
+            for (unsigned int k = node.offset; k < node.offset + node.count; k++) {
+                if (itemBounds[k].Overlaps(box)) callback(items[k]);
+            }
+        }
+        else {
+            stack[top++] = node.offset;
+            stack[top++] = index + 1;
+        }
+    }
+}
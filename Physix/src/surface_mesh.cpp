@@ -0,0 +1,53 @@
+#include "surface_mesh.h"
+
+Surface_mesh::Surface_mesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices)
+    : VAO(0), VBO(0), vertexCount(0)
+{
+    std::vector<float> vertices;
+    generateSurfaceMesh(positions, indices, vertices);
+    vertexCount = static_cast<unsigned int>(vertices.size() / 6);
+
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+
+    // Create and fill VBO. Every triangle gets its own vertices for flat shading, so no EBO.
+    glGenBuffers(1, &VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+
+    // Set vertex attributes: Position (location 0) and Normal (location 1).
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    glBindVertexArray(0);
+}
+
+Surface_mesh::~Surface_mesh() {
+    glDeleteVertexArrays(1, &VAO);
+    glDeleteBuffers(1, &VBO);
+}
+
+void Surface_mesh::render() const {
+    glBindVertexArray(VAO);
+    glDrawArrays(GL_TRIANGLES, 0, vertexCount);
+    glBindVertexArray(0);
+}
+
+void Surface_mesh::generateSurfaceMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+    std::vector<float>& vertices)
+{
+    // Each vertex: position (3 floats) then the triangle's normal (3 floats).
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        const glm::vec3& a = positions[indices[t]];
+        const glm::vec3& b = positions[indices[t + 1]];
+        const glm::vec3& c = positions[indices[t + 2]];
+        glm::vec3 n = glm::cross(b - a, c - a);
+        float length = glm::length(n);
+        if (length > 0.0f) n /= length;
+        for (const glm::vec3* p : { &a, &b, &c }) {
+            vertices.insert(vertices.end(), { p->x, p->y, p->z, n.x, n.y, n.z });
+        }
+    }
+}
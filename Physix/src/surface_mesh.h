@@ -0,0 +1,24 @@
+#pragma once
+#include <vector>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+class Surface_mesh {
+public:
+    // Constructor: creates a flat-shaded mesh from an indexed triangle list.
+    Surface_mesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+
+    // Destructor: cleans up allocated OpenGL resources.
+    ~Surface_mesh();
+
+    // Render the surface mesh.
+    void render() const;
+
+private:
+    unsigned int VAO, VBO;
+    unsigned int vertexCount;
+
+    // Helper function to generate vertices (with face normals) for every triangle.
+    void generateSurfaceMesh(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices,
+        std::vector<float>& vertices);
+};
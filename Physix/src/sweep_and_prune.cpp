@@ -0,0 +1,113 @@
+#include "sweep_and_prune.h"
+#include <algorithm>
+
+SweepAndPrune::SweepAndPrune() : swapCount(0) {
+}
+
+void SweepAndPrune::Update(const std::vector<Sphere>& spheres) {
+    size_t count = spheres.size();
+    bool resized = count != bounds.size();
+
+    bounds.resize(count);
+    positions.resize(count);
+    radii.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        positions[i] = spheres[i].position;
+        radii[i] = ReachRadius(spheres[i]);
+        bounds[i] = AABB::FromSphere(positions[i], radii[i]);
+    }
+
+    swapCount = 0;
+    if (resized) {
+        Rebuild();
+        return;
+    }
+
+    // Refresh endpoint values in place, then repair the nearly sorted order.
+    for (int axis = 0; axis < 3; axis++) {
+        for (SAPEndpoint& e : endpoints[axis]) {
+            const AABB& box = bounds[e.Body()];
+            e.value = e.IsMax() ? box.max[axis] : box.min[axis];
+        }
+        SortAxis(axis);
+    }
+}
+
+void SweepAndPrune::SortAxis(int axis) {
+    std::vector<SAPEndpoint>& e = endpoints[axis];
+
+    for (size_t i = 1; i < e.size(); i++) {
+        SAPEndpoint key = e[i];
+        size_t j = i;
+        while (j > 0 && e[j - 1].value > key.value) {
+            const SAPEndpoint& other = e[j - 1];
+            if (!key.IsMax() && other.IsMax()) {
+                // A min moved below another body's max: the intervals start to overlap.
+                if (BoundsOverlap(key.Body(), other.Body())) {
+                    overlaps.insert(PairKey(key.Body(), other.Body()));
+                }
+            }
+            else if (key.IsMax() && !other.IsMax()) {
+                // A max moved below another body's min: the intervals separate.
+                overlaps.erase(PairKey(key.Body(), other.Body()));
+            }
+            e[j] = other;
+            j--;
+            swapCount++;
+        }
+        e[j] = key;
+    }
+}
+
+void SweepAndPrune::Rebuild() {
+    unsigned int count = static_cast<unsigned int>(bounds.size());
+    overlaps.clear();
+
+    for (int axis = 0; axis < 3; axis++) {
+        std::vector<SAPEndpoint>& e = endpoints[axis];
+        e.resize(2 * static_cast<size_t>(count));
+        for (unsigned int i = 0; i < count; i++) {
+            e[2 * i] = { bounds[i].min[axis], i << 1 };
+            e[2 * i + 1] = { bounds[i].max[axis], (i << 1) | 1u };
+        }
+        // On ties a min sorts before a max, so every interval opens before it closes.
+        std::sort(e.begin(), e.end(), [](const SAPEndpoint& a, const SAPEndpoint& b) {
+            if (a.value != b.value) return a.value < b.value;
+            return !a.IsMax() && b.IsMax();
+            });
+    }
+
+    // Sweep the x axis once, keeping the set of open intervals.
+    std::vector<unsigned int> active;
+    for (const SAPEndpoint& e : endpoints[0]) {
+        unsigned int body = e.Body();
+        if (e.IsMax()) {
+            active.erase(std::find(active.begin(), active.end(), body));
+            continue;
+        }
+        for (unsigned int other : active) {
+            if (BoundsOverlap(body, other)) overlaps.insert(PairKey(body, other));
+        }
+        active.push_back(body);
+    }
+}
+
+void SweepAndPrune::FindPairs(std::vector<CollisionPair>& pairs) {
+    // Box overlap is conservative; keep only the pairs whose spheres touch.
+    for (unsigned long long key : overlaps) {
+        unsigned int a = static_cast<unsigned int>(key >> 32);
+        unsigned int b = static_cast<unsigned int>(key & 0xffffffffu);
+        if (SpheresOverlap(positions[a], radii[a], positions[b], radii[b])) {
+            pairs.push_back({ a, b });
+        }
+    }
+}
+
+size_t SweepAndPrune::getMemoryUsage() const {
+    // The overlap set is a node-based hash table: one bucket pointer per bucket,
+    // and one node (key plus next pointer) per overlap.
+    size_t setBytes = overlaps.bucket_count() * sizeof(void*) +
+        overlaps.size() * (sizeof(unsigned long long) + sizeof(void*));
+    return VectorBytes(endpoints[0]) + VectorBytes(endpoints[1]) + VectorBytes(endpoints[2]) +
+        VectorBytes(bounds) + VectorBytes(positions) + VectorBytes(radii) + setBytes;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <algorithm>
+#include <unordered_set>
+#include <vector>
+#include "aabb.h"
+#include "broadphase.h"
+
+// One end of a body's interval on an axis.
+struct SAPEndpoint {
+    float value;
+    unsigned int data;   // body index << 1 | 1 for a max endpoint
+
+    unsigned int Body() const { return data >> 1; }
+    bool IsMax() const { return (data & 1u) != 0; }
+};
+
+// Incremental sweep-and-prune broadphase.
+// The sorted endpoint arrays of all three axes are kept between substeps and
+// re-sorted with insertion sort, which is close to O(n) when bodies only move a
+// little. The set of AABB-overlapping pairs is persistent: it is only changed by
+// the endpoint swaps that insertion sort performs.
+class SweepAndPrune : public Broadphase {
+public:
+    SweepAndPrune();
+
+    void Update(const std::vector<Sphere>& spheres) override;
+    void FindPairs(std::vector<CollisionPair>& pairs) override;
+    const char* getName() const override { return "SweepAndPrune"; }
+    size_t getMemoryUsage() const override;
+
+    // Endpoint swaps performed by the last Update().
+    size_t getSwapCount() const { return swapCount; }
+    // Pairs whose boxes currently overlap (before the exact sphere test).
+    size_t getOverlapCount() const { return overlaps.size(); }
+
+private:
+    std::vector<SAPEndpoint> endpoints[3];
+    std::vector<AABB> bounds;
+    std::vector<glm::vec3> positions;
+    std::vector<float> radii;
+    std::unordered_set<unsigned long long> overlaps;
+    size_t swapCount;
+
+    // Full sort and sweep, used when bodies are added.
+    void Rebuild();
+    void SortAxis(int axis);
+    bool BoundsOverlap(unsigned int a, unsigned int b) const { return bounds[a].Overlaps(bounds[b]); }
+
+    static unsigned long long PairKey(unsigned int a, unsigned int b) {
+        if (a > b) std::swap(a, b);
+        return (static_cast<unsigned long long>(a) << 32) | b;
+    }
+};
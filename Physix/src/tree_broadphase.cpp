@@ -0,0 +1,95 @@
+#include "tree_broadphase.h"
+#include "parallel.h"
+
+TreeBroadphase::TreeBroadphase(float margin) : tree(margin), reinsertCount(0) {
+}
+
+void TreeBroadphase::SetCuboids(const std::vector<Cuboid>& cuboids) {
+    for (int proxy : cuboidProxies) {
+        tree.DestroyProxy(proxy);
+    }
+    cuboidProxies.clear();
+
+    for (size_t i = 0; i < cuboids.size(); i++) {
+        unsigned int userData = static_cast<unsigned int>(i) | CUBOID_PROXY;
+        cuboidProxies.push_back(tree.CreateProxy(cuboids[i].getBounds(), userData));
+    }
+}
+
+void TreeBroadphase::Update(const std::vector<Sphere>& spheres) {
+    size_t count = spheres.size();
+    reinsertCount = 0;
+
+    // Spheres are only ever appended, so existing proxies keep their index.
+    while (sphereProxies.size() > count) {
+        tree.DestroyProxy(sphereProxies.back());
+        sphereProxies.pop_back();
+    }
+
+    positions.resize(count);
+    radii.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 position = spheres[i].position;
+        float radius = ReachRadius(spheres[i]);
+        AABB box = AABB::FromSphere(position, radius);
+
+        if (i < sphereProxies.size()) {
+            glm::vec3 displacement = position - positions[i];
+            if (tree.MoveProxy(sphereProxies[i], box, displacement)) reinsertCount++;
+        }
+        else {
+            sphereProxies.push_back(tree.CreateProxy(box, static_cast<unsigned int>(i)));
+        }
+        positions[i] = position;
+        radii[i] = radius;
+    }
+}
+
+void TreeBroadphase::FindPairs(std::vector<CollisionPair>& pairs) {
+    size_t count = positions.size();
+    unsigned int num_threads = NumWorkerThreads();
+    threadPairs.resize(num_threads);
+    threadCuboidPairs.resize(num_threads);
+
+    // The tree is read-only here, so the queries run in parallel.
+    ParallelForRange(count, [&](size_t left, size_t right, unsigned int thread_id) {
+        std::vector<CollisionPair>& out = threadPairs[thread_id];
+        std::vector<CollisionPair>& cuboidOut = threadCuboidPairs[thread_id];
+        out.clear();
+        cuboidOut.clear();
+
+        TreeQueryStats stats;
+        for (size_t s = left; s < right; s++) {
+            unsigned int i = static_cast<unsigned int>(s);
+            AABB box = AABB::FromSphere(positions[i], radii[i]);
+
+            tree.Query(box, [&](int proxyId) {
+                unsigned int userData = tree.getUserData(proxyId);
+                if (userData & CUBOID_PROXY) {
+                    cuboidOut.push_back({ i, userData & ~CUBOID_PROXY });
+                    return;
+                }
+                unsigned int j = userData;
+                if (j <= i) return;
+                if (SpheresOverlap(positions[i], radii[i], positions[j], radii[j])) {
+                    out.push_back({ i, j });
+                }
+            }, &stats);
+        }
+        tree.AddQueryStats(stats);
+    });
+
+    cuboidPairs.clear();
+    for (unsigned int t = 0; t < num_threads; t++) {
+        pairs.insert(pairs.end(), threadPairs[t].begin(), threadPairs[t].end());
+        cuboidPairs.insert(cuboidPairs.end(), threadCuboidPairs[t].begin(), threadCuboidPairs[t].end());
+        threadPairs[t].clear();
+        threadCuboidPairs[t].clear();
+    }
+}
+
+size_t TreeBroadphase::getMemoryUsage() const {
+    return tree.getMemoryUsage() + VectorBytes(sphereProxies) + VectorBytes(cuboidProxies) +
+        VectorBytes(positions) + VectorBytes(radii) + VectorBytes(cuboidPairs) +
+        VectorBytes(threadPairs) + VectorBytes(threadCuboidPairs);
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "aabb_tree.h"
+#include "broadphase.h"
+#include "cuboid.h"
+
+// Broadphase backed by a dynamic AABB tree that holds both Sphere and Cuboid
+// proxies. Suited to scenes with very uneven density, where a uniform grid
+// would waste memory on empty cells.
+class TreeBroadphase : public Broadphase {
+public:
+    // Proxy user data: the body index, with the top bit set for Cuboids.
+    static const unsigned int CUBOID_PROXY = 0x80000000u;
+
+    TreeBroadphase(float margin = 0.1f);
+
+    // Registers the Cuboids once; they are static and never moved.
+    void SetCuboids(const std::vector<Cuboid>& cuboids);
+
+    void Update(const std::vector<Sphere>& spheres) override;
+    void FindPairs(std::vector<CollisionPair>& pairs) override;
+    const char* getName() const override { return "AABBTree"; }
+    size_t getMemoryUsage() const override;
+
+    // Sphere/Cuboid candidates from the last FindPairs(), as (sphere, cuboid) pairs.
+    const std::vector<CollisionPair>& getCuboidPairs() const { return cuboidPairs; }
+
+    const AABBTree& getTree() const { return tree; }
+    int getNodeCount() const { return tree.getNodeCount(); }
+    float getAverageQueryCost() const { return tree.getAverageQueryCost(); }
+    // Number of proxies reinserted by the last Update().
+    size_t getReinsertCount() const { return reinsertCount; }
+
+private:
+    AABBTree tree;
+    std::vector<int> sphereProxies;
+    std::vector<int> cuboidProxies;
+    std::vector<glm::vec3> positions;
+    std::vector<float> radii;
+    size_t reinsertCount;
+
+    std::vector<CollisionPair> cuboidPairs;
+    std::vector<std::vector<CollisionPair>> threadPairs;
+    std::vector<std::vector<CollisionPair>> threadCuboidPairs;
+};
@@ -0,0 +1,425 @@
+#include "triangle_mesh.h"
+#include "simd_lanes.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace {
+    const int SAH_BINS = 12;
+    // Same response as the walls: perfectly elastic, and pushed a little past the
+    // surface, since a triangle has no thickness to stop the next substep's tunnelling.
+    const float RESTITUTION = 1.0f;
+    const float SEPARATION = 0.5f;
+
+    // Pending node of the iterative build: triangles order[first, first + count),
+    // and the node whose right child it is (or -1).
+    struct BuildTask {
+        unsigned int first;
+        unsigned int count;
+        int parent;
+    };
+
+    // Node of the binary tree that is collapsed into the BVH4. The left child
+    // follows its parent; 'right' is the right child, or for a leaf the packet.
+    struct BinaryNode {
+        AABB box;
+        unsigned int right;
+        unsigned int count;      // triangles of a leaf, 0 for inner nodes
+    };
+
+    // Binned SAH split of order[first, first + count); returns the split point, or
+    // 'first' if every center lies in the same place.
+    unsigned int SplitSAH(const std::vector<AABB>& bounds, const std::vector<glm::vec3>& centers,
+        std::vector<unsigned int>& order, unsigned int first, unsigned int count, const AABB& centerBox) {
+        int bestAxis = -1;
+        int bestSplit = 0;
+        float bestCost = std::numeric_limits<float>::max();
+        for (int axis = 0; axis < 3; axis++) {
+            float lo = centerBox.min[axis];
+            float extent = centerBox.max[axis] - lo;
+            if (extent <= 0.0f) continue;
+
+            int binCount[SAH_BINS] = {};
+            AABB binBox[SAH_BINS];
+            for (unsigned int k = first; k < first + count; k++) {
+                unsigned int item = order[k];
+                int bin = std::min(SAH_BINS - 1, static_cast<int>(SAH_BINS * (centers[item][axis] - lo) / extent));
+                binBox[bin] = binCount[bin] == 0 ? bounds[item] : Merge(binBox[bin], bounds[item]);
+                binCount[bin]++;
+            }
+
+            // Sweep from the right once, then from the left, instead of merging per split.
+            float rightArea[SAH_BINS];
+            int rightCount[SAH_BINS];
+            AABB box = {};
+            int n = 0;
+            for (int b = SAH_BINS - 1; b > 0; b--) {
+                if (binCount[b] > 0) {
+                    box = n == 0 ? binBox[b] : Merge(box, binBox[b]);
+                    n += binCount[b];
+                }
+                rightArea[b] = n > 0 ? box.SurfaceArea() : 0.0f;
+                rightCount[b] = n;
+            }
+            n = 0;
+            for (int split = 1; split < SAH_BINS; split++) {
+                int b = split - 1;
+                if (binCount[b] > 0) {
+                    box = n == 0 ? binBox[b] : Merge(box, binBox[b]);
+                    n += binCount[b];
+                }
+                if (n == 0 || rightCount[split] == 0) continue;
+
+                float cost = n * box.SurfaceArea() + rightCount[split] * rightArea[split];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+        if (bestAxis < 0) return first;
+
+        float lo = centerBox.min[bestAxis];
+        float extent = centerBox.max[bestAxis] - lo;
+        auto middle = std::partition(order.begin() + first, order.begin() + first + count, [&](unsigned int item) {
+            int bin = std::min(SAH_BINS - 1, static_cast<int>(SAH_BINS * (centers[item][bestAxis] - lo) / extent));
+            return bin < bestSplit;
+        });
+        return static_cast<unsigned int>(middle - order.begin());
+    }
+
+    // Squared distance from p to the triangles in lanes [first, first + L::WIDTH),
+    // as a bit mask of the lanes closer than r. Inside the triangle the distance is
+    // to the plane, otherwise to the nearest of the three edges. Degenerate
+    // triangles produce NaN weights, which fail the inside test and clamp to an edge end.
+    template <typename L>
+    unsigned int TouchMask(const TrianglePacket& packet, int first, const glm::vec3& p, float r) {
+        typedef typename L::Float F;
+        const F zero = L::Set(0.0f);
+        const F one = L::Set(1.0f);
+
+        F ap[3], e1[3], e2[3];
+        for (int i = 0; i < 3; i++) {
+            ap[i] = L::Sub(L::Set(p[i]), L::Load(packet.v0[i] + first));
+            e1[i] = L::Load(packet.edge1[i] + first);
+            e2[i] = L::Load(packet.edge2[i] + first);
+        }
+        auto dot = [](const F* a, const F* b) {
+            return L::Add(L::Add(L::Mul(a[0], b[0]), L::Mul(a[1], b[1])), L::Mul(a[2], b[2]));
+        };
+        auto clamp01 = [&](F t) { return L::Max(L::Min(t, one), zero); };
+        auto distance2 = [&](const F* base, const F* edge, F t) {
+            F d[3];
+            for (int i = 0; i < 3; i++) d[i] = L::Sub(base[i], L::Mul(t, edge[i]));
+            return dot(d, d);
+        };
+
+        F d00 = dot(e1, e1), d01 = dot(e1, e2), d11 = dot(e2, e2);
+        F d20 = dot(ap, e1), d21 = dot(ap, e2);
+        F invDenom = L::Div(one, L::Sub(L::Mul(d00, d11), L::Mul(d01, d01)));
+        F v = L::Mul(L::Sub(L::Mul(d11, d20), L::Mul(d01, d21)), invDenom);
+        F w = L::Mul(L::Sub(L::Mul(d00, d21), L::Mul(d01, d20)), invDenom);
+        F inside = L::And(L::And(L::LessEqual(zero, v), L::LessEqual(zero, w)), L::LessEqual(L::Add(v, w), one));
+
+        F plane[3];
+        for (int i = 0; i < 3; i++) plane[i] = L::Sub(L::Sub(ap[i], L::Mul(v, e1[i])), L::Mul(w, e2[i]));
+        F planeDistance2 = dot(plane, plane);
+
+        F bp[3], e3[3];
+        for (int i = 0; i < 3; i++) {
+            bp[i] = L::Sub(ap[i], e1[i]);
+            e3[i] = L::Sub(e2[i], e1[i]);
+        }
+        F edgeDistance2 = L::Min(
+            L::Min(distance2(ap, e1, clamp01(L::Div(d20, d00))), distance2(ap, e2, clamp01(L::Div(d21, d11)))),
+            distance2(bp, e3, clamp01(L::Div(dot(bp, e3), dot(e3, e3)))));
+
+        F closest2 = L::Select(inside, planeDistance2, edgeDistance2);
+        return L::MoveMask(L::Less(closest2, L::Set(r * r)));
+    }
+
+    // 'reach' is the radius grown by the distance the sphere covers in deltaTime.
+    void ResolveTriangle(Sphere& sphere, float r, float reach, float deltaTime, const TrianglePacket& packet, int lane) {
+        glm::vec3 a(packet.v0[0][lane], packet.v0[1][lane], packet.v0[2][lane]);
+        glm::vec3 e1(packet.edge1[0][lane], packet.edge1[1][lane], packet.edge1[2][lane]);
+        glm::vec3 e2(packet.edge2[0][lane], packet.edge2[1][lane], packet.edge2[2][lane]);
+
+        // The position may have moved since the SIMD test, so test again.
+        glm::vec3 offset = sphere.position - ClosestPointOnTriangle(sphere.position, a, a + e1, a + e2);
+        float dist2 = glm::dot(offset, offset);
+        if (dist2 >= reach * reach) return;
+
+        glm::vec3 normal;
+        float penetration;
+        if (dist2 > 0.0f) {
+            float dist = std::sqrt(dist2);
+            normal = offset / dist;
+            penetration = r - dist;
+            if (penetration <= 0.0f) {
+                // Touching, it bounces; further off it is a speculative contact and only
+                // loses the speed that would carry it past the surface within the step.
+                // Either way it stays where it is: moving it onto the surface would make
+                // the neighbouring triangles push it out again.
+                float velAlongNormal = glm::dot(sphere.velocity, normal);
+                float excess = -penetration <= CONTACT_SLOP ? -(1.0f + RESTITUTION) * velAlongNormal :
+                    -(velAlongNormal - penetration / deltaTime);
+                if (excess > 0.0f) sphere.velocity += excess * normal;
+                return;
+            }
+        }
+        else {
+            // Center on the triangle: back out against the direction of travel.
+            glm::vec3 n = glm::cross(e1, e2);
+            float length = glm::length(n);
+            if (length == 0.0f) return;
+            normal = glm::dot(n, sphere.velocity) > 0.0f ? -n / length : n / length;
+            penetration = r;
+        }
+
+        sphere.position += (penetration + SEPARATION) * normal;
+        float velAlongNormal = glm::dot(sphere.velocity, normal);
+        if (velAlongNormal < 0.0f) sphere.velocity -= (1.0f + RESTITUTION) * velAlongNormal * normal;
+    }
+}
+
+// Ericson, Real-Time Collision Detection 5.1.5.
+glm::vec3 ClosestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+    glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+    float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+    glm::vec3 bp = p - b;
+    float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + (d1 / (d1 - d3)) * ab;
+
+    glm::vec3 cp = p - c;
+    float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + (d2 / (d2 - d6)) * ac;
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) return b + ((d4 - d3) / ((d4 - d3) + (d5 - d6))) * (c - b);
+
+    float sum = va + vb + vc;
+    if (!(sum > 0.0f)) return a;
+    return a + (vb / sum) * ab + (vc / sum) * ac;
+}
+
+TriangleMesh::TriangleMesh()
+    : triangleCount(0), bounds{ glm::vec3(0.0f), glm::vec3(0.0f) }, quantizeScale(0.0f), depth(0),
+    queryCount(0), queryVisits(0) {
+}
+
+void TriangleMesh::Build(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices) {
+    triangleCount = indices.size() / 3;
+    nodes.clear();
+    packets.clear();
+    depth = 0;
+    if (triangleCount == 0) return;
+
+    unsigned int count = static_cast<unsigned int>(triangleCount);
+    std::vector<AABB> triangleBounds(count);
+    std::vector<glm::vec3> centers(count);
+    std::vector<unsigned int> order(count);
+    for (unsigned int t = 0; t < count; t++) {
+        const glm::vec3& a = vertices[indices[3 * t]];
+        const glm::vec3& b = vertices[indices[3 * t + 1]];
+        const glm::vec3& c = vertices[indices[3 * t + 2]];
+        triangleBounds[t] = { glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c)) };
+        centers[t] = triangleBounds[t].Center();
+        order[t] = t;
+    }
+
+    // Binary tree first, depth-first and iteratively: the left child is built right
+    // after its parent, and the parent learns its right child's index once that one
+    // is started.
+    std::vector<BinaryNode> binary;
+    std::vector<BuildTask> stack;
+    binary.reserve(count / 2);
+    packets.reserve(count / 4);
+    stack.push_back({ 0, count, -1 });
+    while (!stack.empty()) {
+        BuildTask task = stack.back();
+        stack.pop_back();
+        unsigned int index = static_cast<unsigned int>(binary.size());
+        if (task.parent >= 0) binary[task.parent].right = index;
+
+        AABB box = triangleBounds[order[task.first]];
+        AABB centerBox = { centers[order[task.first]], centers[order[task.first]] };
+        for (unsigned int k = task.first; k < task.first + task.count; k++) {
+            box = Merge(box, triangleBounds[order[k]]);
+            centerBox.min = glm::min(centerBox.min, centers[order[k]]);
+            centerBox.max = glm::max(centerBox.max, centers[order[k]]);
+        }
+        binary.push_back({ box, 0, 0 });
+
+        if (task.count <= static_cast<unsigned int>(TrianglePacket::SIZE)) {
+            binary[index].right = static_cast<unsigned int>(packets.size());
+            binary[index].count = task.count;
+            packets.emplace_back();
+            TrianglePacket& out = packets.back();
+            for (int lane = 0; lane < TrianglePacket::SIZE; lane++) {
+                unsigned int t = order[task.first + (static_cast<unsigned int>(lane) < task.count ? lane : 0)];
+                const glm::vec3& a = vertices[indices[3 * t]];
+                glm::vec3 e1 = vertices[indices[3 * t + 1]] - a;
+                glm::vec3 e2 = vertices[indices[3 * t + 2]] - a;
+                for (int i = 0; i < 3; i++) {
+                    out.v0[i][lane] = a[i];
+                    out.edge1[i][lane] = e1[i];
+                    out.edge2[i][lane] = e2[i];
+                }
+                out.triangle[lane] = t;
+            }
+            continue;
+        }
+
+        unsigned int mid = SplitSAH(triangleBounds, centers, order, task.first, task.count, centerBox);
+        // All centers coincide: split the range in half.
+        if (mid == task.first || mid == task.first + task.count) mid = task.first + task.count / 2;
+        stack.push_back({ mid, task.first + task.count - mid, static_cast<int>(index) });
+        stack.push_back({ task.first, mid - task.first, -1 });
+    }
+
+    bounds = binary[0].box;
+    glm::vec3 extent = glm::max(bounds.max - bounds.min, glm::vec3(1e-6f));
+    quantizeScale = 65535.0f / extent;
+
+    // Collapse: each BVH4 node takes a binary node's children and keeps opening the
+    // inner child with the largest surface area until it has four.
+    std::vector<std::pair<unsigned int, unsigned int>> work;    // (BVH4 node, binary node)
+    std::vector<unsigned int> nodeDepth;
+    nodes.reserve(binary.size() / 3 + 1);
+    nodes.emplace_back();
+    nodeDepth.push_back(0);
+    work.push_back({ 0, 0 });
+    while (!work.empty()) {
+        unsigned int node = work.back().first;
+        unsigned int source = work.back().second;
+        work.pop_back();
+        depth = std::max(depth, nodeDepth[node]);
+
+        unsigned int children[4];
+        int childCount = 0;
+        if (binary[source].count > 0) children[childCount++] = source;
+        else {
+            children[childCount++] = source + 1;
+            children[childCount++] = binary[source].right;
+        }
+        while (childCount < 4) {
+            int open = -1;
+            float openArea = -1.0f;
+            for (int k = 0; k < childCount; k++) {
+                const BinaryNode& child = binary[children[k]];
+                if (child.count == 0 && child.box.SurfaceArea() > openArea) {
+                    openArea = child.box.SurfaceArea();
+                    open = k;
+                }
+            }
+            if (open < 0) break;
+            unsigned int opened = children[open];
+            children[open] = opened + 1;
+            children[childCount++] = binary[opened].right;
+        }
+
+        for (int k = 0; k < 4; k++) {
+            if (k >= childCount) {
+                // Outside every query in any case; the traversal also skips it.
+                for (int i = 0; i < 6; i++) nodes[node].bounds[i][k] = 32767;
+                nodes[node].child[k] = EMPTY_CHILD;
+                continue;
+            }
+            const BinaryNode& child = binary[children[k]];
+            Quantize(child.box, nodes[node], k);
+            if (child.count > 0) {
+                nodes[node].child[k] = LEAF_BIT | (child.count - 1) << 28 | child.right;
+            }
+            else {
+                nodes[node].child[k] = static_cast<unsigned int>(nodes.size());
+                work.push_back({ static_cast<unsigned int>(nodes.size()), children[k] });
+                nodes.emplace_back();
+                nodeDepth.push_back(nodeDepth[node] + 1);
+            }
+        }
+    }
+    nodes.shrink_to_fit();
+    packets.shrink_to_fit();
+}
+
+void TriangleMesh::Quantize(const AABB& box, MeshBVHNode& node, int k) const {
+    for (int i = 0; i < 3; i++) {
+        // One extra step each way absorbs the rounding of the float multiply.
+        int lo = static_cast<int>(std::floor((box.min[i] - bounds.min[i]) * quantizeScale[i])) - 1;
+        int hi = static_cast<int>(std::ceil((box.max[i] - bounds.min[i]) * quantizeScale[i])) + 1;
+        lo = std::max(0, std::min(65535, lo));
+        hi = std::max(0, std::min(65535, hi));
+        node.bounds[i][k] = static_cast<short>(lo - 32768);
+        node.bounds[3 + i][k] = static_cast<short>(~(hi - 32768));
+    }
+}
+
+void TriangleMesh::QuantizeQuery(const AABB& box, __m128i query[3]) const {
+    short q[6];
+    for (int i = 0; i < 3; i++) {
+        int lo = static_cast<int>(std::floor((box.min[i] - bounds.min[i]) * quantizeScale[i]));
+        int hi = static_cast<int>(std::ceil((box.max[i] - bounds.min[i]) * quantizeScale[i]));
+        lo = std::max(0, std::min(65535, lo));
+        hi = std::max(0, std::min(65535, hi));
+        q[i] = static_cast<short>(hi - 32768);
+        q[3 + i] = static_cast<short>(~(lo - 32768));
+    }
+    // Two planes per register, four lanes each, matching MeshBVHNode::bounds.
+    for (int r = 0; r < 3; r++) {
+        short a = q[2 * r], b = q[2 * r + 1];
+        query[r] = _mm_setr_epi16(a, a, a, a, b, b, b, b);
+    }
+}
+
+size_t TriangleMesh::getMemoryUsage() const {
+    return nodes.capacity() * sizeof(MeshBVHNode) + packets.capacity() * sizeof(TrianglePacket);
+}
+
+float TriangleMesh::getAverageQueryCost() const {
+    unsigned long long queries = queryCount.load(std::memory_order_relaxed);
+    if (queries == 0) return 0.0f;
+    return static_cast<float>(queryVisits.load(std::memory_order_relaxed)) / static_cast<float>(queries);
+}
+
+void TriangleMesh::AddQueryStats(const MeshQueryStats& stats) const {
+    queryCount.fetch_add(stats.queries, std::memory_order_relaxed);
+    queryVisits.fetch_add(stats.visits, std::memory_order_relaxed);
+}
+
+void TriangleMesh::ResetQueryStats() {
+    queryCount.store(0, std::memory_order_relaxed);
+    queryVisits.store(0, std::memory_order_relaxed);
+}
+
+void ResolveMeshCollision(Sphere& sphere, const TriangleMesh& mesh, float deltaTime, MeshQueryStats* stats) {
+    float r = sphere.mesh->getRadius();
+    float reach = r + deltaTime * glm::length(sphere.velocity);
+    mesh.Query(AABB::FromSphere(sphere.position, reach), [&](const TrianglePacket& packet, unsigned int count) {
+#ifdef __AVX__
+        unsigned int hits = TouchMask<AVXLanes>(packet, 0, sphere.position, reach);
+#else
+        unsigned int hits = TouchMask<SSELanes>(packet, 0, sphere.position, reach);
+        if (count > 4) hits |= TouchMask<SSELanes>(packet, 4, sphere.position, reach) << 4;
+#endif
+        hits &= (1u << count) - 1;
+        for (int lane = 0; hits; lane++, hits >>= 1) {
+            if (hits & 1) ResolveTriangle(sphere, r, reach, deltaTime, packet, lane);
+        }
+    }, stats);
+}
+
+void ResolveMeshRange(std::vector<Sphere>& spheres, size_t left, size_t right, const TriangleMesh& mesh, float deltaTime) {
+    MeshQueryStats stats;
+    for (size_t i = left; i < right; i++) ResolveMeshCollision(spheres[i], mesh, deltaTime, &stats);
+    mesh.AddQueryStats(stats);
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include <emmintrin.h>
+#include <glm/glm.hpp>
+#include "aabb.h"
+#include "sphere.h"
+
+// Up to eight triangles of one leaf, as SoA lanes: the first corner and the two
+// edges leaving it. Unused lanes repeat lane 0.
+struct alignas(32) TrianglePacket {
+    static const int SIZE = 8;
+
+    float v0[3][SIZE];
+    float edge1[3][SIZE];    // v1 - v0
+    float edge2[3][SIZE];    // v2 - v0
+    unsigned int triangle[SIZE];
+};
+
+// 64-byte (one cache line) node of the mesh BVH4. The child bounds are quantized
+// to 16 bits per axis inside the mesh bounds (rounded outwards) and kept as signed
+// shorts, plane by plane: the minimum biased by -32768, the maximum also bitwise
+// negated. A child is then outside a prepared query box exactly when one of its six
+// values is greater than the query's, so three SSE compares test all four children.
+// child[k] is a node index, LEAF_BIT | (count - 1) << 28 | packet for a leaf, or
+// EMPTY_CHILD.
+struct alignas(64) MeshBVHNode {
+    short bounds[6][4];      // min x, y, z, then ~max x, y, z; four children each
+    unsigned int child[4];
+};
+
+// Node visits of a run of mesh queries, counted by the caller (one per thread or
+// batch) and merged into the mesh's totals once, so queries share no counter.
+struct MeshQueryStats {
+    unsigned long long queries = 0;
+    unsigned long long visits = 0;
+};
+
+// Static triangle-mesh collider (level geometry), built once.
+// The BVH is a binned SAH build like StaticBVH's with leaves of at most eight
+// triangles, collapsed into four-wide nodes the way WideBVH collapses the LBVH (the
+// child with the largest surface area is opened first). Each leaf's triangles are
+// copied into one TrianglePacket in leaf order, so a leaf is tested in one AVX pass
+// (or two SSE halves) without touching the vertex and index lists again.
+class TriangleMesh {
+public:
+    static const unsigned int LEAF_BIT = 0x80000000u;
+    static const unsigned int EMPTY_CHILD = 0x7FFFFFFFu;
+    static const unsigned int STACK_SIZE = 128;
+
+    TriangleMesh();
+
+    // Builds from an indexed triangle list (three indices per triangle).
+    void Build(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices);
+
+    // Calls callback(packet, count) for every leaf whose quantized bounds overlap 'box'.
+    // Safe to call from several threads. The visits are added to 'stats' if given.
+    template <typename Callback>
+    void Query(const AABB& box, Callback callback, MeshQueryStats* stats = nullptr) const;
+
+    size_t getTriangleCount() const { return triangleCount; }
+    const std::vector<TrianglePacket>& getPackets() const { return packets; }
+    size_t getNodeCount() const { return nodes.size(); }
+    size_t getMemoryUsage() const;
+    const AABB& getBounds() const { return bounds; }
+    // Average number of nodes visited per query merged since the last reset.
+    float getAverageQueryCost() const;
+    void AddQueryStats(const MeshQueryStats& stats) const;
+    void ResetQueryStats();
+
+private:
+    std::vector<MeshBVHNode> nodes;
+    std::vector<TrianglePacket> packets;
+    size_t triangleCount;
+    AABB bounds;
+    glm::vec3 quantizeScale;
+    unsigned int depth;     // BVH4 levels below the root
+
+    mutable std::atomic<unsigned long long> queryCount;
+    mutable std::atomic<unsigned long long> queryVisits;
+
+    // Query box in the nodes' plane order: the maximum, then the bitwise-negated minimum.
+    void QuantizeQuery(const AABB& box, __m128i query[3]) const;
+    void Quantize(const AABB& box, MeshBVHNode& node, int k) const;
+};
+
+// Closest point to p on the triangle abc.
+glm::vec3 ClosestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+
+// Sphere against the mesh: every leaf near the sphere is tested in SIMD lanes for
+// triangles within the radius, and those are then resolved one after another
+// through the closest point on the triangle, as the walls are: pushed out along
+// the normal at that point and reflected if moving into the triangle. Triangles
+// the sphere reaches within deltaTime are speculative contacts: a fast sphere loses
+// the speed that would carry it through the surface, and bounces once it touches.
+void ResolveMeshCollision(Sphere& sphere, const TriangleMesh& mesh, float deltaTime, MeshQueryStats* stats = nullptr);
+// The same for spheres [left, right), merging their query stats into the mesh once.
+void ResolveMeshRange(std::vector<Sphere>& spheres, size_t left, size_t right, const TriangleMesh& mesh, float deltaTime);
+
+template <typename Callback>
+void TriangleMesh::Query(const AABB& box, Callback callback, MeshQueryStats* stats) const {
+    if (nodes.empty() || !bounds.Overlaps(box)) return;
+
+    __m128i query[3];
+    QuantizeQuery(box, query);
+    // A node replaces itself by up to four children, so a query holds at most
+    // 3 * depth + 1 nodes. SAH builds stay well inside the fixed stack; a
+    // degenerate mesh spills to the heap.
+    unsigned int fixedStack[STACK_SIZE];
+    std::vector<unsigned int> heapStack;
+    unsigned int* stack = fixedStack;
+    if (3 * depth + 1 > STACK_SIZE) {
+        heapStack.resize(3 * static_cast<size_t>(depth) + 1);
+        stack = heapStack.data();
+    }
+    int top = 0;
+    stack[top++] = 0;
+    unsigned long long visits = 0;
+
+    while (top > 0) {
+        const MeshBVHNode& node = nodes[stack[--top]];
+        visits++;
+        const __m128i* planes = reinterpret_cast<const __m128i*>(node.bounds);
+        __m128i separated = _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi16(_mm_load_si128(planes), query[0]),
+            _mm_cmpgt_epi16(_mm_load_si128(planes + 1), query[1])), _mm_cmpgt_epi16(_mm_load_si128(planes + 2), query[2]));
+        // Fold the two halves so lane k holds child k's six planes, then one bit per child.
+        separated = _mm_or_si128(separated, _mm_srli_si128(separated, 8));
+        unsigned int mask = ~static_cast<unsigned int>(_mm_movemask_epi8(_mm_packs_epi16(separated, separated))) & 0xFu;
+
+        for (int k = 0; mask; k++, mask >>= 1) {
+            unsigned int child = node.child[k];
+            if (!(mask & 1) || child == EMPTY_CHILD) continue;
+            if (child & LEAF_BIT) callback(packets[child & 0x0FFFFFFFu], ((child >> 28) & 7u) + 1);
+            else stack[top++] = child;
+        }
+    }
+
+    if (stats) {
+        stats->queries++;
+        stats->visits += visits;
+    }
+}
@@ -0,0 +1,136 @@
+#include "wide_bvh.h"
+#include "parallel.h"
+#include <limits>
+
+template <int Width>
+void WideBVH<Width>::Update(const std::vector<Sphere>& spheres) {
+    binary.setSpeculativeTime(speculativeTime);
+    binary.Update(spheres);
+
+    nodes.clear();
+    if (binary.getLeafCount() < 2) return;
+    // A collapsed tree has at most one wide node per (Width - 1) binary nodes.
+    nodes.reserve(binary.getNodes().size() / (Width - 1) + 1);
+    Collapse(0);
+}
+
+template <int Width>
+int WideBVH<Width>::Collapse(int binaryNode) {
+    const std::vector<LBVHNode>& binaryNodes = binary.getNodes();
+    int index = static_cast<int>(nodes.size());
+    nodes.emplace_back();
+
+    // Open the largest internal child until the node is full.
+    int children[Width];
+    int count = 0;
+    children[count++] = binaryNodes[binaryNode].left;
+    children[count++] = binaryNodes[binaryNode].right;
+    while (count < Width) {
+        int best = -1;
+        float bestArea = -1.0f;
+        for (int k = 0; k < count; k++) {
+            if (children[k] < 0) continue;
+            float area = binaryNodes[children[k]].box.SurfaceArea();
+            if (area > bestArea) {
+                bestArea = area;
+                best = k;
+            }
+        }
+        if (best < 0) break;
+
+        int opened = children[best];
+        children[best] = binaryNodes[opened].left;
+        children[count++] = binaryNodes[opened].right;
+    }
+
+    const float inf = std::numeric_limits<float>::max();
+    for (int k = 0; k < Width; k++) {
+        AABB box = { glm::vec3(inf), glm::vec3(-inf) };
+        int child = -1;
+        int last = -1;
+        if (k < count) {
+            int c = children[k];
+            if (c >= 0) {
+                box = binaryNodes[c].box;
+                last = binaryNodes[c].last;
+                child = Collapse(c);
+            }
+            else {
+                box = binary.getLeafBox(~c);
+                last = ~c;
+                child = c;
+            }
+        }
+
+        // Collapse() may have grown the vector, so index rather than hold a reference.
+        Node& node = nodes[index];
+        node.minX[k] = box.min.x;
+        node.minY[k] = box.min.y;
+        node.minZ[k] = box.min.z;
+        node.maxX[k] = box.max.x;
+        node.maxY[k] = box.max.y;
+        node.maxZ[k] = box.max.z;
+        node.child[k] = child;
+        node.last[k] = last;
+    }
+    return index;
+}
+
+template <int Width>
+void WideBVH<Width>::FindPairs(std::vector<CollisionPair>& pairs) {
+    size_t count = binary.getLeafCount();
+    if (nodes.empty()) return;
+    threadPairs.resize(NumWorkerThreads());
+
+    ParallelForRange(count, [&](size_t left, size_t right, unsigned int batch) {
+        std::vector<CollisionPair>& out = threadPairs[batch];
+        out.clear();
+
+        int stack[STACK_SIZE];
+        for (size_t leaf = left; leaf < right; leaf++) {
+            int self = static_cast<int>(leaf);
+            const AABB& box = binary.getLeafBox(leaf);
+            const glm::vec3& p = binary.getLeafPosition(leaf);
+            float r = binary.getLeafRadius(leaf);
+
+            int top = 0;
+            stack[top++] = 0;
+            while (top > 0) {
+                const Node& node = nodes[stack[--top]];
+                // Lanes covering only leaves up to this one are masked off, so each
+                // pair is reported once.
+                unsigned int mask = OverlapMask(node, box, self);
+                while (mask) {
+                    int lane = 0;
+                    while (!(mask & (1u << lane))) lane++;
+                    mask &= mask - 1;
+
+                    int child = node.child[lane];
+                    if (child >= 0) {
+                        stack[top++] = child;
+                        continue;
+                    }
+                    int other = ~child;
+                    if (SpheresOverlap(p, r, binary.getLeafPosition(other), binary.getLeafRadius(other))) {
+                        unsigned int a = binary.getLeafBody(leaf);
+                        unsigned int b = binary.getLeafBody(other);
+                        out.push_back(a < b ? CollisionPair{ a, b } : CollisionPair{ b, a });
+                    }
+                }
+            }
+        }
+    });
+
+    for (std::vector<CollisionPair>& out : threadPairs) {
+        pairs.insert(pairs.end(), out.begin(), out.end());
+        out.clear();
+    }
+}
+
+template <int Width>
+size_t WideBVH<Width>::getMemoryUsage() const {
+    return binary.getMemoryUsage() + VectorBytes(nodes) + VectorBytes(threadPairs);
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
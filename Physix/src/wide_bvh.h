@@ -0,0 +1,143 @@
+#pragma once
+#include <vector>
+#include <immintrin.h>
+#include <glm/glm.hpp>
+#include "aabb.h"
+#include "broadphase.h"
+#include "lbvh.h"
+
+// Node of a Width-ary BVH. Child bounds are stored as SoA float lanes so one
+// SIMD compare tests a query box against all children at once.
+// child[k] >= 0 is another node, ~leaf for a leaf (a sphere in Morton order).
+// last[k] is the highest leaf index below lane k; empty lanes have inverted
+// bounds and last = -1, so they never match.
+template <int Width>
+struct alignas(32) WideBVHNode {
+    float minX[Width];
+    float minY[Width];
+    float minZ[Width];
+    float maxX[Width];
+    float maxY[Width];
+    float maxZ[Width];
+    int child[Width];
+    int last[Width];
+};
+
+// BVH4 / BVH8 broadphase.
+// The binary LBVH is built every Update() and then collapsed into Width-ary
+// nodes by repeatedly opening the child with the largest surface area.
+// Traversal uses a small explicit stack: a node costs one SIMD overlap test
+// (SSE per 4 lanes, a single AVX compare for 8 lanes when AVX is enabled)
+// instead of a pointer chase and a branch per child.
+template <int Width>
+class WideBVH : public Broadphase {
+    static_assert(Width == 4 || Width == 8, "WideBVH supports 4 or 8 children per node");
+
+public:
+    typedef WideBVHNode<Width> Node;
+    // A node pushes at most Width - 1 more entries than it pops, per level.
+    static const int STACK_SIZE = 64 * (Width - 1);
+
+    void Update(const std::vector<Sphere>& spheres) override;
+    void FindPairs(std::vector<CollisionPair>& pairs) override;
+    const char* getName() const override { return Width == 4 ? "BVH4" : "BVH8"; }
+    size_t getMemoryUsage() const override;
+
+    // Calls callback(leaf) for every leaf whose box overlaps 'box'.
+    template <typename Callback>
+    void Query(const AABB& box, Callback callback) const;
+
+    const std::vector<Node>& getNodes() const { return nodes; }
+    const LBVH& getBinaryTree() const { return binary; }
+
+    // Bit k is set if lane k overlaps the box and covers a leaf after 'after'.
+    static unsigned int OverlapMask(const Node& node, const AABB& box, int after);
+
+private:
+    LBVH binary;
+    std::vector<Node> nodes;
+    std::vector<std::vector<CollisionPair>> threadPairs;
+
+    int Collapse(int binaryNode);
+};
+
+template <int Width>
+inline unsigned int WideBVH<Width>::OverlapMask(const Node& node, const AABB& box, int after) {
+#ifdef __AVX__
+    if (Width == 8) {
+        __m256 overlap = _mm256_and_ps(
+            _mm256_and_ps(
+                _mm256_cmp_ps(_mm256_load_ps(node.minX), _mm256_set1_ps(box.max.x), _CMP_LE_OQ),
+                _mm256_cmp_ps(_mm256_load_ps(node.maxX), _mm256_set1_ps(box.min.x), _CMP_GE_OQ)),
+            _mm256_and_ps(
+                _mm256_and_ps(
+                    _mm256_cmp_ps(_mm256_load_ps(node.minY), _mm256_set1_ps(box.max.y), _CMP_LE_OQ),
+                    _mm256_cmp_ps(_mm256_load_ps(node.maxY), _mm256_set1_ps(box.min.y), _CMP_GE_OQ)),
+                _mm256_and_ps(
+                    _mm256_cmp_ps(_mm256_load_ps(node.minZ), _mm256_set1_ps(box.max.z), _CMP_LE_OQ),
+                    _mm256_cmp_ps(_mm256_load_ps(node.maxZ), _mm256_set1_ps(box.min.z), _CMP_GE_OQ))));
+#ifdef __AVX2__
+        __m256i later = _mm256_cmpgt_epi32(
+            _mm256_load_si256(reinterpret_cast<const __m256i*>(node.last)), _mm256_set1_epi32(after));
+        overlap = _mm256_and_ps(overlap, _mm256_castsi256_ps(later));
+        return static_cast<unsigned int>(_mm256_movemask_ps(overlap));
+#else
+        unsigned int mask = static_cast<unsigned int>(_mm256_movemask_ps(overlap));
+        for (int k = 0; k < 8; k++) {
+            if (node.last[k] <= after) mask &= ~(1u << k);
+        }
+        return mask;
+#endif
+    }
+#endif
+    unsigned int mask = 0;
+    __m128 qMaxX = _mm_set1_ps(box.max.x), qMinX = _mm_set1_ps(box.min.x);
+    __m128 qMaxY = _mm_set1_ps(box.max.y), qMinY = _mm_set1_ps(box.min.y);
+    __m128 qMaxZ = _mm_set1_ps(box.max.z), qMinZ = _mm_set1_ps(box.min.z);
+    __m128i qAfter = _mm_set1_epi32(after);
+
+    for (int lane = 0; lane < Width; lane += 4) {
+        __m128 overlap = _mm_and_ps(
+            _mm_and_ps(
+                _mm_cmple_ps(_mm_load_ps(node.minX + lane), qMaxX),
+                _mm_cmpge_ps(_mm_load_ps(node.maxX + lane), qMinX)),
+            _mm_and_ps(
+                _mm_and_ps(
+                    _mm_cmple_ps(_mm_load_ps(node.minY + lane), qMaxY),
+                    _mm_cmpge_ps(_mm_load_ps(node.maxY + lane), qMinY)),
+                _mm_and_ps(
+                    _mm_cmple_ps(_mm_load_ps(node.minZ + lane), qMaxZ),
+                    _mm_cmpge_ps(_mm_load_ps(node.maxZ + lane), qMinZ))));
+        __m128i later = _mm_cmpgt_epi32(_mm_load_si128(reinterpret_cast<const __m128i*>(node.last + lane)), qAfter);
+        overlap = _mm_and_ps(overlap, _mm_castsi128_ps(later));
+        mask |= static_cast<unsigned int>(_mm_movemask_ps(overlap)) << lane;
+    }
+    return mask;
+}
+
+template <int Width>
+template <typename Callback>
+void WideBVH<Width>::Query(const AABB& box, Callback callback) const {
+    if (nodes.empty()) {
+        // A single sphere has no internal node.
+        if (binary.getLeafCount() == 1 && binary.getLeafBox(0).Overlaps(box)) callback(0);
+        return;
+    }
+
+    int stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        unsigned int mask = OverlapMask(node, box, -1);
+        while (mask) {
+            int lane = 0;
+            while (!(mask & (1u << lane))) lane++;
+            mask &= mask - 1;
+
+            int child = node.child[lane];
+            if (child >= 0) stack[top++] = child;
+            else callback(~child);
+        }
+    }
+}